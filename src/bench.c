@@ -0,0 +1,476 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+/* ffmpeg */
+#include <libavformat/avformat.h>   // libavformat-dev  : Audio-Video Foramt - 用于音视频文件封装、解封装
+#include <libavcodec/avcodec.h>     // libavcodec-dev   : Audio-Video Codec - 用于音视频数据编解码
+#include <libavutil/pixdesc.h>     // libavutil-dev    : Audio-Video Utilities - 一些实用函数
+#include <libswscale/swscale.h>     // libswscale-dev   : Software Scale - 软件缩放算法
+
+#include "bench.h"
+#include "report.h"
+#include "convert.h"
+
+/* 等待解码数据的最长时间 */
+static const uint32_t WAIT_INTERVAL = 10;
+
+/* 定位测试的次数 */
+static const int SEEK_COUNT = 50;
+
+/* 定位测试的目标离文件结尾至少这么远，单位微秒，保证定位后还有帧可以显示 */
+static const int64_t SEEK_MARGIN = 1000000;
+
+/* 转换测试中每种实现重复转换同一帧的次数 */
+static const int CONVERT_ITERATIONS = 30;
+
+/* 转换测试的快速路径: 源的像素格式和相对转换后尺寸的倍数 */
+typedef struct ConvertCase
+{
+    enum AVPixelFormat format;
+    int factor;
+}ConvertCase;
+
+static const ConvertCase CONVERT_CASES[] = {
+    {AV_PIX_FMT_YUV420P,    1},     // copy
+    {AV_PIX_FMT_NV12,       1},     // nv12
+    {AV_PIX_FMT_YUV420P,    2},     // box2
+    {AV_PIX_FMT_YUV420P,    4},     // box4
+};
+
+/* 记录的帧间隔，单位纳秒 */
+typedef struct Intervals
+{
+    uint64_t* data;
+    size_t count;
+    size_t capacity;
+}Intervals;
+
+static void pushInterval(Intervals* intervals, uint64_t ns)
+{
+    if (intervals->count == intervals->capacity)
+    {
+        size_t capacity = intervals->capacity > 0 ? intervals->capacity * 2 : 1024;
+        uint64_t* data = realloc(intervals->data, sizeof(uint64_t) * capacity);
+        if (data == NULL)
+            return;
+
+        intervals->data = data;
+        intervals->capacity = capacity;
+    }
+
+    intervals->data[intervals->count++] = ns;
+}
+
+static int compareInterval(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// 百分位数，单位毫秒，intervals 需要已经排序
+static double percentile(const Intervals* intervals, double p)
+{
+    if (intervals->count == 0)
+        return 0;
+
+    size_t index = (size_t)(p / 100 * (intervals->count - 1) + 0.5);
+    return intervals->data[index] / 1e6;
+}
+
+// 消耗音频数据，代替音频回调
+static int drainAudio(void* userdata)
+{
+    DecoderData* data = (DecoderData*)(userdata);
+    int size = decoderAudioBufferSize(data);
+    uint8_t* buffer = malloc(size);
+    if (buffer == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return EXIT_FAILURE;
+    }
+
+    int64_t pts = 0;
+    int serial = 0;
+    while (!decoderIsEnd(data) || decoderCountAudio(data) > 0)
+    {
+        // 只在有数据时读取，避免把测试线程读得比解码快记为数据不足
+        if (decoderCountAudio(data) >= size || decoderIsEnd(data))
+            decoderReadAudio(data, buffer, size, &pts, &serial);
+        else
+            SDL_Delay(1);
+    }
+
+    free(buffer);
+    return EXIT_SUCCESS;
+}
+
+static int runDecoder(void* userdata)
+{
+    return decoderRun((DecoderData*)(userdata));
+}
+
+// 以 dummy 驱动初始化 SDL，打开文件并初始化解码器，失败时返回 NULL
+static DecoderData* openBench(const char* file, const DecoderOptions* options, int width, int height, bool* hasVideo, bool* hasAudio)
+{
+    // 使用 dummy 驱动，没有显示器和声卡的机器上也可以运行
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    SDL_Init(SDL_INIT_EVERYTHING);
+
+    DecoderData* data = createDecoder();
+    decoderSetOptions(data, options);
+    if (!decoderUnpack(data, file))
+    {
+        deleteDecoder(data);
+        SDL_Quit();
+        return NULL;
+    }
+
+    AVChannelLayout layout = AV_CHANNEL_LAYOUT_STEREO;
+    decoderInit(data, width, height, AV_PIX_FMT_YUV420P, &layout, AV_SAMPLE_FMT_FLT, 44100, hasVideo, hasAudio);
+    av_channel_layout_uninit(&layout);
+    return data;
+}
+
+int runBench(const char* file, const DecoderOptions* options, int width, int height, const char* statsFile)
+{
+    // 包括打开文件时的读取
+    ProcessIo startIo;
+    processIo(&startIo);
+
+    bool hasVideo = false;
+    bool hasAudio = false;
+    DecoderData* data = openBench(file, options, width, height, &hasVideo, &hasAudio);
+    if (data == NULL)
+        return EXIT_FAILURE;
+
+    // 不设置播放时钟，解码器不会因为落后而丢帧
+    uint64_t startNs = wallNs();
+    uint64_t startCpuNs = processCpuNs();
+    SDL_Thread* decodeThread = SDL_CreateThread(runDecoder, "threadDecode", data);
+    SDL_Thread* audioThread = hasAudio ? SDL_CreateThread(drainAudio, "benchAudio", data) : NULL;
+
+    Intervals intervals = {NULL, 0, 0};
+    uint64_t frames = 0;
+    uint64_t lastNs = startNs;
+    int64_t pts = 0;
+    while (hasVideo && (!decoderIsEnd(data) || decoderCountVideo(data) > 0))
+    {
+        AVFrame* frame = decoderWaitVideo(data, &pts, WAIT_INTERVAL);
+        if (frame == NULL)
+            continue;
+
+        decoderMarkMilestone(data, DECODER_MILESTONE_FIRST_VIDEO);
+        uint64_t now = wallNs();
+        pushInterval(&intervals, now - lastNs);
+        lastNs = now;
+        frames += 1;
+        av_frame_free(&frame);
+    }
+
+    SDL_WaitThread(decodeThread, NULL);
+    SDL_WaitThread(audioThread, NULL);
+    double seconds = (wallNs() - startNs) / 1e9;
+    double cpuSeconds = (processCpuNs() - startCpuNs) / 1e9;
+
+    ProcessIo io;
+    processIo(&io);
+
+    qsort(intervals.data, intervals.count, sizeof(uint64_t), compareInterval);
+
+    DecoderStats stats;
+    decoderGetStats(data, &stats);
+    const DecoderCounters* video = &(stats.video);
+    const DecoderCounters* audio = &(stats.audio);
+
+    printf("file:           %s\n", file);
+    printf("video decoder:  %s (%s, %.1f ms)\n", decoderVideoCodecName(data), decoderVideoCodecSource(data), decoderCalibrateTime(data) / 1e3);
+    printf("scale path:     %s\n", decoderScalePath(data));
+    printf("video frames:   %llu (decoded %llu, dropped %llu)\n",
+        (unsigned long long)frames, (unsigned long long)video->received, (unsigned long long)video->dropped);
+    printf("audio frames:   %llu (dropped %llu)\n",
+        (unsigned long long)audio->received, (unsigned long long)audio->dropped);
+    printf("wall time:      %.3f s\n", seconds);
+    printf("process cpu:    %.3f s\n", cpuSeconds);
+    printf("video fps:      %.1f\n", seconds > 0 ? frames / seconds : 0);
+    printf("ms per frame:   p50 %.3f  p99 %.3f\n", percentile(&intervals, 50), percentile(&intervals, 99));
+    printf("startup ms:   ");
+    for (int i = 0; i < DECODER_MILESTONE_COUNT; i++)
+    {
+        if (stats.milestones[i] >= 0)
+            printf("  %s %.1f", decoderMilestoneName(i), stats.milestones[i] / 1e3);
+    }
+    printf("\n");
+
+    // 解封装吞吐量: 文件大小除以 av_read_frame 的累计耗时
+    struct stat st;
+    double demuxSeconds = stats.stages[DECODER_STAGE_DEMUX].wallNs / 1e9;
+    if (stat(file, &st) == 0 && demuxSeconds > 0)
+        printf("demux MB/s:     %.1f\n", st.st_size / 1e6 / demuxSeconds);
+
+    printf("read syscalls:  %llu (%.1f MB)\n",
+        (unsigned long long)(io.readCalls - startIo.readCalls), (io.readBytes - startIo.readBytes) / 1e6);
+    printf("page faults:    minor %llu  major %llu\n",
+        (unsigned long long)(io.minorFaults - startIo.minorFaults), (unsigned long long)(io.majorFaults - startIo.majorFaults));
+    printf("packet buffer:  peak %.1f MB (budget %.1f MB), video peak %.0f ms, audio peak %.0f ms\n",
+        stats.gauges[DECODER_GAUGE_PACKET_BYTES].max / 1e6, options->bufferBytes / 1e6,
+        stats.gauges[DECODER_GAUGE_VIDEO_BUFFERED].max / 1e3, stats.gauges[DECODER_GAUGE_AUDIO_BUFFERED].max / 1e3);
+    if (stats.input.reads > 0)
+    {
+        printf("input reads:    %llu (%.1f MB, %llu seeks, %llu syscalls)\n",
+            (unsigned long long)stats.input.reads, stats.input.bytes / 1e6,
+            (unsigned long long)stats.input.seeks, (unsigned long long)stats.input.syscalls);
+        printf("input stalls:   %llu (%.1f ms waiting, %llu window invalidations)\n",
+            (unsigned long long)stats.input.stalls, stats.input.stallNs / 1e6,
+            (unsigned long long)stats.input.invalidations);
+    }
+
+    printf("video pool:     %llu buffers, %llu hits, %llu misses\n",
+        (unsigned long long)stats.videoPool.count, (unsigned long long)stats.videoPool.hits,
+        (unsigned long long)stats.videoPool.misses);
+
+    printf("%-14s %10s %12s %12s %14s %10s %10s %10s\n", "stage", "calls", "wall ms", "cpu ms", "cpu us/call", "p50 us", "p99 us", "max us");
+    for (int i = 0; i < DECODER_STAGE_COUNT; i++)
+    {
+        const StageStats* stage = &(stats.stages[i]);
+        if (stage->count == 0)
+            continue;
+
+        printf("%-14s %10llu %12.1f %12.1f %14.1f %10llu %10llu %10llu\n",
+            decoderStageName(i),
+            (unsigned long long)stage->count,
+            stage->wallNs / 1e6,
+            stage->cpuNs / 1e6,
+            stage->cpuNs / 1e3 / stage->count,
+            (unsigned long long)stagePercentileUs(stage, 50),
+            (unsigned long long)stagePercentileUs(stage, 99),
+            (unsigned long long)(stage->maxNs / 1000)
+        );
+    }
+
+    if (statsFile != NULL)
+        writeStats(statsFile, &stats);
+
+    free(intervals.data);
+    deleteDecoder(data);
+    SDL_Quit();
+    return EXIT_SUCCESS;
+}
+
+int runSeekBench(const char* file, const DecoderOptions* options, int width, int height, const char* statsFile)
+{
+    bool hasVideo = false;
+    bool hasAudio = false;
+    DecoderData* data = openBench(file, options, width, height, &hasVideo, &hasAudio);
+    if (data == NULL)
+        return EXIT_FAILURE;
+
+    int64_t duration = decoderDuration(data);
+    if (!hasVideo || duration == CLOCK_NONE || duration <= SEEK_MARGIN)
+    {
+        fprintf(stderr, "cannot seek: no video or unknown duration\n");
+        deleteDecoder(data);
+        SDL_Quit();
+        return EXIT_FAILURE;
+    }
+
+    // 等待关键帧索引完整，没有封装格式自带的索引也没有旁路缓存时需要扫描整个文件
+    uint64_t startNs = wallNs();
+    while (!decoderIndexReady(data))
+        SDL_Delay(1);
+    double indexMs = (wallNs() - startNs) / 1e6;
+
+    SDL_Thread* decodeThread = SDL_CreateThread(runDecoder, "threadDecode", data);
+    SDL_Thread* audioThread = hasAudio ? SDL_CreateThread(drainAudio, "benchAudio", data) : NULL;
+
+    // 固定种子的线性同余序列，每次运行定位到相同的位置
+    Intervals latencies = {NULL, 0, 0};
+    uint64_t seed = 1;
+    int64_t errorSum = 0;
+    int64_t errorMax = 0;
+    int seeks = 0;
+    for (int i = 0; i < SEEK_COUNT && !decoderIsEnd(data); i++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        int64_t target = (int64_t)((seed >> 33) % (uint64_t)(duration - SEEK_MARGIN));
+
+        // 定位延迟: 从发出请求到取得新位置的第一帧
+        uint64_t seekNs = wallNs();
+        decoderSeek(data, target);
+
+        int64_t pts = 0;
+        AVFrame* frame = NULL;
+        while (frame == NULL && !decoderIsEnd(data))
+            frame = decoderWaitVideo(data, &pts, WAIT_INTERVAL);
+
+        if (frame == NULL)
+            break;
+
+        pushInterval(&latencies, wallNs() - seekNs);
+        av_frame_free(&frame);
+
+        // 精度: 第一帧的时间戳与目标位置之差，正常情况下不超过一帧的时长
+        int64_t error = pts > target ? pts - target : target - pts;
+        errorSum += error;
+        errorMax = error > errorMax ? error : errorMax;
+        seeks += 1;
+    }
+
+    decoderSetEnd(data, true);
+    SDL_WaitThread(decodeThread, NULL);
+    SDL_WaitThread(audioThread, NULL);
+
+    qsort(latencies.data, latencies.count, sizeof(uint64_t), compareInterval);
+
+    DecoderStats stats;
+    decoderGetStats(data, &stats);
+    const StageStats* seek = &(stats.stages[DECODER_STAGE_SEEK]);
+
+    printf("file:           %s\n", file);
+    printf("keyframes:      %d (index ready after %.1f ms)\n", decoderKeyframes(data), indexMs);
+    printf("seeks:          %d\n", seeks);
+    printf("seek ms:        p50 %.3f  p99 %.3f  max %.3f\n",
+        percentile(&latencies, 50), percentile(&latencies, 99), percentile(&latencies, 100));
+    printf("demux seek us:  p50 %llu  p99 %llu\n",
+        (unsigned long long)stagePercentileUs(seek, 50), (unsigned long long)stagePercentileUs(seek, 99));
+    printf("pts error ms:   mean %.3f  max %.3f\n", seeks > 0 ? errorSum / 1e3 / seeks : 0, errorMax / 1e3);
+
+    if (statsFile != NULL)
+        writeStats(statsFile, &stats);
+
+    free(latencies.data);
+    deleteDecoder(data);
+    SDL_Quit();
+    return EXIT_SUCCESS;
+}
+
+// 分配一帧，各平面按 SIMD 宽度对齐
+static AVFrame* allocBenchFrame(enum AVPixelFormat format, int width, int height)
+{
+    AVFrame* frame = av_frame_alloc();
+    if (frame == NULL)
+        return NULL;
+
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 32) < 0)
+        av_frame_free(&frame);
+
+    return frame;
+}
+
+// 两帧 YUV420P 的可见部分是否完全相同
+static bool sameFrame(const AVFrame* a, const AVFrame* b)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int width = plane == 0 ? a->width : a->width / 2;
+        int height = plane == 0 ? a->height : a->height / 2;
+        for (int y = 0; y < height; y++)
+        {
+            if (memcmp(a->data[plane] + y * a->linesize[plane], b->data[plane] + y * b->linesize[plane], width) != 0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+int runConvertBench(const DecoderOptions* options, int width, int height)
+{
+    int best = (int)convertBestIsa();
+    AVFrame* outputs[CONVERT_ISA_COUNT] = {NULL};
+    AVFrame* scaled = allocBenchFrame(AV_PIX_FMT_YUV420P, width, height);
+    bool allocated = scaled != NULL;
+    for (int isa = 0; isa <= best; isa++)
+    {
+        outputs[isa] = allocBenchFrame(AV_PIX_FMT_YUV420P, width, height);
+        allocated = allocated && outputs[isa] != NULL;
+    }
+
+    int status = EXIT_SUCCESS;
+    printf("%-6s %-22s %-10s %10s %10s\n", "path", "source", "impl", "ms/frame", "vs sws");
+    for (size_t i = 0; i < sizeof(CONVERT_CASES) / sizeof(CONVERT_CASES[0]) && status == EXIT_SUCCESS; i++)
+    {
+        const ConvertCase* test = &(CONVERT_CASES[i]);
+        int srcWidth = width * test->factor;
+        int srcHeight = height * test->factor;
+        AVFrame* src = allocBenchFrame(test->format, srcWidth, srcHeight);
+        struct SwsContext* context = sws_getContext(srcWidth, srcHeight, test->format, width, height, AV_PIX_FMT_YUV420P,
+            options->scaleFlags, NULL, NULL, NULL);
+        if (src == NULL || !allocated || context == NULL)
+        {
+            fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+            av_frame_free(&src);
+            sws_freeContext(context);
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        // 固定种子的线性同余序列填充源帧，每次运行的输入相同
+        uint32_t seed = 1;
+        for (int plane = 0; plane < AV_NUM_DATA_POINTERS && src->data[plane] != NULL; plane++)
+        {
+            int rows = plane == 0 ? srcHeight : srcHeight / 2;
+            for (int y = 0; y < rows; y++)
+            {
+                for (int x = 0; x < src->linesize[plane]; x++)
+                {
+                    seed = seed * 1664525 + 1013904223;
+                    src->data[plane][y * src->linesize[plane] + x] = (uint8_t)(seed >> 24);
+                }
+            }
+        }
+
+        char source[32];
+        snprintf(source, sizeof(source), "%s %dx%d", av_get_pix_fmt_name(test->format), srcWidth, srcHeight);
+
+        uint64_t startNs = wallNs();
+        for (int k = 0; k < CONVERT_ITERATIONS; k++)
+            sws_scale(context, (const uint8_t* const*)(src->data), src->linesize, 0, srcHeight, scaled->data, scaled->linesize);
+        double swsMs = (wallNs() - startNs) / 1e6 / CONVERT_ITERATIONS;
+        sws_freeContext(context);
+
+        const char* name = "";
+        for (int isa = 0; isa <= best; isa++)
+        {
+            Converter* converter = createConverter(test->format, srcWidth, srcHeight, AV_PIX_FMT_YUV420P, width, height, isa);
+            if (converter == NULL)
+            {
+                fprintf(stderr, "no fast path for %s\n", source);
+                status = EXIT_FAILURE;
+                break;
+            }
+
+            name = converterName(converter);
+            startNs = wallNs();
+            for (int k = 0; k < CONVERT_ITERATIONS; k++)
+                convertSlice(converter, src, outputs[isa], 0, height);
+            double ms = (wallNs() - startNs) / 1e6 / CONVERT_ITERATIONS;
+            deleteConverter(converter);
+
+            printf("%-6s %-22s %-10s %10.3f %9.1fx\n", name, source, convertIsaName(isa), ms, ms > 0 ? swsMs / ms : 0);
+
+            // SIMD 实现与 C 实现的输出必须逐字节相同
+            if (isa > CONVERT_ISA_C && !sameFrame(outputs[CONVERT_ISA_C], outputs[isa]))
+            {
+                fprintf(stderr, "%s: %s output differs from c\n", name, convertIsaName(isa));
+                status = EXIT_FAILURE;
+            }
+        }
+
+        printf("%-6s %-22s %-10s %10.3f %9.1fx\n", name, source, "sws_scale", swsMs, 1.0);
+        av_frame_free(&src);
+    }
+
+    for (int isa = 0; isa <= best; isa++)
+        av_frame_free(&(outputs[isa]));
+    av_frame_free(&scaled);
+    return status;
+}
@@ -0,0 +1,17 @@
+#ifndef FFMPEG_PLAYER_DEMO_BENCH
+#define FFMPEG_PLAYER_DEMO_BENCH
+
+#include "decoder.h"
+
+// 无窗口、不按播放时间同步，以最快速度运行解码器，输出解码吞吐量
+// width、height 为缩放后的视频尺寸，与正常播放时相同，statsFile 不为 NULL 时结束后把运行统计写入该文件
+int runBench(const char* file, const DecoderOptions* options, int width, int height, const char* statsFile);
+
+// 无窗口，随机定位到文件中的若干位置，输出从请求定位到取得新位置第一帧的延迟，以及第一帧时间戳的误差
+int runSeekBench(const char* file, const DecoderOptions* options, int width, int height, const char* statsFile);
+
+// 不需要文件，在合成的帧上对比各个快速路径的 C/SSE2/AVX2 实现和 sws_scale 的耗时，并检查各指令集的输出一致
+// width、height 为转换后的尺寸，sws_scale 使用 options 中的缩放算法
+int runConvertBench(const DecoderOptions* options, int width, int height);
+
+#endif // FFMPEG_PLAYER_DEMO_BENCH
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+/* ffmpeg */
+#include <libavcodec/avcodec.h>     // libavcodec-dev   : Audio-Video Codec - 用于音视频数据编解码
+
+#include "codecs.h"
+
+// 检查解码器选择缓存文件的读写: 记录的读取、同一编码和分辨率的替换、失效记录的忽略，以及多个线程同时写入时文件始终完整
+// 缓存文件放在当前目录下的 check-cache 目录中，同时检查不存在的上级目录会被创建，结束后删除
+
+#define CHECK_DIR           "check-cache"
+#define CHECK_FILE          CHECK_DIR "/cache/decoders"
+
+// 同时写入的线程数和每个线程写入的次数
+#define WRITER_THREADS      4
+#define WRITER_COUNT        200
+
+typedef struct WriterData
+{
+    int width;
+    const AVCodec* codec;
+    atomic_int* running;        // 还没有写完的线程数
+}WriterData;
+
+static bool check(const char* name, bool ok)
+{
+    printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// 统计缓存文件的行数，有不能解析的行时返回 -1
+static int countLines(const char* file)
+{
+    FILE* fp = fopen(file, "r");
+    if (fp == NULL)
+        return 0;
+
+    int count = 0;
+    char line[256];
+    char name[256];
+    char decoder[256];
+    int w = 0;
+    int h = 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (sscanf(line, "%255s %dx%d %255s", name, &w, &h, decoder) != 4)
+        {
+            count = -1;
+            break;
+        }
+
+        count += 1;
+    }
+
+    fclose(fp);
+    return count;
+}
+
+static void appendLine(const char* file, const char* line)
+{
+    FILE* fp = fopen(file, "a");
+    if (fp == NULL)
+        return;
+
+    fputs(line, fp);
+    fclose(fp);
+}
+
+static int writer(void* userdata)
+{
+    WriterData* data = (WriterData*)(userdata);
+    for (int i = 0; i < WRITER_COUNT; i++)
+        saveDecoderChoice(CHECK_FILE, data->codec->id, data->width, 720, data->codec);
+
+    atomic_fetch_sub(data->running, 1);
+    return EXIT_SUCCESS;
+}
+
+// 多个线程各自反复写入一个分辨率，写入互相覆盖可能丢掉别的线程的记录，但读到的文件不能是空的或者有半行，
+// 结束后同一分辨率不能重复；共用一个临时文件时一个线程可能把另一个线程刚截断的文件改名成缓存文件
+// 各个分辨率的位数不同，互相覆盖的内容对不齐时会留下半行
+static bool checkConcurrent(const AVCodec* codec)
+{
+    static const int widths[WRITER_THREADS] = {64, 640, 6400, 64000};
+    remove(CHECK_FILE);
+    saveDecoderChoice(CHECK_FILE, codec->id, widths[0], 720, codec);
+
+    atomic_int running = WRITER_THREADS;
+    SDL_Thread* threads[WRITER_THREADS];
+    WriterData data[WRITER_THREADS];
+    for (int i = 0; i < WRITER_THREADS; i++)
+    {
+        data[i].width = widths[i];
+        data[i].codec = codec;
+        data[i].running = &running;
+        threads[i] = SDL_CreateThread(writer, "checkWriter", &(data[i]));
+    }
+
+    bool ok = true;
+    while (atomic_load(&running) > 0)
+        ok = countLines(CHECK_FILE) > 0 && ok;
+
+    for (int i = 0; i < WRITER_THREADS; i++)
+        SDL_WaitThread(threads[i], NULL);
+
+    int lines = countLines(CHECK_FILE);
+    int found = 0;
+    for (int i = 0; i < WRITER_THREADS; i++)
+        found += loadDecoderChoice(CHECK_FILE, codec->id, data[i].width, 720) == codec;
+
+    return ok && lines >= 1 && lines == found;
+}
+
+// 用法: check-codecs
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    const AVCodec* h264 = avcodec_find_decoder(AV_CODEC_ID_H264);
+    const AVCodec* hevc = avcodec_find_decoder(AV_CODEC_ID_HEVC);
+    if (h264 == NULL || hevc == NULL)
+    {
+        fprintf(stderr, "h264 and hevc decoders are required\n");
+        return EXIT_FAILURE;
+    }
+
+    // 有第二个 H.264 解码器时用它检查替换，没有时用同一个，仍然检查只留下一条记录
+    const AVCodec* decoders[2];
+    const AVCodec* other = listDecoders(AV_CODEC_ID_H264, decoders, 2) == 2 && decoders[0] == h264 ? decoders[1] : decoders[0];
+
+    remove(CHECK_FILE);
+    bool ok = true;
+    ok = check("missing file", loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 1920, 1080) == NULL) && ok;
+
+    saveDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 1920, 1080, h264);
+    ok = check("save creates directories", countLines(CHECK_FILE) == 1) && ok;
+    ok = check("load saved choice", loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 1920, 1080) == h264) && ok;
+    ok = check("other resolution", loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 1280, 720) == NULL) && ok;
+    ok = check("other codec", loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_HEVC, 1920, 1080) == NULL) && ok;
+
+    saveDecoderChoice(CHECK_FILE, AV_CODEC_ID_HEVC, 3840, 2160, hevc);
+    ok = check("second record", countLines(CHECK_FILE) == 2 &&
+        loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 1920, 1080) == h264 &&
+        loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_HEVC, 3840, 2160) == hevc) && ok;
+
+    saveDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 1920, 1080, other);
+    ok = check("replace record", countLines(CHECK_FILE) == 2 &&
+        loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 1920, 1080) == other &&
+        loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_HEVC, 3840, 2160) == hevc) && ok;
+
+    // 手工写入的记录: 不存在的解码器、编码对不上的解码器
+    char line[256];
+    appendLine(CHECK_FILE, "h264 640x480 no_such_decoder\n");
+    snprintf(line, sizeof(line), "h264 320x240 %s\n", hevc->name);
+    appendLine(CHECK_FILE, line);
+    ok = check("unknown decoder", loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 640, 480) == NULL) && ok;
+    ok = check("decoder for another codec", loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 320, 240) == NULL) && ok;
+
+    saveDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 640, 480, h264);
+    ok = check("replace stale record", countLines(CHECK_FILE) == 4 &&
+        loadDecoderChoice(CHECK_FILE, AV_CODEC_ID_H264, 640, 480) == h264) && ok;
+
+    ok = check("concurrent writers", checkConcurrent(h264)) && ok;
+
+    remove(CHECK_FILE);
+    remove(CHECK_DIR "/cache");
+    remove(CHECK_DIR);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "sheet.h"
+
+// 检查缩略图拼图: 网格的行列数、超过上限后保留的缩略图的间隔和顺序，以及逐行写出的 PPM 中每一格的内容
+// 每张缩略图的像素都是它的序号，写出后按格子读回对比；拼图写在当前目录下的 check-sheet.ppm，结束后删除
+
+#define CHECK_FILE      "check-sheet.ppm"
+
+// 缩略图尺寸取奇数宽度，行宽不是 4 的倍数时也要按字节拼接
+#define THUMB_WIDTH     5
+#define THUMB_HEIGHT    3
+
+static bool check(const char* name, bool ok)
+{
+    printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool checkLayout(int count, int cols, int rows)
+{
+    int c = 0;
+    int r = 0;
+    layoutSheet(count, &c, &r);
+    return c == cols && r == rows;
+}
+
+// 读回拼图，检查第 i 格是追加的第 i * stride 张，空余的格子为黑色
+static bool checkFile(int count, int stride)
+{
+    int cols = 0;
+    int rows = 0;
+    layoutSheet(count, &cols, &rows);
+
+    FILE* fp = fopen(CHECK_FILE, "rb");
+    if (fp == NULL)
+        return false;
+
+    int width = 0;
+    int height = 0;
+    bool ok = fscanf(fp, "P6 %d %d 255", &width, &height) == 2 && fgetc(fp) == '\n' &&
+        width == cols * THUMB_WIDTH && height == rows * THUMB_HEIGHT;
+
+    for (int y = 0; y < height && ok; y++)
+    {
+        for (int x = 0; x < width && ok; x++)
+        {
+            int cell = y / THUMB_HEIGHT * cols + x / THUMB_WIDTH;
+            int expected = cell < count ? (cell * stride) & 0xff : 0;
+            for (int k = 0; k < 3 && ok; k++)
+                ok = fgetc(fp) == expected;
+        }
+    }
+
+    ok = ok && fgetc(fp) == EOF;
+    fclose(fp);
+    return ok;
+}
+
+// 追加 added 张，检查保留的张数、间隔和写出的内容
+static bool checkSheet(int max, int added, int count, int stride)
+{
+    Sheet* sheet = createSheet(THUMB_WIDTH, THUMB_HEIGHT, max);
+    if (sheet == NULL)
+        return false;
+
+    uint8_t thumb[THUMB_WIDTH * THUMB_HEIGHT * 3];
+    bool ok = true;
+    for (int i = 0; i < added && ok; i++)
+    {
+        memset(thumb, i & 0xff, sizeof(thumb));
+        ok = addSheet(sheet, thumb);
+    }
+
+    ok = ok && countSheet(sheet) == count && strideSheet(sheet) == stride;
+    ok = ok && writeSheet(sheet, CHECK_FILE) && checkFile(count, stride);
+    deleteSheet(sheet);
+    remove(CHECK_FILE);
+    return ok;
+}
+
+// 用法: check-sheet
+int main(void)
+{
+    bool ok = true;
+    ok = check("layout 1", checkLayout(1, 1, 1)) && ok;
+    ok = check("layout 2", checkLayout(2, 2, 1)) && ok;
+    ok = check("layout 5", checkLayout(5, 3, 2)) && ok;
+    ok = check("layout 16", checkLayout(16, 4, 4)) && ok;
+    ok = check("layout 17", checkLayout(17, 5, 4)) && ok;
+
+    // 上限 8: 追加 7 张全部保留；第 8 张时保留 0 2 4 6，之后每两张一张；16 张时再减半
+    ok = check("single thumbnail", checkSheet(8, 1, 1, 1)) && ok;
+    ok = check("below limit", checkSheet(8, 7, 7, 1)) && ok;
+    ok = check("limit reached", checkSheet(8, 8, 4, 2)) && ok;
+    ok = check("after first halving", checkSheet(8, 13, 7, 2)) && ok;
+    ok = check("second halving", checkSheet(8, 16, 4, 4)) && ok;
+    ok = check("many thumbnails", checkSheet(256, 3600, 225, 16)) && ok;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
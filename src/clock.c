@@ -0,0 +1,58 @@
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+#include "clock.h"
+
+int64_t clockNowUs(void)
+{
+    // 先按整秒换算再换算余数，避免计数器乘以 1000000 时溢出
+    static Uint64 frequency = 0;
+    if (frequency == 0)
+        frequency = SDL_GetPerformanceFrequency();
+
+    Uint64 counter = SDL_GetPerformanceCounter();
+    return (int64_t)(counter / frequency * 1000000 + counter % frequency * 1000000 / frequency);
+}
+
+void resetClock(Clock* clock)
+{
+    clock->base = CLOCK_NONE;
+}
+
+void setClock(Clock* clock, int64_t pts)
+{
+    clock->base = clockNowUs() - pts;
+}
+
+int64_t adjustClock(Clock* clock, int64_t pts, int64_t jitter)
+{
+    // 其它线程可能同时 setClock、resetClock，读取、计算、写回用比较交换完成
+    // 基准在两者之间被改过时交换失败，base 更新为新的值，按新的基准重新计算，不会覆盖别人的修改
+    int64_t now = clockNowUs();
+    int64_t base = atomic_load(&(clock->base));
+    int64_t error = 0;
+    int64_t next = 0;
+    do
+    {
+        if (base == CLOCK_NONE)
+        {
+            error = 0;
+            next = now - pts;
+        }
+        else
+        {
+            error = (now - base) - pts;
+            next = error > jitter || error < -jitter ? now - pts : base + error / 8;
+        }
+    } while (!atomic_compare_exchange_weak(&(clock->base), &base, next));
+
+    return error;
+}
+
+int64_t readClock(Clock* clock)
+{
+    int64_t base = clock->base;
+    if (base == CLOCK_NONE)
+        return CLOCK_NONE;
+
+    return clockNowUs() - base;
+}
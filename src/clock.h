@@ -0,0 +1,32 @@
+#ifndef FFMPEG_PLAYER_DEMO_CLOCK
+#define FFMPEG_PLAYER_DEMO_CLOCK
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// 没有时间: 时钟还没开始，或没有读到数据
+#define CLOCK_NONE INT64_MIN
+
+// 播放时钟，单位微秒，可以在任意线程读写
+// 只保存播放位置为 0 的时刻，读取时加上经过的时间，不需要加锁
+typedef struct Clock
+{
+    _Atomic int64_t base;
+}Clock;
+
+// 单调时间，单位微秒，由 SDL_GetPerformanceCounter 换算
+int64_t clockNowUs(void);
+
+void resetClock(Clock* clock);
+
+// 设置时钟: 当前时刻的播放位置为 pts 微秒
+void setClock(Clock* clock, int64_t pts);
+
+// 用参考时间修正时钟，返回修正前的偏差（时钟减参考时间），时钟还没开始时直接设置并返回 0
+// 偏差小于 jitter 时只修正八分之一，滤掉参考时间本身的抖动；偏差大时直接跳到参考时间
+int64_t adjustClock(Clock* clock, int64_t pts, int64_t jitter);
+
+// 当前的播放位置，单位微秒，还没开始时返回 CLOCK_NONE
+int64_t readClock(Clock* clock);
+
+#endif // FFMPEG_PLAYER_DEMO_CLOCK
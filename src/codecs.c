@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <errno.h>
+#include <sys/stat.h>
+#endif
+
+/* ffmpeg */
+#include <libavcodec/avcodec.h>     // libavcodec-dev   : Audio-Video Codec - 用于音视频数据编解码
+
+#include "codecs.h"
+#include "tempfile.h"
+
+// 缓存文件名
+#define CACHE_NAME      "ffmpeg-player-demo-decoders"
+
+// 缓存文件一行的最大长度
+#define CACHE_LINE      256
+
+// 缓存文件路径的最大长度
+#define CACHE_PATH      1024
+
+int listDecoders(enum AVCodecID id, const AVCodec** decoders, int max)
+{
+    int count = 0;
+    void* opaque = NULL;
+    const AVCodec* codec = NULL;
+    while (count < max && (codec = av_codec_iterate(&opaque)) != NULL)
+    {
+        if (av_codec_is_decoder(codec) && codec->id == id && !(codec->capabilities & AV_CODEC_CAP_EXPERIMENTAL))
+            decoders[count++] = codec;
+    }
+
+    return count;
+}
+
+bool defaultDecoderCache(char* path, size_t size)
+{
+#ifdef _WIN32
+    const char* dir = getenv("LOCALAPPDATA");
+    if (dir != NULL && dir[0] != '\0')
+        return snprintf(path, size, "%s\\%s", dir, CACHE_NAME) < (int)size;
+#else
+    const char* dir = getenv("XDG_CACHE_HOME");
+    if (dir != NULL && dir[0] != '\0')
+        return snprintf(path, size, "%s/%s", dir, CACHE_NAME) < (int)size;
+
+    dir = getenv("HOME");
+    if (dir != NULL && dir[0] != '\0')
+        return snprintf(path, size, "%s/.cache/%s", dir, CACHE_NAME) < (int)size;
+#endif
+
+    return false;
+}
+
+// 缓存文件每行一条记录: <编码名称> <宽>x<高> <解码器名称>，例如 "hevc 3840x2160 hevc_cuvid"
+const AVCodec* loadDecoderChoice(const char* cacheFile, enum AVCodecID id, int width, int height)
+{
+    FILE* fp = fopen(cacheFile, "r");
+    if (fp == NULL)
+        return NULL;
+
+    const char* codecName = avcodec_get_name(id);
+    char line[CACHE_LINE];
+    char name[CACHE_LINE];
+    char choice[CACHE_LINE] = "";
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char decoder[CACHE_LINE];
+        int w = 0;
+        int h = 0;
+        if (sscanf(line, "%255s %dx%d %255s", name, &w, &h, decoder) == 4 &&
+            strcmp(name, codecName) == 0 && w == width && h == height)
+        {
+            strcpy(choice, decoder);
+        }
+    }
+
+    fclose(fp);
+    if (choice[0] == '\0')
+        return NULL;
+
+    // FFmpeg 升级或换了构建后记录的解码器可能不存在了
+    const AVCodec* codec = avcodec_find_decoder_by_name(choice);
+    return codec != NULL && codec->id == id ? codec : NULL;
+}
+
+// 依次创建 file 所在的各级目录，已经存在的跳过
+static void makeParentDirs(const char* file)
+{
+    char path[CACHE_PATH];
+    if (snprintf(path, sizeof(path), "%s", file) >= (int)sizeof(path))
+        return;
+
+    // 从第二个字符开始，跳过绝对路径开头的分隔符
+    for (char* p = path + 1; *p != '\0'; p++)
+    {
+#ifdef _WIN32
+        if (*p != '/' && *p != '\\')
+            continue;
+        char separator = *p;
+        *p = '\0';
+        if (p[-1] != ':')
+            _mkdir(path);
+        *p = separator;
+#else
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST)
+            return;
+        *p = '/';
+#endif
+    }
+}
+
+// 同一编码和分辨率只保留一条记录: 复制其它记录到临时文件，再写入新的记录，最后改名替换
+// 同时写入的进程和线程各自使用自己的临时文件，后改名的覆盖先改名的
+void saveDecoderChoice(const char* cacheFile, enum AVCodecID id, int width, int height, const AVCodec* codec)
+{
+    makeParentDirs(cacheFile);
+
+    char temp[CACHE_PATH];
+    FILE* fp = openTempFile(cacheFile, temp, sizeof(temp), "w");
+    if (fp == NULL)
+        return;
+
+    const char* codecName = avcodec_get_name(id);
+    bool ok = true;
+    FILE* old = fopen(cacheFile, "r");
+    if (old != NULL)
+    {
+        char line[CACHE_LINE];
+        char name[CACHE_LINE];
+        while (ok && fgets(line, sizeof(line), old) != NULL)
+        {
+            int w = 0;
+            int h = 0;
+            if (sscanf(line, "%255s %dx%d", name, &w, &h) == 3 &&
+                strcmp(name, codecName) == 0 && w == width && h == height)
+            {
+                continue;
+            }
+
+            ok = fputs(line, fp) >= 0;
+        }
+
+        fclose(old);
+    }
+
+    ok = fprintf(fp, "%s %dx%d %s\n", codecName, width, height, codec->name) > 0 && ok;
+    replaceFile(fp, temp, cacheFile, ok);
+}
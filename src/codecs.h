@@ -0,0 +1,22 @@
+#ifndef FFMPEG_PLAYER_DEMO_CODECS
+#define FFMPEG_PLAYER_DEMO_CODECS
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <libavcodec/avcodec.h>     // libavcodec-dev   : AVCodec、enum AVCodecID
+
+// 列出本机 FFmpeg 中能解码 id 的全部解码器（不包括实验性的），按 FFmpeg 注册的顺序，最多 max 个，返回个数
+int listDecoders(enum AVCodecID id, const AVCodec** decoders, int max);
+
+// 默认的解码器选择缓存文件: $XDG_CACHE_HOME 或 ~/.cache（Windows 上为 %LOCALAPPDATA%）下的 ffmpeg-player-demo-decoders
+// 找不到这些目录时返回 false
+bool defaultDecoderCache(char* path, size_t size);
+
+// 从缓存文件读取 id 在 width x height 下选定的解码器，没有记录或记录的解码器已经不可用时返回 NULL
+const AVCodec* loadDecoderChoice(const char* cacheFile, enum AVCodecID id, int width, int height);
+
+// 把选定的解码器写入缓存文件，替换同一编码和分辨率原有的记录，所在的目录不存在时先创建，不可写时放弃
+void saveDecoderChoice(const char* cacheFile, enum AVCodecID id, int width, int height, const AVCodec* codec);
+
+#endif // FFMPEG_PLAYER_DEMO_CODECS
@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* ffmpeg */
+#include <libavutil/frame.h>        // libavutil-dev : AVFrame
+#include <libavutil/imgutils.h>     // libavutil-dev : av_image_copy_plane
+#include <libavutil/cpu.h>          // libavutil-dev : av_get_cpu_flags
+
+#include "convert.h"
+
+// x86 上用 GCC/Clang 的 target 属性单独编译 SSE2/AVX2 函数，其余代码不需要额外的编译选项
+// 运行时按 CPU 支持的指令集选择，不支持的 CPU 不会执行到这些函数
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_HAS_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CONVERT_HAS_X86 0
+#endif
+
+// 快速路径
+typedef enum ConvertPath
+{
+    CONVERT_COPY,       // 相同格式、相同尺寸
+    CONVERT_NV12,       // NV12 到 YUV420P，相同尺寸
+    CONVERT_BOX2,       // YUV420P 缩小 2 倍
+    CONVERT_BOX4,       // YUV420P 缩小 4 倍
+}ConvertPath;
+
+// 一种指令集的行处理函数，width 都是输出的像素数，不足一个向量的部分由 C 实现处理
+typedef struct ConvertKernels
+{
+    // 把 width 对 UV 交错的像素拆分到 U、V 两行
+    void (*deinterleave)(uint8_t* u, uint8_t* v, const uint8_t* uv, int width);
+
+    // 源的第 0、1 行每 2x2 个像素取平均，stride 为源的行宽
+    void (*box2)(uint8_t* dst, const uint8_t* src, ptrdiff_t stride, int width);
+
+    // 源的第 0 到 3 行每 4x4 个像素取平均
+    void (*box4)(uint8_t* dst, const uint8_t* src, ptrdiff_t stride, int width);
+}ConvertKernels;
+
+struct Converter
+{
+    ConvertPath path;
+    ConvertIsa isa;
+    const ConvertKernels* kernels;
+    enum AVPixelFormat srcFormat;
+    int srcWidth;
+    int srcHeight;
+    int dstWidth;
+    int dstHeight;
+};
+
+/* C 实现，也负责 SIMD 实现剩余的不足一个向量的像素 */
+
+static void deinterleaveC(uint8_t* u, uint8_t* v, const uint8_t* uv, int width)
+{
+    for (int x = 0; x < width; x++)
+    {
+        u[x] = uv[2 * x];
+        v[x] = uv[2 * x + 1];
+    }
+}
+
+static void box2C(uint8_t* dst, const uint8_t* src, ptrdiff_t stride, int width)
+{
+    const uint8_t* s0 = src;
+    const uint8_t* s1 = src + stride;
+    for (int x = 0; x < width; x++)
+        dst[x] = (uint8_t)((s0[2 * x] + s0[2 * x + 1] + s1[2 * x] + s1[2 * x + 1] + 2) >> 2);
+}
+
+static void box4C(uint8_t* dst, const uint8_t* src, ptrdiff_t stride, int width)
+{
+    for (int x = 0; x < width; x++)
+    {
+        int sum = 0;
+        for (int r = 0; r < 4; r++)
+        {
+            const uint8_t* s = src + r * stride + 4 * x;
+            sum += s[0] + s[1] + s[2] + s[3];
+        }
+        dst[x] = (uint8_t)((sum + 8) >> 4);
+    }
+}
+
+static const ConvertKernels KERNELS_C = {deinterleaveC, box2C, box4C};
+
+#if CONVERT_HAS_X86
+
+/* SSE2: 字节按 16 位拆成偶数、奇数两组，相加或打包后再饱和压缩回字节 */
+
+TARGET_SSE2 static void deinterleaveSse2(uint8_t* u, uint8_t* v, const uint8_t* uv, int width)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(uv + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(uv + 2 * x + 16));
+        __m128i even = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+        __m128i odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i*)(u + x), even);
+        _mm_storeu_si128((__m128i*)(v + x), odd);
+    }
+
+    deinterleaveC(u + x, v + x, uv + 2 * x, width - x);
+}
+
+// 16 字节中相邻两个像素的和，得到 8 个 16 位的值
+TARGET_SSE2 static inline __m128i pairSumSse2(__m128i a)
+{
+    return _mm_add_epi16(_mm_and_si128(a, _mm_set1_epi16(0x00FF)), _mm_srli_epi16(a, 8));
+}
+
+TARGET_SSE2 static void box2Sse2(uint8_t* dst, const uint8_t* src, ptrdiff_t stride, int width)
+{
+    const uint8_t* s0 = src;
+    const uint8_t* s1 = src + stride;
+    const __m128i round = _mm_set1_epi16(2);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i lo = _mm_add_epi16(
+            pairSumSse2(_mm_loadu_si128((const __m128i*)(s0 + 2 * x))),
+            pairSumSse2(_mm_loadu_si128((const __m128i*)(s1 + 2 * x))));
+        __m128i hi = _mm_add_epi16(
+            pairSumSse2(_mm_loadu_si128((const __m128i*)(s0 + 2 * x + 16))),
+            pairSumSse2(_mm_loadu_si128((const __m128i*)(s1 + 2 * x + 16))));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 2);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+
+    box2C(dst + x, src + 2 * x, stride, width - x);
+}
+
+// 4 行的相邻两个像素的和累加到 16 位，再把相邻两个 16 位的和相加到 32 位，最大 16 * 255
+TARGET_SSE2 static void box4Sse2(uint8_t* dst, const uint8_t* src, ptrdiff_t stride, int width)
+{
+    const __m128i mask = _mm_set1_epi32(0x0000FFFF);
+    const __m128i round = _mm_set1_epi32(8);
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        for (int r = 0; r < 4; r++)
+        {
+            const uint8_t* s = src + r * stride + 4 * x;
+            lo = _mm_add_epi16(lo, pairSumSse2(_mm_loadu_si128((const __m128i*)s)));
+            hi = _mm_add_epi16(hi, pairSumSse2(_mm_loadu_si128((const __m128i*)(s + 16))));
+        }
+
+        lo = _mm_add_epi32(_mm_and_si128(lo, mask), _mm_srli_epi32(lo, 16));
+        hi = _mm_add_epi32(_mm_and_si128(hi, mask), _mm_srli_epi32(hi, 16));
+        lo = _mm_srli_epi32(_mm_add_epi32(lo, round), 4);
+        hi = _mm_srli_epi32(_mm_add_epi32(hi, round), 4);
+        __m128i words = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(words, words));
+    }
+
+    box4C(dst + x, src + 4 * x, stride, width - x);
+}
+
+static const ConvertKernels KERNELS_SSE2 = {deinterleaveSse2, box2Sse2, box4Sse2};
+
+/* AVX2: 与 SSE2 相同，但打包指令在两个 128 位通道内分别进行，打包后要交换中间的两个 64 位 */
+
+TARGET_AVX2 static void deinterleaveAvx2(uint8_t* u, uint8_t* v, const uint8_t* uv, int width)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(uv + 2 * x));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(uv + 2 * x + 32));
+        __m256i even = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i odd = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i*)(u + x), _mm256_permute4x64_epi64(even, 0xD8));
+        _mm256_storeu_si256((__m256i*)(v + x), _mm256_permute4x64_epi64(odd, 0xD8));
+    }
+
+    deinterleaveSse2(u + x, v + x, uv + 2 * x, width - x);
+}
+
+TARGET_AVX2 static inline __m256i pairSumAvx2(__m256i a)
+{
+    return _mm256_add_epi16(_mm256_and_si256(a, _mm256_set1_epi16(0x00FF)), _mm256_srli_epi16(a, 8));
+}
+
+TARGET_AVX2 static void box2Avx2(uint8_t* dst, const uint8_t* src, ptrdiff_t stride, int width)
+{
+    const uint8_t* s0 = src;
+    const uint8_t* s1 = src + stride;
+    const __m256i round = _mm256_set1_epi16(2);
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i lo = _mm256_add_epi16(
+            pairSumAvx2(_mm256_loadu_si256((const __m256i*)(s0 + 2 * x))),
+            pairSumAvx2(_mm256_loadu_si256((const __m256i*)(s1 + 2 * x))));
+        __m256i hi = _mm256_add_epi16(
+            pairSumAvx2(_mm256_loadu_si256((const __m256i*)(s0 + 2 * x + 32))),
+            pairSumAvx2(_mm256_loadu_si256((const __m256i*)(s1 + 2 * x + 32))));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 2);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 2);
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8));
+    }
+
+    box2Sse2(dst + x, src + 2 * x, stride, width - x);
+}
+
+TARGET_AVX2 static void box4Avx2(uint8_t* dst, const uint8_t* src, ptrdiff_t stride, int width)
+{
+    const __m256i mask = _mm256_set1_epi32(0x0000FFFF);
+    const __m256i round = _mm256_set1_epi32(8);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i lo = _mm256_setzero_si256();
+        __m256i hi = _mm256_setzero_si256();
+        for (int r = 0; r < 4; r++)
+        {
+            const uint8_t* s = src + r * stride + 4 * x;
+            lo = _mm256_add_epi16(lo, pairSumAvx2(_mm256_loadu_si256((const __m256i*)s)));
+            hi = _mm256_add_epi16(hi, pairSumAvx2(_mm256_loadu_si256((const __m256i*)(s + 32))));
+        }
+
+        lo = _mm256_add_epi32(_mm256_and_si256(lo, mask), _mm256_srli_epi32(lo, 16));
+        hi = _mm256_add_epi32(_mm256_and_si256(hi, mask), _mm256_srli_epi32(hi, 16));
+        lo = _mm256_srli_epi32(_mm256_add_epi32(lo, round), 4);
+        hi = _mm256_srli_epi32(_mm256_add_epi32(hi, round), 4);
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+        _mm_storeu_si128((__m128i*)(dst + x), bytes);
+    }
+
+    box4Sse2(dst + x, src + 4 * x, stride, width - x);
+}
+
+static const ConvertKernels KERNELS_AVX2 = {deinterleaveAvx2, box2Avx2, box4Avx2};
+
+#endif // CONVERT_HAS_X86
+
+ConvertIsa convertBestIsa(void)
+{
+#if CONVERT_HAS_X86
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX2)
+        return CONVERT_ISA_AVX2;
+
+    if (flags & AV_CPU_FLAG_SSE2)
+        return CONVERT_ISA_SSE2;
+#endif
+
+    return CONVERT_ISA_C;
+}
+
+const char* convertIsaName(ConvertIsa isa)
+{
+    static const char* names[CONVERT_ISA_COUNT] = {
+        "c",
+        "sse2",
+        "avx2",
+    };
+
+    return isa < CONVERT_ISA_COUNT ? names[isa] : "unknown";
+}
+
+static const ConvertKernels* convertKernels(ConvertIsa isa)
+{
+#if CONVERT_HAS_X86
+    if (isa == CONVERT_ISA_AVX2)
+        return &KERNELS_AVX2;
+
+    if (isa == CONVERT_ISA_SSE2)
+        return &KERNELS_SSE2;
+#endif
+
+    return &KERNELS_C;
+}
+
+// YUV420P 和 YUVJ420P 的区别只是取值范围，相同格式之间可以直接缩小
+static bool isPlanar420(enum AVPixelFormat format)
+{
+    return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P;
+}
+
+Converter* createConverter(enum AVPixelFormat srcFormat, int srcWidth, int srcHeight,
+    enum AVPixelFormat dstFormat, int dstWidth, int dstHeight, ConvertIsa isa)
+{
+    if (dstWidth <= 0 || dstHeight <= 0 || dstWidth % 2 != 0 || dstHeight % 2 != 0)
+        return NULL;
+
+    // YUVJ420P 到 YUV420P 需要转换取值范围，交给 sws_scale
+    ConvertPath path;
+    bool sameSize = srcWidth == dstWidth && srcHeight == dstHeight;
+    if (sameSize && srcFormat == dstFormat && (isPlanar420(srcFormat) || srcFormat == AV_PIX_FMT_NV12))
+        path = CONVERT_COPY;
+    else if (sameSize && srcFormat == AV_PIX_FMT_NV12 && dstFormat == AV_PIX_FMT_YUV420P)
+        path = CONVERT_NV12;
+    else if (srcFormat == dstFormat && isPlanar420(srcFormat) && srcWidth == 2 * dstWidth && srcHeight == 2 * dstHeight)
+        path = CONVERT_BOX2;
+    else if (srcFormat == dstFormat && isPlanar420(srcFormat) && srcWidth == 4 * dstWidth && srcHeight == 4 * dstHeight)
+        path = CONVERT_BOX4;
+    else
+        return NULL;
+
+    Converter* converter = malloc(sizeof(Converter));
+    if (converter == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    ConvertIsa best = convertBestIsa();
+    converter->path = path;
+    converter->isa = isa < best ? isa : best;
+    converter->kernels = convertKernels(converter->isa);
+    converter->srcFormat = srcFormat;
+    converter->srcWidth = srcWidth;
+    converter->srcHeight = srcHeight;
+    converter->dstWidth = dstWidth;
+    converter->dstHeight = dstHeight;
+    return converter;
+}
+
+void deleteConverter(Converter* converter)
+{
+    free(converter);
+}
+
+const char* converterName(Converter* converter)
+{
+    static const char* names[] = {
+        "copy",
+        "nv12",
+        "box2",
+        "box4",
+    };
+
+    return names[converter->path];
+}
+
+ConvertIsa converterIsa(Converter* converter)
+{
+    return converter->isa;
+}
+
+bool matchConverter(Converter* converter, const AVFrame* src)
+{
+    return src->format == converter->srcFormat && src->width == converter->srcWidth && src->height == converter->srcHeight;
+}
+
+// 把一个平面的 [y, y + height) 行按 factor 倍缩小，box 为对应倍数的行处理函数
+static void boxPlane(void (*box)(uint8_t*, const uint8_t*, ptrdiff_t, int), int factor,
+    uint8_t* dst, int dstStride, const uint8_t* src, int srcStride, int width, int y, int height)
+{
+    for (int row = y; row < y + height; row++)
+        box(dst + (ptrdiff_t)row * dstStride, src + (ptrdiff_t)row * factor * srcStride, srcStride, width);
+}
+
+void convertSlice(Converter* converter, const AVFrame* src, AVFrame* dst, int y, int height)
+{
+    // 4:2:0 的色度平面宽高都减半，y 和 height 是偶数，色度行与亮度行一一对应
+    int width = converter->dstWidth;
+    int chromaWidth = width / 2;
+    int chromaY = y / 2;
+    int chromaHeight = (height + 1) / 2;
+    const ConvertKernels* kernels = converter->kernels;
+
+    switch (converter->path)
+    {
+    case CONVERT_COPY:
+        // 逐行拷贝由 libc 的 memcpy 完成，它本身已经按 CPU 选择了 SSE2/AVX2 实现
+        av_image_copy_plane(dst->data[0] + (ptrdiff_t)y * dst->linesize[0], dst->linesize[0],
+            src->data[0] + (ptrdiff_t)y * src->linesize[0], src->linesize[0], width, height);
+        if (converter->srcFormat == AV_PIX_FMT_NV12)
+        {
+            av_image_copy_plane(dst->data[1] + (ptrdiff_t)chromaY * dst->linesize[1], dst->linesize[1],
+                src->data[1] + (ptrdiff_t)chromaY * src->linesize[1], src->linesize[1], width, chromaHeight);
+            break;
+        }
+
+        for (int plane = 1; plane < 3; plane++)
+        {
+            av_image_copy_plane(dst->data[plane] + (ptrdiff_t)chromaY * dst->linesize[plane], dst->linesize[plane],
+                src->data[plane] + (ptrdiff_t)chromaY * src->linesize[plane], src->linesize[plane], chromaWidth, chromaHeight);
+        }
+        break;
+
+    case CONVERT_NV12:
+        av_image_copy_plane(dst->data[0] + (ptrdiff_t)y * dst->linesize[0], dst->linesize[0],
+            src->data[0] + (ptrdiff_t)y * src->linesize[0], src->linesize[0], width, height);
+        for (int row = chromaY; row < chromaY + chromaHeight; row++)
+        {
+            kernels->deinterleave(
+                dst->data[1] + (ptrdiff_t)row * dst->linesize[1],
+                dst->data[2] + (ptrdiff_t)row * dst->linesize[2],
+                src->data[1] + (ptrdiff_t)row * src->linesize[1],
+                chromaWidth
+            );
+        }
+        break;
+
+    case CONVERT_BOX2:
+    case CONVERT_BOX4:
+    {
+        int factor = converter->path == CONVERT_BOX2 ? 2 : 4;
+        void (*box)(uint8_t*, const uint8_t*, ptrdiff_t, int) = factor == 2 ? kernels->box2 : kernels->box4;
+        boxPlane(box, factor, dst->data[0], dst->linesize[0], src->data[0], src->linesize[0], width, y, height);
+        for (int plane = 1; plane < 3; plane++)
+            boxPlane(box, factor, dst->data[plane], dst->linesize[plane], src->data[plane], src->linesize[plane], chromaWidth, chromaY, chromaHeight);
+        break;
+    }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef FFMPEG_PLAYER_DEMO_CONVERT
+#define FFMPEG_PLAYER_DEMO_CONVERT
+
+#include <stdbool.h>
+
+#include <libavutil/frame.h>        // libavutil-dev    : AVFrame、enum AVPixelFormat
+
+typedef struct Converter Converter;
+
+// 转换使用的指令集，从慢到快
+typedef enum ConvertIsa
+{
+    CONVERT_ISA_C,          // 纯 C 实现，所有平台都可用
+    CONVERT_ISA_SSE2,       // 每次处理 16 字节
+    CONVERT_ISA_AVX2,       // 每次处理 32 字节
+    CONVERT_ISA_COUNT,
+}ConvertIsa;
+
+// 当前 CPU 支持的最快的指令集，遵循 FFmpeg 的 CPU 检测结果（包括 -cpuflags 的限制）
+ConvertIsa convertBestIsa(void);
+
+// 指令集的名称
+const char* convertIsaName(ConvertIsa isa);
+
+// 按源和目标的像素格式、尺寸选择不经过 sws_scale 的快速路径:
+//   相同格式、相同尺寸的 YUV420P/YUVJ420P/NV12: 逐平面拷贝，修正行宽
+//   相同尺寸的 NV12 到 YUV420P: 拷贝 Y 平面，UV 平面解交错
+//   YUV420P/YUVJ420P 宽高正好是目标的 2 倍或 4 倍: 每 2x2 或 4x4 个像素取平均
+// 目标宽高需要是偶数，isa 超过 CPU 支持的指令集时使用支持的最快指令集，没有匹配的快速路径时返回 NULL
+Converter* createConverter(enum AVPixelFormat srcFormat, int srcWidth, int srcHeight,
+    enum AVPixelFormat dstFormat, int dstWidth, int dstHeight, ConvertIsa isa);
+void deleteConverter(Converter* converter);
+
+// 快速路径的名称: copy、nv12、box2、box4
+const char* converterName(Converter* converter);
+
+// 实际使用的指令集
+ConvertIsa converterIsa(Converter* converter);
+
+// 源帧的格式和尺寸是否与创建时一致，解码器输出意外改变时调用者应当退回 sws_scale
+bool matchConverter(Converter* converter, const AVFrame* src);
+
+// 转换目标画面的 [y, y + height) 行，y 和 height 都是偶数（最后一个条带到画面底部为止）
+// 不同条带可以在多个线程中同时转换
+void convertSlice(Converter* converter, const AVFrame* src, AVFrame* dst, int y, int height);
+
+#endif // FFMPEG_PLAYER_DEMO_CONVERT
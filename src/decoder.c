@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
 
 #include <SDL2/SDL.h>               // libsdl2-dev
 
@@ -7,29 +9,177 @@
 #include <libavformat/avformat.h>       // libavformat-dev   : Audio-Video Foramt - 用于音视频文件封装、解封装
 #include <libavcodec/avcodec.h>         // libavcodec-dev    : Audio-Video Codec - 用于音视频数据编解码
 #include <libavutil/imgutils.h>         // libavutil-dev     : Audio-Video Utilities - 一些实用函数
+#include <libavutil/pixdesc.h>          // libavutil-dev     : Audio-Video Utilities - 像素格式描述
 #include <libswscale/swscale.h>         // libswscale-dev    : Software Scale - 软件缩放算法
 #include <libswresample/swresample.h>   // libswresample-dev : Software Resample - 软件重采样算法
 
 #include "decoder.h"
+#include "worker.h"
+#include "stats.h"
+#include "ring.h"
+#include "clock.h"
+#include "index.h"
+#include "convert.h"
+#include "codecs.h"
+#include "waitqueue.h"
 
-typedef struct DecoderData
+// 解码后的帧队列容量的范围，在范围内按内存预算和一帧的大小确定，队列满时对应的解码线程等待
+#define QUEUE_CAPACITY          8
+#define MIN_QUEUE_CAPACITY      2
+
+// 解码后的帧最多占用内存预算的几分之一，其余留给数据包队列
+#define FRAME_BUDGET_SHARE      2
+
+// 解封装后的数据包队列的槽位数，只是兜底，平时由字节预算和缓冲时长限制解封装
+#define PACKET_QUEUE_CAPACITY   4096
+
+// 数据包队列的字节预算的下限，帧队列占满预算时仍然保证解封装能够前进
+#define MIN_PACKET_BYTES        (1024 * 1024)
+
+// 目标缓冲时长为最短时长加上抖动的倍数
+#define JITTER_MARGIN   2
+
+// 抖动峰值的衰减速度: 新样本更小时每次向它靠近差值的几分之一
+#define JITTER_DECAY    64
+
+// 重采样后的 PCM 环形缓冲区能容纳的时长，单位毫秒
+#define AUDIO_RING_MS   250
+
+// PCM 环形缓冲区中最多记录的时间戳个数，超出时按采样率推算
+#define AUDIO_MARK_CAPACITY 256
+
+// 解码器没有给出 frame_size 时，音频回调默认的采样数
+#define DEFAULT_AUDIO_SAMPLES 1024
+
+// 无法从流信息得到帧率时，假定的一帧视频的时长，单位微秒
+#define DEFAULT_FRAME_DURATION 40000
+
+// 校准解码器时从第一个关键帧开始最多读取的数据包数，遇到下一个关键帧时提前结束
+// 第一个关键帧之前最多也只跳过这么多个数据包，没有数据包带关键帧标记时不会读完整个文件
+#define CALIBRATE_PACKETS   250
+
+// 参与校准的解码器个数上限
+#define CALIBRATE_DECODERS  16
+
+// 校准一个解码器的时间上限，单位毫秒，超过后按已经解码的帧计算，不再解码第一个 GOP 剩下的数据包
+// 读取第一个 GOP 也使用同样的上限，存储很慢时按已经读到的数据包校准
+#define CALIBRATE_BUDGET_MS 100
+
+// 本进程记住的校准结果个数，超出后覆盖最早的记录
+#define CALIBRATE_MEMORY    16
+
+// 读完文件后检查定位请求和解码进度的间隔，单位毫秒
+#define EOF_POLL_INTERVAL 10
+
+// 视频行宽按 SIMD 寄存器宽度对齐
+#define LINESIZE_ALIGN  32
+
+// 并行缩放时每个条带的最小行数，条带太窄时线程调度的开销大于收益
+#define MIN_SLICE_HEIGHT 64
+
+// 解码计数，除 skipped、repeated 由渲染线程写入外，只由对应的解码线程写入
+typedef struct StreamCounters
 {
-    const char* file;
+    _Atomic uint64_t sent;          // 送入解码器的数据包数
+    _Atomic uint64_t received;      // 解码器输出的帧数
+    _Atomic uint64_t dropped;       // 解码器输出后被丢弃的帧数
+    _Atomic uint64_t late;          // 其中因为已经落后于播放时钟，未经缩放就丢弃的帧数
+    _Atomic uint64_t skipped;       // 渲染线程取出后因为落后而没有显示的帧数
+    _Atomic uint64_t repeated;      // 渲染线程重复显示上一帧的次数
+}StreamCounters;
+
+// 每次定位序号加一，队列中的数据都带有产生它时的序号，序号过时的数据直接丢弃
+
+// 数据包队列的元素，packet 为 NULL 表示这个序号的流结束
+typedef struct PacketItem
+{
+    AVPacket* packet;
+    int serial;
+    int64_t start;      // 这个序号的数据从 start 微秒开始显示，之前的帧解码后丢弃
+    int64_t duration;   // 数据包的时长，单位微秒，计入缓冲时长
+}PacketItem;
+
+// 视频队列的元素，帧的所有权随出队转移给渲染线程
+typedef struct VideoItem
+{
+    AVFrame* frame;
+    int64_t pts;
+    int serial;
+}VideoItem;
 
-    SDL_mutex* endMutex;
-    bool end;
+// PCM 环形缓冲区中一段数据的时间戳: 累计写入位置为 position 的字节的 pts 为 pts 微秒
+typedef struct AudioMark
+{
+    uint64_t position;
+    int64_t pts;
+    int serial;
+}AudioMark;
 
-    SDL_mutex* videoMutex;
-    Queue* videoQueue;
-    Queue* videoPtsQueue;
+// 解码线程的定位状态，serial、skipUntil 只由对应的解码线程读写
+typedef struct StreamSeek
+{
+    int serial;                 // 正在解码的数据的序号
+    int64_t skipUntil;          // 结束时间不晚于它的帧解码后丢弃，单位微秒
+    _Atomic int done;           // 已经解码完全部数据的序号
+}StreamSeek;
 
-    SDL_mutex* audioMutex;
-    Queue* audioQueue;
-    Queue* audioPtsQueue;
+// 一路数据包队列的缓冲状态，bytes、duration 由解封装线程增加、解码线程减少
+typedef struct StreamBuffer
+{
+    _Atomic int64_t bytes;      // 队列中数据包的字节数
+    _Atomic int64_t duration;   // 队列中数据包的总时长，单位微秒
+    _Atomic int64_t jitter;     // 解码一个数据包比它的时长多用的时间，取近期的峰值，单位微秒，只由解码线程写入
+    int64_t min;                // 最短缓冲时长
+    int64_t max;                // 最长缓冲时长
+}StreamBuffer;
 
-    // 用于主线程通知解码线程继续解码
-    SDL_cond* avCond;
-    SDL_mutex* avMutex;
+typedef struct DecoderData
+{
+    const char* file;
+    DecoderOptions options;
+
+    atomic_bool end;
+
+    Clock clock;                    // 播放时钟，单位微秒
+    int64_t startTime;              // 文件的起始时间，单位微秒，所有时间戳都减去它，从 0 开始
+
+    KeyframeIndex* index;           // 视频流的关键帧索引
+    Input* input;                   // 自定义输入，为 NULL 时由 FFmpeg 自己打开文件
+
+    // 定位请求由渲染线程发出，解封装线程执行
+    SDL_mutex* seekMutex;           // 保护 seekRequest，保证它与 serial 一致
+    atomic_bool seekPending;        // 有尚未执行的定位请求
+    int64_t seekRequest;            // 请求定位到的位置，单位微秒
+    _Atomic int serial;             // 最新的定位序号，旧序号的数据包、帧和 PCM 数据都被丢弃
+    StreamSeek videoSeek;
+    StreamSeek audioSeek;
+
+    Stage stages[DECODER_STAGE_COUNT];  // 各处理阶段的累计耗时
+    Gauge gauges[DECODER_GAUGE_COUNT];  // 各队列的深度
+    uint64_t createNs;                              // 创建解码器的时刻
+    _Atomic int64_t milestones[DECODER_MILESTONE_COUNT];   // 从创建解码器到各时间点的微秒数，-1 表示没有到达
+
+    WaitQueue* videoQueue;          // 保存 VideoItem，送给渲染线程的视频帧
+
+    // 重采样线程与音频回调之间的 PCM 数据，两边都不加锁
+    Ring* audioRing;                // PCM 数据
+    Ring* audioMarks;               // 保存 AudioMark，记录各段 PCM 数据的时间戳
+    SDL_sem* audioSpace;            // 音频回调取走数据后唤醒等待空间的重采样线程
+    atomic_bool audioWaiting;       // 重采样线程正在等待空间
+    AudioMark audioMark;            // 音频回调最近越过的时间戳，只由音频回调读写
+    int audioReadSerial;            // 音频回调正在播放的数据的序号，只由音频回调读写
+    int audioMarkSerial;            // 最近写入的时间戳的序号，只由音频解码线程读写
+    _Atomic uint64_t underruns;     // 音频回调数据不足的次数
+    _Atomic uint64_t silenceBytes;  // 音频回调因数据不足填充的静音字节数
+
+    WaitQueue* videoPackets;        // 保存 PacketItem，送给视频解码线程的数据包
+    WaitQueue* audioPackets;        // 保存 PacketItem，送给音频解码线程的数据包
+    StreamBuffer videoBuffer;       // 视频数据包队列的缓冲状态
+    StreamBuffer audioBuffer;       // 音频数据包队列的缓冲状态
+    int64_t packetBudget;           // 两路数据包队列合计的字节上限，内存预算减去帧队列和 PCM 缓冲区
+    int64_t demuxJitter;            // 读取一个数据包用时的近期峰值，单位微秒，只由解封装线程读写
+    SDL_sem* demuxSpace;            // 解码线程取走数据包、定位或结束时唤醒等待缓冲空间的解封装线程
+    atomic_bool demuxWaiting;       // 解封装线程正在等待缓冲空间
 
     AVFormatContext* formatContext;
     int videoIndex;                 // 视频流的索引
@@ -38,44 +188,110 @@ typedef struct DecoderData
     AVStream* videoStream;          // 视频流
     AVCodecParameters* videoParams; // 视频流参数
     const AVCodec* videoCodec;      // 视频解码器
+    const char* videoCodecSource;   // 视频解码器的来源: override、default、cached、remembered、calibrated、busy 或 only
+    int64_t calibrateUs;            // 选择视频解码器用的微秒数，包括等待其它解码器校准和读取第一个 GOP
     AVCodecContext* videoContext;   // 视频解码器上下文
     AVFrame* decodedVideoFrame;     // 解码后的视频帧
+    int videoDelay;                 // 帧级多线程带来的解码延迟帧数
+    int64_t frameDuration;          // 一帧视频的时长，单位微秒
+    int64_t nextVideoPts;           // 下一帧视频的预计时间戳，用于补全缺失的时间戳
+    StreamCounters videoCounters;   // 视频解码计数
     int width;                      // 缩放后的宽度
     int height;                     // 缩放后的高度
     enum AVPixelFormat pixFormat;   // 缩放后的视频像素格式
     int videoBufferSize;            // 缩放后的视频缓冲区大小
-    void* displayVideoBuffer;       // 缩放后的视频缓冲区
-    AVFrame* displayVideoFrame;     // 缩放后的视频帧
+    Pool* videoPool;                // 缩放后的视频缓冲区池，帧释放后缓冲区回到池中
     struct SwsContext* swsContext;  // 缩放算法上下文
+    Workers* workers;               // 并行缩放的常驻线程池
+    struct SwsContext** swsSlices;  // 每个条带一个缩放算法上下文
+    int swsSliceCount;              // 条带数，小于 2 时不并行缩放
+    int sliceHeight;                // 每个条带的行数
+    enum AVPixelFormat sliceSrcFormat;  // 条带上下文创建时的源像素格式和尺寸，与解码器实际输出的帧不同时重建
+    int sliceSrcWidth;
+    int sliceSrcHeight;
+    bool passthrough;               // 直通模式: 解码后的帧不缩放，直接交给渲染线程
+    Converter* converter;           // 格式和尺寸匹配快速路径时代替 sws_scale，为 NULL 时没有快速路径
+    char scalePath[32];             // 缩放使用的方式，例如 box2/avx2 或 sws_scale
+    const AVFrame* scaleSrc;        // 正在并行缩放的源帧
+    AVFrame* scaleDst;              // 正在并行缩放的目标帧
+    atomic_bool scaleFailed;        // 有条带缩放失败
 
     AVStream* audioStream;              // 音频流
     AVCodecParameters* audioParams;     // 音频流参数
     const AVCodec* audioCodec;          // 音频解码器
     AVCodecContext* audioContext;       // 音频解码器上下文
     AVFrame* decodedAudioFrame;         // 解码后的音频帧
+    StreamCounters audioCounters;       // 音频解码计数
     const AVChannelLayout* layout;      // 重采样后的声道布局
     enum AVSampleFormat sampleFormat;   // 重采样后的音频采样格式
     int rate;                           // 重采样后的采样频率
-    int samples;                        // 重采样后的一个通道的采样数
-    int audioBufferSize;                // 重采样后的音频缓冲区大小
-    uint8_t* displayAudioBuffer;        // 重采样后的音频缓冲区
-    AVFrame* displayAudioFrame;         // 重采样后的音频帧
+    int channels;                       // 重采样后的声道数
+    int frameBytes;                     // 重采样后所有声道一个采样的字节数
+    int samples;                        // 音频回调一次请求的一个通道的采样数
+    int audioBufferSize;                // 音频回调一次请求的字节数
+    uint8_t* resampleBuffer;            // 重采样输出缓冲区，按需扩大
+    int resampleSamples;                // 重采样输出缓冲区能容纳的一个通道的采样数
     SwrContext* swrContext;             // 重采样上下文
 }DecoderData;
 
+static void resetStreamBuffer(StreamBuffer* buffer)
+{
+    buffer->bytes = 0;
+    buffer->duration = 0;
+    buffer->jitter = 0;
+    buffer->min = 0;
+    buffer->max = 0;
+}
+
 void resetDecoderData(DecoderData* data)
 {
     data->file = NULL;
-    data->endMutex = NULL;
+    decoderDefaultOptions(&(data->options));
     data->end = false;
+    resetClock(&(data->clock));
+    data->startTime = 0;
+    data->index = NULL;
+    data->input = NULL;
+    data->seekMutex = NULL;
+    data->seekPending = false;
+    data->seekRequest = 0;
+    data->serial = 0;
+    data->videoSeek.serial = 0;
+    data->videoSeek.skipUntil = CLOCK_NONE;
+    data->videoSeek.done = -1;
+    data->audioSeek.serial = 0;
+    data->audioSeek.skipUntil = CLOCK_NONE;
+    data->audioSeek.done = -1;
+    for (int i = 0; i < DECODER_STAGE_COUNT; i++)
+        resetStage(&(data->stages[i]));
+    for (int i = 0; i < DECODER_GAUGE_COUNT; i++)
+        resetGauge(&(data->gauges[i]));
+    data->createNs = wallNs();
+    for (int i = 0; i < DECODER_MILESTONE_COUNT; i++)
+        data->milestones[i] = -1;
 
-    data->videoMutex = NULL;
     data->videoQueue = NULL;
-    data->videoPtsQueue = NULL;
 
-    data->audioMutex = NULL;
-    data->audioQueue = NULL;
-    data->audioPtsQueue = NULL;
+    data->audioRing = NULL;
+    data->audioMarks = NULL;
+    data->audioSpace = NULL;
+    data->audioWaiting = false;
+    data->audioMark.position = 0;
+    data->audioMark.pts = CLOCK_NONE;
+    data->audioMark.serial = 0;
+    data->audioReadSerial = 0;
+    data->audioMarkSerial = -1;
+    data->underruns = 0;
+    data->silenceBytes = 0;
+
+    data->videoPackets = NULL;
+    data->audioPackets = NULL;
+    resetStreamBuffer(&(data->videoBuffer));
+    resetStreamBuffer(&(data->audioBuffer));
+    data->packetBudget = 0;
+    data->demuxJitter = 0;
+    data->demuxSpace = NULL;
+    data->demuxWaiting = false;
 
     data->formatContext = NULL;
     data->videoIndex = -1;
@@ -84,31 +300,102 @@ void resetDecoderData(DecoderData* data)
     data->videoStream = NULL;
     data->videoParams = NULL;
     data->videoCodec = NULL;
+    data->videoCodecSource = "default";
+    data->calibrateUs = 0;
     data->videoContext = NULL;
     data->decodedVideoFrame = NULL;
+    data->videoDelay = 0;
+    data->frameDuration = DEFAULT_FRAME_DURATION;
+    data->nextVideoPts = 0;
+    data->videoCounters.sent = 0;
+    data->videoCounters.received = 0;
+    data->videoCounters.dropped = 0;
+    data->videoCounters.late = 0;
+    data->videoCounters.skipped = 0;
+    data->videoCounters.repeated = 0;
     data->width = 0;
     data->height = 0;
     data->pixFormat = AV_PIX_FMT_NONE;
     data->videoBufferSize = 0;
-    data->displayVideoBuffer = NULL;
-    data->displayVideoFrame = NULL;
+    data->videoPool = NULL;
     data->swsContext = NULL;
+    data->workers = NULL;
+    data->swsSlices = NULL;
+    data->swsSliceCount = 0;
+    data->sliceHeight = 0;
+    data->sliceSrcFormat = AV_PIX_FMT_NONE;
+    data->sliceSrcWidth = 0;
+    data->sliceSrcHeight = 0;
+    data->passthrough = false;
+    data->converter = NULL;
+    strcpy(data->scalePath, "sws_scale");
+    data->scaleSrc = NULL;
+    data->scaleDst = NULL;
+    data->scaleFailed = false;
 
     data->audioStream = NULL;
     data->audioParams = NULL;
     data->audioCodec = NULL;
     data->audioContext = NULL;
     data->decodedAudioFrame = NULL;
+    data->audioCounters.sent = 0;
+    data->audioCounters.received = 0;
+    data->audioCounters.dropped = 0;
+    data->audioCounters.late = 0;
+    data->audioCounters.skipped = 0;
+    data->audioCounters.repeated = 0;
     data->layout = NULL;
     data->sampleFormat = AV_SAMPLE_FMT_NONE;
     data->rate = 0;
+    data->channels = 0;
+    data->frameBytes = 0;
     data->audioBufferSize = 0;
-    data->audioBufferSize = 0;
-    data->displayAudioBuffer = NULL;
-    data->displayAudioFrame = NULL;
+    data->resampleBuffer = NULL;
+    data->resampleSamples = 0;
     data->swrContext = NULL;
 }
 
+// 释放数据包队列中未被解码的数据包，然后删除队列
+static void deletePacketQueue(WaitQueue* packets)
+{
+    if (packets == NULL)
+        return;
+
+    PacketItem item;
+    while (popWaitQueue(packets, &item, 0))
+        av_packet_free(&(item.packet));
+
+    deleteWaitQueue(packets);
+}
+
+// 默认选项
+void decoderDefaultOptions(DecoderOptions* options)
+{
+    options->threadType = DECODER_THREAD_AUTO;
+    options->threadCount = 0;
+    options->scaleThreads = 0;
+    options->scaleFlags = SWS_BICUBIC;
+    options->native = false;
+    options->fastConvert = true;
+    options->videoDecoder = NULL;
+    options->decoderCache = NULL;
+    options->recalibrate = false;
+    options->verbose = false;
+    options->audio = true;
+    options->workers = NULL;
+    options->probeSize = 0;
+    options->analyzeDuration = 0;
+    options->mmap = false;
+    options->prefetch = 0;
+    options->ioDelayMs = 0;
+    options->ioDelayEvery = 1;
+    options->bufferBytes = 64 * 1024 * 1024;
+    options->videoMinBuffer = 500000;
+    options->videoMaxBuffer = 4000000;
+    options->audioMinBuffer = 1000000;
+    options->audioMaxBuffer = 8000000;
+}
+
 // 创建
 DecoderData* createDecoder()
 {
@@ -120,8 +407,11 @@ DecoderData* createDecoder()
     }
 
     resetDecoderData(data);
-    data->avCond = SDL_CreateCond();
-    data->avMutex = SDL_CreateMutex();
+    data->audioSpace = SDL_CreateSemaphore(0);
+    data->demuxSpace = SDL_CreateSemaphore(0);
+    data->seekMutex = SDL_CreateMutex();
+    data->videoPackets = createWaitQueue(sizeof(PacketItem), PACKET_QUEUE_CAPACITY, &(data->end), &(data->gauges[DECODER_GAUGE_VIDEO_PACKETS]));
+    data->audioPackets = createWaitQueue(sizeof(PacketItem), PACKET_QUEUE_CAPACITY, &(data->end), &(data->gauges[DECODER_GAUGE_AUDIO_PACKETS]));
     return data;
 }
 
@@ -134,11 +424,8 @@ void deleteDecoder(DecoderData* data)
     if (data->swrContext != NULL)
         swr_free(&(data->swrContext));
 
-    if (data->displayAudioFrame != NULL)
-        av_frame_free(&(data->displayAudioFrame));
-
-    if (data->displayAudioBuffer != NULL)
-        av_free(data->displayAudioBuffer);
+    if (data->resampleBuffer != NULL)
+        av_freep(&(data->resampleBuffer));
 
     if (data->decodedAudioFrame != NULL)
         av_frame_free(&(data->decodedAudioFrame));
@@ -148,14 +435,21 @@ void deleteDecoder(DecoderData* data)
         avcodec_free_context(&(data->audioContext));
     }
 
-    if (data->swsContext != NULL)
-        sws_freeContext(data->swsContext);
+    if (data->workers != NULL && data->workers != data->options.workers)
+        deleteWorkers(data->workers);
+
+    deleteConverter(data->converter);
 
-    if (data->displayVideoFrame != NULL)
-        av_frame_free(&(data->displayVideoFrame));
+    if (data->swsSlices != NULL)
+    {
+        for (int i = 0; i < data->swsSliceCount; i++)
+            sws_freeContext(data->swsSlices[i]);
+
+        free(data->swsSlices);
+    }
 
-    if (data->displayVideoBuffer != NULL)
-        av_free(data->displayVideoBuffer);
+    if (data->swsContext != NULL)
+        sws_freeContext(data->swsContext);
 
     if (data->decodedVideoFrame != NULL)
         av_frame_free(&(data->decodedVideoFrame));
@@ -165,398 +459,1479 @@ void deleteDecoder(DecoderData* data)
         avcodec_free_context(&(data->videoContext));
     }
 
+    deleteIndex(data->index);
+
     if (data->formatContext != NULL)
     {
         avformat_close_input(&(data->formatContext));
         avformat_free_context(data->formatContext);
     }
 
-    if (data->avMutex != NULL)
-        SDL_DestroyMutex(data->avMutex);
+    // 自定义输入不随 AVFormatContext 关闭，在它之后删除
+    deleteInput(data->input);
+
+    deletePacketQueue(data->audioPackets);
+    deletePacketQueue(data->videoPackets);
+
+    deleteRing(data->audioRing);
+    deleteRing(data->audioMarks);
 
-    if (data->avCond != NULL)
-        SDL_DestroyCond(data->avCond);
+    if (data->audioSpace != NULL)
+        SDL_DestroySemaphore(data->audioSpace);
 
-    if (data->audioQueue != NULL)
-        deleteQueue(data->audioQueue);
+    if (data->demuxSpace != NULL)
+        SDL_DestroySemaphore(data->demuxSpace);
 
-    if (data->audioMutex != NULL)
-        SDL_DestroyMutex(data->audioMutex);
+    if (data->seekMutex != NULL)
+        SDL_DestroyMutex(data->seekMutex);
 
     if (data->videoQueue != NULL)
-        deleteQueue(data->videoQueue);
+    {
+        // 释放队列中未被取走的帧
+        VideoItem item;
+        while (popWaitQueue(data->videoQueue, &item, 0))
+            av_frame_free(&(item.frame));
+
+        deleteWaitQueue(data->videoQueue);
+    }
 
-    if (data->videoMutex != NULL)
-        SDL_DestroyMutex(data->videoMutex);
+    // 队列中的帧释放后才能删除缓冲区池
+    if (data->videoPool != NULL)
+        deletePool(data->videoPool);
 
-    if (data->endMutex != NULL)
-        SDL_DestroyMutex(data->endMutex);
-    
     free(data);
 }
 
+// 设置选项，需要在初始化解码器之前调用
+void decoderSetOptions(DecoderData* data, const DecoderOptions* options)
+{
+    data->options = *options;
+}
+
 // 设置视频解码结束
 void decoderSetEnd(DecoderData* data, bool n)
 {
-    SDL_LockMutex(data->endMutex);
     data->end = n;
-    SDL_UnlockMutex(data->endMutex);
+
+    // 唤醒在各个队列上等待的线程
+    wakeWaitQueue(data->videoQueue);
+    wakeWaitQueue(data->videoPackets);
+    wakeWaitQueue(data->audioPackets);
+
+    if (data->audioSpace != NULL)
+        SDL_SemPost(data->audioSpace);
+
+    if (data->demuxSpace != NULL)
+        SDL_SemPost(data->demuxSpace);
 }
 
 // 是否视频解码结束
 int decoderIsEnd(const DecoderData* data)
 {
-    SDL_LockMutex(data->endMutex);
-    int n = data->end;
-    SDL_UnlockMutex(data->endMutex);
-    return n;
+    return data->end;
 }
 
-// 压入一帧视频数据
-void decoderPushVideo(DecoderData* data, void* videoBuffer, int64_t pts)
+// 设置播放时钟: 当前时刻的播放位置为 pts 微秒
+void decoderSetClock(DecoderData* data, int64_t pts)
 {
-    SDL_LockMutex(data->videoMutex);
-    pushQueue(data->videoQueue, videoBuffer);
-    pushQueue(data->videoPtsQueue, &pts);
-    SDL_UnlockMutex(data->videoMutex);
+    setClock(&(data->clock), pts);
 }
 
-// 弹出一帧视频数据
-void* decoderPopVideo(DecoderData* data, int64_t* pts)
+// 用主时钟的参考时间修正播放时钟，返回修正前的偏差
+// 参考时间是定位之前的数据时不修正，否则会用旧的位置重新设置定位时刚刚重置的时钟
+// 定位在 seekMutex 中增加序号并重置时钟，这里拿不到锁说明正在定位，同样不修正，音频回调不会等待
+int64_t decoderAdjustClock(DecoderData* data, int64_t pts, int64_t jitter, int serial)
 {
-    SDL_LockMutex(data->videoMutex);
-    void* buffer = popQueue(data->videoQueue);
-    int64_t* _pts = popQueue(data->videoPtsQueue);
-    SDL_UnlockMutex(data->videoMutex);
-    if (_pts != NULL)
-    {
-        *pts = *_pts;
-        free(_pts);
-    }
+    if (SDL_TryLockMutex(data->seekMutex) != 0)
+        return 0;
 
-    return buffer;
+    int64_t error = serial == data->serial ? adjustClock(&(data->clock), pts, jitter) : 0;
+    SDL_UnlockMutex(data->seekMutex);
+    return error;
 }
 
-// 获取视频队列缓存帧数
-int decoderCountVideo(DecoderData* data)
+// 当前的播放位置，单位微秒，还没开始播放时返回 CLOCK_NONE
+int64_t decoderClock(DecoderData* data)
 {
-    SDL_LockMutex(data->videoMutex);
-    int n = countQueue(data->videoQueue);
-    SDL_UnlockMutex(data->videoMutex);
+    return readClock(&(data->clock));
+}
 
-    return n;
+// 记录一帧视频显示时与播放时钟的偏差
+void decoderRecordDrift(DecoderData* data, int64_t drift)
+{
+    setGauge(&(data->gauges[DECODER_GAUGE_AV_DRIFT]), drift >= 0 ? drift : -drift);
+}
+
+// 帧的时间戳，单位微秒，优先使用 best_effort_timestamp，都没有时返回 CLOCK_NONE
+static int64_t decoderFramePts(DecoderData* data, const AVFrame* frame, AVRational timebase)
+{
+    int64_t ts = frame->best_effort_timestamp;
+    if (ts == AV_NOPTS_VALUE)
+        ts = frame->pts;
+
+    if (ts == AV_NOPTS_VALUE)
+        return CLOCK_NONE;
+
+    return av_rescale_q(ts, timebase, AV_TIME_BASE_Q) - data->startTime;
+}
+
+// 压入一帧视频数据
+bool decoderPushVideo(DecoderData* data, AVFrame* frame, int64_t pts)
+{
+    VideoItem item = {frame, pts, data->videoSeek.serial};
+    return pushWaitQueue(data->videoQueue, &item, false);
 }
 
-// 压入一帧音频数据
-void decoderPushAudio(DecoderData* data, void* audioBuffer, int64_t pts)
+// 压入一帧视频数据，队列满时等待渲染线程取走，解码结束时返回 false
+static bool decoderPushVideoWait(DecoderData* data, AVFrame* frame, int64_t pts)
 {
-    SDL_LockMutex(data->videoMutex);
-    pushQueue(data->audioQueue, audioBuffer);
-    pushQueue(data->audioPtsQueue, &pts);
-    SDL_UnlockMutex(data->videoMutex);
+    VideoItem item = {frame, pts, data->videoSeek.serial};
+    return pushWaitQueue(data->videoQueue, &item, true);
 }
 
-// 弹出一帧音频数据
-void* decoderPopAudio(DecoderData* data, int64_t* pts)
+// 弹出一帧当前序号的视频数据，定位之前解码的帧直接释放
+static bool decoderPopVideoItem(DecoderData* data, VideoItem* item, int32_t ms)
 {
-    SDL_LockMutex(data->videoMutex);
-    void* buffer = popQueue(data->audioQueue);
-    int64_t* _pts = popQueue(data->audioPtsQueue);
-    SDL_UnlockMutex(data->videoMutex);
-    if (_pts != NULL)
+    while (popWaitQueue(data->videoQueue, item, ms))
     {
-        *pts = *_pts;
-        free(_pts);
+        if (item->serial == data->serial)
+            return true;
+
+        av_frame_free(&(item->frame));
     }
 
-    return buffer;
+    return false;
 }
 
-// 获取音频队列缓存帧数
-int decoderCountAudio(DecoderData* data)
+// 弹出一帧视频数据
+AVFrame* decoderPopVideo(DecoderData* data, int64_t* pts)
 {
-    SDL_LockMutex(data->audioMutex);
-    int n = countQueue(data->audioQueue);
-    SDL_UnlockMutex(data->audioMutex);
+    VideoItem item;
+    if (!decoderPopVideoItem(data, &item, 0))
+        return NULL;
 
-    return n;
+    *pts = item.pts;
+    return item.frame;
 }
 
-// 等待队列空间
-void decoderWaitBuffer(DecoderData* data)
+// 等待并弹出一帧视频数据，超时或解码结束时返回 NULL
+AVFrame* decoderWaitVideo(DecoderData* data, int64_t* pts, uint32_t ms)
 {
-    SDL_LockMutex(data->avMutex);
-    SDL_CondWait(data->avCond, data->avMutex);
-    SDL_UnlockMutex(data->avMutex);
+    StageTimer timer;
+    beginStage(&timer);
+
+    VideoItem item;
+    if (!decoderPopVideoItem(data, &item, ms))
+        return NULL;
+
+    // 只统计等到了视频帧的情况，超时说明视频已暂停或结束，不是瓶颈
+    endStage(&(data->stages[DECODER_STAGE_VIDEO_WAIT]), &timer);
+    *pts = item.pts;
+    return item.frame;
 }
 
-// 通知解码器,队列有空间
-void decoderNotifyBuffer(DecoderData* data)
+// 获取视频队列缓存帧数
+int decoderCountVideo(DecoderData* data)
 {
-    SDL_LockMutex(data->avMutex);
-    SDL_CondSignal(data->avCond);
-    SDL_UnlockMutex(data->avMutex);
+    return countWaitQueue(data->videoQueue);
 }
 
-// 解封装: 从 MP4、AVI 等封装格式中提取出 H.264、pcm 等音视频编码数据
-bool decoderUnpack(DecoderData* data, const char* file)
+// 写入一段重采样后的 PCM 数据，空间不足时等待音频回调取走，解码结束时返回 false
+static bool decoderWriteAudio(DecoderData* data, const uint8_t* buffer, size_t size, int64_t pts)
 {
-    /* 打开文件 */
-    data->file = file;
-    if (avformat_open_input(&(data->formatContext), data->file, NULL, NULL) != 0)
+    // 时间戳先于数据写入，音频回调读到这段数据时一定能看到它的时间戳
+    // 没有时间戳或记录满了就不记录，由上一个时间戳按采样率推算
+    // 定位后的第一段数据即使没有时间戳也要记录，音频回调靠它找到新数据的起点
+    int serial = data->audioSeek.serial;
+    AudioMark mark = {writePositionRing(data->audioRing), pts, serial};
+    if ((pts != CLOCK_NONE || serial != data->audioMarkSerial) && freeRing(data->audioMarks) >= sizeof(AudioMark))
     {
-        fprintf(stderr, "avformat_open_input failed: %s\n", data->file);
-        avformat_free_context(data->formatContext);
-        data->formatContext = NULL;
-        return false;
+        writeRing(data->audioMarks, &mark, sizeof(AudioMark));
+        data->audioMarkSerial = serial;
     }
 
-    /* 读取流信息 */
-    if (avformat_find_stream_info((data->formatContext), NULL) != 0)
+    while (size > 0)
     {
-        fprintf(stderr, "avformat_find_stream_info failed\n");
-        avformat_close_input(&(data->formatContext));
-        avformat_free_context(data->formatContext);
-        data->formatContext = NULL;
-        return false;
+        size_t n = writeRing(data->audioRing, buffer, size);
+        buffer += n;
+        size -= n;
+        setGauge(&(data->gauges[DECODER_GAUGE_AUDIO_BYTES]), usedRing(data->audioRing));
+        if (size == 0)
+            break;
+
+        // 已经定位到别处，剩下的数据不必再写
+        if (decoderIsEnd(data) || serial != data->serial)
+            return false;
+
+        // 先声明正在等待再检查空间，音频回调在两者之间取走数据时也会唤醒这里
+        data->audioWaiting = true;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (freeRing(data->audioRing) == 0 && !decoderIsEnd(data) && serial == data->serial)
+            SDL_SemWait(data->audioSpace);
+        data->audioWaiting = false;
     }
 
-    /* 遍历 stream 查找音视频流的数据 */
-    for (unsigned int i = 0; i < data->formatContext->nb_streams; i++)
+    return true;
+}
+
+// 丢弃序号不是 serial 的 PCM 数据，找到新序号数据的起点时返回 true
+// 只由音频回调调用，序号的第一个时间戳一定先于这个序号的数据写入
+static bool decoderSkipAudio(DecoderData* data, int serial)
+{
+    AudioMark mark;
+    bool found = false;
+    while (peekRing(data->audioMarks, &mark, sizeof(AudioMark)) == sizeof(AudioMark))
     {
-        if (data->formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        if (mark.serial == serial)
         {
-            data->videoIndex = i;
+            found = true;
+            break;
         }
 
-        if (data->formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
-        {
-            data->audioIndex = i;
-        }
+        readRing(data->audioMarks, &mark, sizeof(AudioMark));
     }
 
-    if (data->audioIndex == -1 && data->videoIndex == -1)
+    uint64_t position = readPositionRing(data->audioRing);
+    if (found)
     {
-        fprintf(stderr, "cannot find stream\n");
-        avformat_free_context(data->formatContext);
-        return false;
+        // 时间戳的位置可能已经被上一次丢弃越过，这时按它推算第一个字节的时间即可
+        if (mark.position > position)
+            skipRing(data->audioRing, mark.position - position);
+
+        data->audioReadSerial = serial;
+    }
+    else
+    {
+        size_t used = usedRing(data->audioRing);
+        skipRing(data->audioRing, used - used % data->frameBytes);
     }
 
-    return true;
+    data->audioMark.pts = CLOCK_NONE;
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&(data->audioWaiting), false))
+        SDL_SemPost(data->audioSpace);
+
+    return found;
 }
 
-// 初始化视频解码器
-bool decoderInitVideoCodec(DecoderData* data)
+// 读取 len 字节 PCM 数据，不足的部分填充静音
+int decoderReadAudio(DecoderData* data, uint8_t* stream, int len, int64_t* pts, int* readSerial)
 {
-    data->videoStream = data->formatContext->streams[data->videoIndex];
-    data->videoParams = data->videoStream->codecpar;
+    int serial = data->serial;
+    *pts = CLOCK_NONE;
+    *readSerial = serial;
+    if (data->audioRing == NULL)
+    {
+        memset(stream, 0, len);
+        return 0;
+    }
 
-    switch (data->videoParams->codec_id)
+    // 定位后先丢弃旧序号的数据，新数据到达之前输出静音，不算数据不足
+    if (serial != data->audioReadSerial && !decoderSkipAudio(data, serial))
     {
-    case AV_CODEC_ID_H264:
-        data->videoCodec = avcodec_find_decoder_by_name("h264_cuvid");
-        break;
-    case AV_CODEC_ID_HEVC:
-        data->videoCodec = avcodec_find_decoder_by_name("h264_cuvid");
-        break;
-    case AV_CODEC_ID_AV1:
-        data->videoCodec = avcodec_find_decoder_by_name("av1_cuvid");
-        break;
-    default:
-        break; // 清警告
+        av_samples_set_silence(&stream, 0, len / data->frameBytes, data->channels, data->sampleFormat);
+        return 0;
     }
-    
-    if (data->videoCodec == NULL)
+
+    // 只读取完整的采样，生产者可能刚写入了一个采样的一部分
+    size_t used = usedRing(data->audioRing);
+    size_t size = (size_t)len < used ? (size_t)len : used;
+    size -= size % data->frameBytes;
+
+    // 越过读取位置之前的时间戳，第一个字节的时间由最近的时间戳按采样率推算
+    uint64_t position = readPositionRing(data->audioRing);
+    AudioMark mark;
+    while (peekRing(data->audioMarks, &mark, sizeof(AudioMark)) == sizeof(AudioMark) && mark.position <= position)
     {
-        data->videoCodec = avcodec_find_decoder(data->videoParams->codec_id);
+        readRing(data->audioMarks, &mark, sizeof(AudioMark));
+        data->audioMark = mark;
     }
 
-    if (data->videoCodec == NULL)
+    if (size > 0 && data->audioMark.pts != CLOCK_NONE)
+        *pts = data->audioMark.pts + (int64_t)((position - data->audioMark.position) * 1000000 / ((uint64_t)data->frameBytes * data->rate));
+
+    size_t n = readRing(data->audioRing, stream, size);
+    setGauge(&(data->gauges[DECODER_GAUGE_AUDIO_BYTES]), usedRing(data->audioRing));
+    if (n > 0 && data->milestones[DECODER_MILESTONE_FIRST_AUDIO] < 0)
+        decoderMarkMilestone(data, DECODER_MILESTONE_FIRST_AUDIO);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (n > 0 && atomic_exchange(&(data->audioWaiting), false))
+        SDL_SemPost(data->audioSpace);
+
+    if (n < (size_t)len)
     {
-        fprintf(stderr, "avcodec_find_decoder failed\n");
-        return false;
+        uint8_t* silence = stream + n;
+        av_samples_set_silence(&silence, 0, (len - n) / data->frameBytes, data->channels, data->sampleFormat);
+
+        // 播放结束后的静音不算数据不足
+        if (!decoderIsEnd(data))
+        {
+            data->underruns += 1;
+            data->silenceBytes += len - n;
+        }
     }
 
-    data->videoContext = avcodec_alloc_context3(data->videoCodec);
-    if (data->videoContext == NULL)
+    return n;
+}
+
+// 获取缓存的 PCM 数据字节数
+int decoderCountAudio(DecoderData* data)
+{
+    return data->audioRing != NULL ? usedRing(data->audioRing) : 0;
+}
+
+Input* decoderCreateInput(const char* file, const DecoderOptions* options)
+{
+    if (options->mmap)
+        return createMmapInput(file);
+
+    if (options->prefetch > 0 || options->ioDelayMs > 0)
     {
-        fprintf(stderr, "avcodec_alloc_context3 failed\n");
-        return false;
+        FileInputOptions inputOptions = {options->prefetch, options->ioDelayMs, options->ioDelayEvery};
+        return createFileInput(file, &inputOptions);
     }
 
-    // 使用 GPU 时需要手动设置
-    data->videoContext->pkt_timebase = data->videoStream->time_base;
+    return NULL;
+}
 
-    if (avcodec_parameters_to_context(data->videoContext, data->videoParams) < 0)
+bool decoderOpenFormat(AVFormatContext** formatContext, const char* file, AVIOContext* pb, const DecoderOptions* options)
+{
+    // 限制探测流信息读取的数据量和时长，MP4 等头部已经描述了流参数的格式可以更快开始播放
+    // 限制过小时 TS 等格式可能探测不到完整的流参数，初始化解码器时会报错
+    AVDictionary* formatOptions = NULL;
+    if (options->probeSize > 0)
+        av_dict_set_int(&formatOptions, "probesize", options->probeSize, 0);
+    if (options->analyzeDuration > 0)
+        av_dict_set_int(&formatOptions, "analyzeduration", options->analyzeDuration, 0);
+
+    // 文件名仍然传给 avformat_open_input，用于按扩展名猜测封装格式
+    *formatContext = NULL;
+    if (pb != NULL)
     {
-        fprintf(stderr, "avcodec_parameters_to_context failed\n");
+        *formatContext = avformat_alloc_context();
+        if (*formatContext == NULL)
+        {
+            fprintf(stderr, "avformat_alloc_context failed\n");
+            av_dict_free(&formatOptions);
+            return false;
+        }
+
+        (*formatContext)->pb = pb;
+        (*formatContext)->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
+    // 失败时 avformat_open_input 释放上下文并置为 NULL
+    int ret = avformat_open_input(formatContext, file, NULL, &formatOptions);
+    av_dict_free(&formatOptions);
+    if (ret != 0)
+    {
+        fprintf(stderr, "avformat_open_input failed: %s\n", file);
         return false;
     }
 
-    if (avcodec_open2(data->videoContext, data->videoCodec, NULL) < 0)
+    if (avformat_find_stream_info(*formatContext, NULL) < 0)
     {
-        fprintf(stderr, "avcodec_open2 failed\n");
+        fprintf(stderr, "avformat_find_stream_info failed: %s\n", file);
+        avformat_close_input(formatContext);
         return false;
     }
 
     return true;
 }
 
-// 初始化音频解码器
-bool decoderInitAudioCodec(DecoderData* data)
+const AVCodec* decoderFindNamedCodec(const char* name, enum AVCodecID id)
 {
-    data->audioStream = data->formatContext->streams[data->audioIndex];
-    data->audioParams = data->audioStream->codecpar;
+    if (name == NULL || strcmp(name, "auto") == 0 || strcmp(name, "default") == 0)
+        return NULL;
 
-    data->audioCodec = avcodec_find_decoder(data->audioParams->codec_id);
-    if (data->audioCodec == NULL)
+    const AVCodec* codec = avcodec_find_decoder_by_name(name);
+    if (codec == NULL || codec->id != id)
     {
-        fprintf(stderr, "avcodec_find_decoder failed\n");
-        return false;
+        fprintf(stderr, "decoder %s cannot decode %s, using the default decoder\n", name, avcodec_get_name(id));
+        return NULL;
     }
 
-    data->audioContext = avcodec_alloc_context3(data->audioCodec);
-    if (data->audioContext == NULL)
+    return codec;
+}
+
+void decoderSetThreads(AVCodecContext* context, const DecoderOptions* options)
+{
+    // 软件解码的多线程设置，thread_count 为 0 时 FFmpeg 按 CPU 核心数自动选择
+    // 硬件解码器不支持这两种多线程，FFmpeg 会忽略这些设置
+    context->thread_count = options->threadCount;
+    switch (options->threadType)
     {
-        fprintf(stderr, "avcodec_alloc_context3 failed\n");
-        return false;
+    case DECODER_THREAD_FRAME:
+        context->thread_type = FF_THREAD_FRAME;
+        break;
+    case DECODER_THREAD_SLICE:
+        context->thread_type = FF_THREAD_SLICE;
+        break;
+    default:
+        context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        break;
     }
+}
 
-    if (avcodec_parameters_to_context(data->audioContext, data->audioParams) < 0)
-    {
-        fprintf(stderr, "avcodec_parameters_to_context failed\n");
+// 解封装: 从 MP4、AVI 等封装格式中提取出 H.264、pcm 等音视频编码数据
+bool decoderUnpack(DecoderData* data, const char* file)
+{
+    /* 打开文件 */
+    data->file = file;
+    data->input = decoderCreateInput(data->file, &(data->options));
+
+    /* 读取流信息 */
+    AVIOContext* pb = data->input != NULL ? inputContext(data->input) : NULL;
+    if (!decoderOpenFormat(&(data->formatContext), data->file, pb, &(data->options)))
         return false;
+
+    /* 遍历 stream 查找音视频流的数据 */
+    for (unsigned int i = 0; i < data->formatContext->nb_streams; i++)
+    {
+        if (data->formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            data->videoIndex = i;
+        }
+
+        if (data->formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+            if (data->options.audio)
+                data->audioIndex = i;
+            else
+                data->formatContext->streams[i]->discard = AVDISCARD_ALL;
+        }
     }
 
-    if (avcodec_open2(data->audioContext, data->audioCodec, NULL) < 0)
+    if (data->audioIndex == -1 && data->videoIndex == -1)
     {
-        fprintf(stderr, "avcodec_open2 failed\n");
+        fprintf(stderr, "cannot find stream\n");
+        avformat_close_input(&(data->formatContext));
         return false;
     }
 
+    decoderMarkMilestone(data, DECODER_MILESTONE_OPEN);
+
+    // 音视频流使用同一个起点，保留二者之间的相对偏移
+    if (data->formatContext->start_time != AV_NOPTS_VALUE)
+        data->startTime = data->formatContext->start_time;
+
+    // 定位以视频的关键帧为准，没有封装格式自带的索引时在后台扫描
+    if (data->videoIndex != -1)
+        data->index = createIndex(data->file, data->formatContext, data->videoIndex, &(data->options));
+
     return true;
 }
 
-// 初始化软件缩放算法
-bool decoderInitSwScale(DecoderData* data, int width, int height, enum AVPixelFormat fmt)
+// 按流参数和选项设置视频解码器上下文，校准时的解码器与播放时使用相同的设置
+static bool decoderConfigureVideo(DecoderData* data, AVCodecContext* context)
 {
-    data->width = width;
-    data->height = height;
-    data->pixFormat = fmt;
+    // 使用 GPU 时需要手动设置
+    context->pkt_timebase = data->videoStream->time_base;
 
-    data->decodedVideoFrame = av_frame_alloc();
-    data->displayVideoFrame = av_frame_alloc();
+    if (avcodec_parameters_to_context(context, data->videoParams) < 0)
+        return false;
 
-    // 计算缩放后需要的视频缓冲区大小
-    data->videoBufferSize = av_image_get_buffer_size(
-        data->pixFormat, 
-        data->width, 
-        data->height, 
-        1
-    );
+    decoderSetThreads(context, &(data->options));
+    return true;
+}
 
-    // 为缩放后的视频缓冲区分配内存
-    data->displayVideoBuffer = av_malloc(data->videoBufferSize);
-    av_image_fill_arrays(
-        data->displayVideoFrame->data, 
-        data->displayVideoFrame->linesize, 
-        data->displayVideoBuffer, 
-        data->pixFormat,
-        data->width, 
-        data->height,
-        1
-    );
+// 用独立的 AVFormatContext 读取视频流从第一个关键帧开始的一个 GOP，不影响播放使用的 AVFormatContext
+// 与播放使用相同的读取方式和探测流信息的限制，返回读到的数据包个数，packets 由调用者用 av_packet_free 释放
+static int decoderReadFirstGop(DecoderData* data, AVPacket** packets, int max)
+{
+    Input* input = decoderCreateInput(data->file, &(data->options));
+    AVIOContext* pb = input != NULL ? inputContext(input) : NULL;
+    AVFormatContext* formatContext = NULL;
+    if (!decoderOpenFormat(&formatContext, data->file, pb, &(data->options)))
+    {
+        deleteInput(input);
+        return 0;
+    }
 
-    // 创建软件缩放算法上下文
-    AVCodecParameters* params = avcodec_parameters_alloc(); // 使用 GPU 解码会导致像素格式改变
-    avcodec_parameters_from_context(params, data->videoContext);
+    int index = data->videoIndex;
+    if (index >= (int)formatContext->nb_streams || formatContext->streams[index]->codecpar->codec_id != data->videoParams->codec_id)
+    {
+        avformat_close_input(&formatContext);
+        deleteInput(input);
+        return 0;
+    }
 
-    // 新版本好像不存在这个现象了，大概是作为 BUG 修复了
-    // 使用 qsv 解码器时，params->format 得到的是使用软件解码器时的格式
-    // 但实际上解码器返回的是 NV12 格式，通过 data->videoCodec->pix_fmts 来获得该格式
-    //      NV12 和 YUV422 格式一致，但是排列不同
-    //      YUV422 按像素排列，例如: Y0 U0 Y1 V1 Y2 U2 Y3 V3
-    //      NV12 按通道排列，例如: Y0 Y1 Y2 Y3 U0 V1 U2 V3
-    const enum AVPixelFormat* pix_fmts = NULL;
-    int n = 0;
-    avcodec_get_supported_config(data->videoContext, data->videoCodec, AV_CODEC_CONFIG_PIX_FORMAT, 0, (const void**)&pix_fmts, &n);
-    
-    data->swsContext = sws_getContext(
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+    {
+        if ((int)i != index)
+            formatContext->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    // 超时或跳过的数据包太多时按已经读到的数据包校准，一个也没有读到时使用默认解码器
+    uint64_t deadlineNs = wallNs() + (uint64_t)CALIBRATE_BUDGET_MS * 1000000;
+    int count = 0;
+    int skipped = 0;
+    AVPacket* packet = av_packet_alloc();
+    while (packet != NULL && count < max && skipped < max && wallNs() < deadlineNs && av_read_frame(formatContext, packet) >= 0)
+    {
+        bool key = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+        if (packet->stream_index != index || (count == 0 && !key))
+        {
+            av_packet_unref(packet);
+            skipped += 1;
+            continue;
+        }
+
+        // 下一个关键帧是下一个 GOP 的开始
+        if (count > 0 && key)
+        {
+            av_packet_unref(packet);
+            break;
+        }
+
+        packets[count++] = packet;
+        packet = av_packet_alloc();
+    }
+
+    av_packet_free(&packet);
+    avformat_close_input(&formatContext);
+    deleteInput(input);
+    return count;
+}
+
+// 用 codec 解码 packets，最多用 CALIBRATE_BUDGET_MS 毫秒，返回平均每帧的解码时间，单位毫秒，
+// 打开失败、解码出错、没有输出帧或输出的是 sws_scale 无法读取的硬件帧时返回负数
+static double decoderCalibrate(DecoderData* data, const AVCodec* codec, AVPacket** packets, int count)
+{
+    AVCodecContext* context = avcodec_alloc_context3(codec);
+    AVFrame* frame = av_frame_alloc();
+    if (context == NULL || frame == NULL || !decoderConfigureVideo(data, context) || avcodec_open2(context, codec, NULL) < 0)
+    {
+        av_frame_free(&frame);
+        avcodec_free_context(&context);
+        return -1;
+    }
+
+    // 打开解码器的时间只在播放开始时花一次，不计入
+    uint64_t startNs = wallNs();
+    int frames = 0;
+    bool ok = true;
+    for (int i = 0; i <= count && ok; i++)
+    {
+        // 超时后不再送入，不冲刷解码器，缓存在解码器中的帧不计入
+        if (frames > 0 && wallNs() - startNs > (uint64_t)CALIBRATE_BUDGET_MS * 1000000)
+            break;
+
+        // 每次送入后都取空输出，送入不会返回 EAGAIN；最后送入 NULL 冲刷解码器，取出缓存的全部帧
+        if (avcodec_send_packet(context, i < count ? packets[i] : NULL) < 0)
+        {
+            ok = false;
+            break;
+        }
+
+        while (ok)
+        {
+            int ret = avcodec_receive_frame(context, frame);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+                break;
+
+            if (ret < 0)
+            {
+                ok = false;
+                break;
+            }
+
+            const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(frame->format);
+            if (desc == NULL || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) || !sws_isSupportedInput(frame->format))
+                ok = false;
+
+            frames += 1;
+            av_frame_unref(frame);
+        }
+    }
+
+    double ms = (wallNs() - startNs) / 1e6;
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+    return ok && frames > 0 ? ms / frames : -1;
+}
+
+/* 本进程的校准结果，同一编码和分辨率只校准一次，由 calibrateMutex 保护 */
+typedef struct CalibratedChoice
+{
+    enum AVCodecID id;
+    int width;
+    int height;
+    const AVCodec* codec;
+}CalibratedChoice;
+
+static SDL_SpinLock calibrateMutexLock = 0;
+static SDL_mutex* calibrateMutex = NULL;
+static CalibratedChoice calibrated[CALIBRATE_MEMORY];
+static int calibratedCount = 0;
+
+// 正在运行 decoderRun 的解码器个数，不为 0 时校准的计时会被它们的解码线程拖慢
+static atomic_int runningDecoders = 0;
+
+// 校准互斥锁在第一次使用时创建，之后在整个进程中一直存在
+static SDL_mutex* decoderCalibrateMutex(void)
+{
+    SDL_AtomicLock(&calibrateMutexLock);
+    if (calibrateMutex == NULL)
+        calibrateMutex = SDL_CreateMutex();
+    SDL_AtomicUnlock(&calibrateMutexLock);
+    return calibrateMutex;
+}
+
+// 查找本进程的校准结果，调用者持有 calibrateMutex
+static const AVCodec* decoderFindCalibrated(enum AVCodecID id, int width, int height)
+{
+    int count = calibratedCount < CALIBRATE_MEMORY ? calibratedCount : CALIBRATE_MEMORY;
+    for (int i = 0; i < count; i++)
+    {
+        if (calibrated[i].id == id && calibrated[i].width == width && calibrated[i].height == height)
+            return calibrated[i].codec;
+    }
+
+    return NULL;
+}
+
+// 记住本进程的校准结果，调用者持有 calibrateMutex
+static void decoderRememberCalibrated(enum AVCodecID id, int width, int height, const AVCodec* codec)
+{
+    CalibratedChoice choice = {id, width, height, codec};
+    calibrated[calibratedCount % CALIBRATE_MEMORY] = choice;
+    calibratedCount += 1;
+}
+
+// 用文件的第一个 GOP 依次校准所有候选的解码器，返回最快的一个，全部失败时返回 NULL
+static const AVCodec* decoderCalibrateAll(DecoderData* data, const AVCodec** decoders, int count)
+{
+    enum AVCodecID id = data->videoParams->codec_id;
+    int width = data->videoParams->width;
+    int height = data->videoParams->height;
+
+    AVPacket* packets[CALIBRATE_PACKETS];
+    int packetCount = decoderReadFirstGop(data, packets, CALIBRATE_PACKETS);
+    if (packetCount == 0)
+        return NULL;
+
+    const AVCodec* codec = NULL;
+    double best = -1;
+    for (int i = 0; i < count; i++)
+    {
+        double ms = decoderCalibrate(data, decoders[i], packets, packetCount);
+        if (data->options.verbose && ms < 0)
+            fprintf(stderr, "calibrate %s %dx%d: %-16s failed\n", avcodec_get_name(id), width, height, decoders[i]->name);
+        else if (data->options.verbose)
+            fprintf(stderr, "calibrate %s %dx%d: %-16s %.3f ms/frame\n", avcodec_get_name(id), width, height, decoders[i]->name, ms);
+
+        if (ms >= 0 && (best < 0 || ms < best))
+        {
+            best = ms;
+            codec = decoders[i];
+        }
+    }
+
+    for (int i = 0; i < packetCount; i++)
+        av_packet_free(&(packets[i]));
+
+    return codec;
+}
+
+// 选择视频解码器，没有可选的解码器时返回 NULL，由调用者使用 FFmpeg 的默认解码器
+// 1. 命令行指定的解码器，default 表示直接使用 FFmpeg 的默认解码器
+// 2. 本进程中同一编码、同一分辨率已经校准过的选择
+// 3. 缓存文件中同一编码、同一分辨率的选择
+// 4. 用文件的第一个 GOP 依次校准所有能解码这种编码的解码器，选出最快的写入缓存文件
+// 后三步持有进程内的校准锁: 并行打开的多个文件（拼接模式的各个格子）只有第一个校准，其它的等待后直接使用结果
+static const AVCodec* decoderSelectVideoCodec(DecoderData* data)
+{
+    enum AVCodecID id = data->videoParams->codec_id;
+    int width = data->videoParams->width;
+    int height = data->videoParams->height;
+    const char* name = data->options.videoDecoder;
+    if (name != NULL && strcmp(name, "auto") != 0)
+    {
+        const AVCodec* codec = decoderFindNamedCodec(name, id);
+        if (codec != NULL)
+            data->videoCodecSource = "override";
+        return codec;
+    }
+
+    const AVCodec* decoders[CALIBRATE_DECODERS];
+    int count = listDecoders(id, decoders, CALIBRATE_DECODERS);
+    if (count <= 1)
+    {
+        data->videoCodecSource = "only";
+        return count == 1 ? decoders[0] : NULL;
+    }
+
+    char cache[1024];
+    const char* cacheFile = data->options.decoderCache;
+    if (cacheFile == NULL && defaultDecoderCache(cache, sizeof(cache)))
+        cacheFile = cache;
+
+    uint64_t startNs = wallNs();
+    SDL_mutex* mutex = decoderCalibrateMutex();
+    SDL_LockMutex(mutex);
+
+    const AVCodec* codec = decoderFindCalibrated(id, width, height);
+    if (codec != NULL)
+    {
+        data->videoCodecSource = "remembered";
+    }
+    else if (cacheFile != NULL && !data->options.recalibrate && (codec = loadDecoderChoice(cacheFile, id, width, height)) != NULL)
+    {
+        data->videoCodecSource = "cached";
+    }
+    else if ((codec = decoderCalibrateAll(data, decoders, count)) != NULL)
+    {
+        decoderRememberCalibrated(id, width, height, codec);
+
+        // 其它文件正在解码时（播放列表预加载下一项）计时不准，只在本进程使用，不写入缓存文件
+        if (atomic_load(&runningDecoders) > 0)
+        {
+            data->videoCodecSource = "busy";
+        }
+        else
+        {
+            data->videoCodecSource = "calibrated";
+            if (cacheFile != NULL)
+                saveDecoderChoice(cacheFile, id, width, height, codec);
+        }
+    }
+
+    SDL_UnlockMutex(mutex);
+    data->calibrateUs = (int64_t)((wallNs() - startNs) / 1000);
+    return codec;
+}
+
+// 初始化视频解码器
+bool decoderInitVideoCodec(DecoderData* data)
+{
+    if (data->videoIndex == -1)
+    {
+        fprintf(stderr, "cannot find video stream\n");
+        return false;
+    }
+
+    data->videoStream = data->formatContext->streams[data->videoIndex];
+    data->videoParams = data->videoStream->codecpar;
+    if (data->videoParams->width <= 0 || data->videoParams->height <= 0)
+    {
+        fprintf(stderr, "video size not found, try a larger probesize or analyzeduration\n");
+        return false;
+    }
+
+    // 一帧的时长，用于判断帧是否落后、补全缺失的时间戳
+    AVRational rate = data->videoStream->avg_frame_rate;
+    if (rate.num <= 0 || rate.den <= 0)
+        rate = data->videoStream->r_frame_rate;
+    if (rate.num > 0 && rate.den > 0)
+        data->frameDuration = av_rescale(AV_TIME_BASE, rate.den, rate.num);
+
+    // 命令行指定、缓存或校准选出的解码器，都没有时使用 FFmpeg 的默认解码器
+    data->videoCodec = decoderSelectVideoCodec(data);
+    if (data->videoCodec == NULL)
+    {
+        data->videoCodec = avcodec_find_decoder(data->videoParams->codec_id);
+        data->videoCodecSource = "default";
+    }
+
+    if (data->videoCodec == NULL)
+    {
+        fprintf(stderr, "avcodec_find_decoder failed\n");
+        return false;
+    }
+
+    data->videoContext = avcodec_alloc_context3(data->videoCodec);
+    if (data->videoContext == NULL)
+    {
+        fprintf(stderr, "avcodec_alloc_context3 failed\n");
+        return false;
+    }
+
+    if (!decoderConfigureVideo(data, data->videoContext))
+    {
+        fprintf(stderr, "avcodec_parameters_to_context failed\n");
+        return false;
+    }
+
+    if (avcodec_open2(data->videoContext, data->videoCodec, NULL) < 0)
+    {
+        fprintf(stderr, "avcodec_open2 failed\n");
+        return false;
+    }
+
+    // 帧级多线程时，每个线程各自解码一帧，第一帧输出前要先送入 thread_count - 1 个数据包
+    // 之后帧也是成批输出，缓存队列需要相应加长，否则渲染线程会等待
+    if (data->videoContext->active_thread_type & FF_THREAD_FRAME)
+        data->videoDelay = FFMAX(data->videoContext->thread_count - 1, 0);
+
+    return true;
+}
+
+// 初始化音频解码器
+bool decoderInitAudioCodec(DecoderData* data)
+{
+    if (data->audioIndex == -1)
+    {
+        fprintf(stderr, "cannot find audio stream\n");
+        return false;
+    }
+
+    data->audioStream = data->formatContext->streams[data->audioIndex];
+    data->audioParams = data->audioStream->codecpar;
+    if (data->audioParams->sample_rate <= 0 || data->audioParams->ch_layout.nb_channels <= 0 || data->audioParams->format < 0)
+    {
+        fprintf(stderr, "audio parameters not found, try a larger probesize or analyzeduration\n");
+        return false;
+    }
+
+    data->audioCodec = avcodec_find_decoder(data->audioParams->codec_id);
+    if (data->audioCodec == NULL)
+    {
+        fprintf(stderr, "avcodec_find_decoder failed\n");
+        return false;
+    }
+
+    data->audioContext = avcodec_alloc_context3(data->audioCodec);
+    if (data->audioContext == NULL)
+    {
+        fprintf(stderr, "avcodec_alloc_context3 failed\n");
+        return false;
+    }
+
+    if (avcodec_parameters_to_context(data->audioContext, data->audioParams) < 0)
+    {
+        fprintf(stderr, "avcodec_parameters_to_context failed\n");
+        return false;
+    }
+
+    if (avcodec_open2(data->audioContext, data->audioCodec, NULL) < 0)
+    {
+        fprintf(stderr, "avcodec_open2 failed\n");
+        return false;
+    }
+
+    return true;
+}
+
+// 创建缩放算法上下文
+static struct SwsContext* decoderCreateSwsContext(DecoderData* data, enum AVPixelFormat srcFormat)
+{
+    return sws_getContext(
         data->videoParams->width,                   // 缩放之前的尺寸
         data->videoParams->height,
-        pix_fmts ? pix_fmts[0] : params->format,    // 缩放之前像素格式
+        srcFormat,                                  // 缩放之前像素格式
         data->width,                                // 缩放后的尺寸
         data->height,
         data->pixFormat,                            // 缩放后的像素格式
-        SWS_BICUBIC,                                // 缩放算法:双三次方插值
+        data->options.scaleFlags,                   // 缩放算法，默认双三次方插值
         NULL,
         NULL,
         NULL
     );
+}
+
+// 缩放一个条带: 每个条带的上下文都送入完整的源帧，只输出自己负责的行
+static void decoderScaleSlice(void* userdata, int index)
+{
+    DecoderData* data = (DecoderData*)(userdata);
+    struct SwsContext* context = data->swsSlices[index];
+    int y = index * data->sliceHeight;
+    int h = FFMIN(data->sliceHeight, data->height - y);
+    if (h <= 0)
+        return;
+
+    uint64_t cpuNs = threadCpuNs();
+    if (sws_frame_start(context, data->scaleDst, data->scaleSrc) < 0 ||
+        sws_send_slice(context, 0, data->scaleSrc->height) < 0 ||
+        sws_receive_slice(context, y, h) < 0)
+    {
+        data->scaleFailed = true;
+    }
+
+    sws_frame_end(context);
+
+    // 每个工作线程累加自己的 CPU 时间
+    addStageCpu(&(data->stages[DECODER_STAGE_SCALE]), threadCpuNs() - cpuNs);
+}
+
+// 用快速路径转换一个条带，条带的划分与 sws_scale 相同
+static void decoderConvertSlice(void* userdata, int index)
+{
+    DecoderData* data = (DecoderData*)(userdata);
+    int y = index * data->sliceHeight;
+    int h = FFMIN(data->sliceHeight, data->height - y);
+    if (h <= 0)
+        return;
+
+    uint64_t cpuNs = threadCpuNs();
+    convertSlice(data->converter, data->scaleSrc, data->scaleDst, y, h);
+    addStageCpu(&(data->stages[DECODER_STAGE_SCALE]), threadCpuNs() - cpuNs);
+}
+
+// 解码器实际输出的格式或尺寸与条带上下文不同时（分辨率切换、硬件解码退回软件格式等）按实际的帧重建全部条带上下文
+static bool decoderUpdateSlices(DecoderData* data, const AVFrame* src)
+{
+    if (src->format == data->sliceSrcFormat && src->width == data->sliceSrcWidth && src->height == data->sliceSrcHeight)
+        return true;
+
+    for (int i = 0; i < data->swsSliceCount; i++)
+    {
+        data->swsSlices[i] = sws_getCachedContext(
+            data->swsSlices[i],
+            src->width,
+            src->height,
+            src->format,
+            data->width,
+            data->height,
+            data->pixFormat,
+            data->options.scaleFlags,
+            NULL,
+            NULL,
+            NULL
+        );
+        if (data->swsSlices[i] == NULL)
+        {
+            // 下一帧重新尝试
+            data->sliceSrcFormat = AV_PIX_FMT_NONE;
+            return false;
+        }
+    }
+
+    // 新格式的色度平面可能有不同的行对齐要求
+    int align = FFMAX(sws_receive_slice_alignment(data->swsSlices[0]), 2);
+    data->sliceHeight = FFALIGN((data->height + data->swsSliceCount - 1) / data->swsSliceCount, align);
+    data->sliceSrcFormat = src->format;
+    data->sliceSrcWidth = src->width;
+    data->sliceSrcHeight = src->height;
+    return true;
+}
+
+// 像素格式是否可以直接上传到 SDL 纹理
+static bool decoderIsTextureFormat(enum AVPixelFormat fmt)
+{
+    return fmt == AV_PIX_FMT_YUV420P || fmt == AV_PIX_FMT_YUVJ420P || fmt == AV_PIX_FMT_NV12;
+}
+
+// 将解码后的帧缩放到 dst，有多个条带时由线程池并行缩放
+// 源帧与快速路径匹配时用 SIMD 实现代替 sws_scale，解码器输出的格式或尺寸改变后退回 sws_scale
+// 单个上下文和条带上下文都按实际的帧更新，不会用初始化时的尺寸读取新的帧
+static bool decoderScale(DecoderData* data, const AVFrame* src, AVFrame* dst)
+{
+    StageTimer timer;
+    beginStage(&timer);
+    bool fast = data->converter != NULL && matchConverter(data->converter, src);
+    if (fast && data->swsSliceCount < 2)
+    {
+        convertSlice(data->converter, src, dst, 0, data->height);
+        endStage(&(data->stages[DECODER_STAGE_SCALE]), &timer);
+        return true;
+    }
+
+    if (data->swsSliceCount < 2)
+    {
+        // 解码器实际输出的格式或尺寸可能与初始化时不同，按实际的帧更新上下文
+        data->swsContext = sws_getCachedContext(
+            data->swsContext,
+            src->width,
+            src->height,
+            src->format,
+            data->width,
+            data->height,
+            data->pixFormat,
+            data->options.scaleFlags,
+            NULL,
+            NULL,
+            NULL
+        );
+        if (data->swsContext == NULL)
+        {
+            endStage(&(data->stages[DECODER_STAGE_SCALE]), &timer);
+            return false;
+        }
+
+        int ret = sws_scale(
+            data->swsContext, 
+            (const unsigned char * const*)(src->data), 
+            src->linesize, 
+            0, 
+            src->height, 
+            dst->data, 
+            dst->linesize
+        );
+        endStage(&(data->stages[DECODER_STAGE_SCALE]), &timer);
+        return ret > 0;
+    }
+
+    if (!fast && !decoderUpdateSlices(data, src))
+    {
+        endStage(&(data->stages[DECODER_STAGE_SCALE]), &timer);
+        return false;
+    }
+
+    data->scaleSrc = src;
+    data->scaleDst = dst;
+    data->scaleFailed = false;
+    runWorkers(data->workers, fast ? decoderConvertSlice : decoderScaleSlice, data, data->swsSliceCount);
+    endStageWall(&(data->stages[DECODER_STAGE_SCALE]), &timer);
+    return !data->scaleFailed;
+}
+
+// 初始化软件缩放算法
+bool decoderInitSwScale(DecoderData* data, int width, int height, enum AVPixelFormat fmt)
+{
+    // 创建软件缩放算法上下文
+    AVCodecParameters* params = avcodec_parameters_alloc(); // 使用 GPU 解码会导致像素格式改变
+    avcodec_parameters_from_context(params, data->videoContext);
+
+    // 新版本好像不存在这个现象了，大概是作为 BUG 修复了
+    // 使用 qsv 解码器时，params->format 得到的是使用软件解码器时的格式
+    // 但实际上解码器返回的是 NV12 格式，通过 data->videoCodec->pix_fmts 来获得该格式
+    //      NV12 和 YUV422 格式一致，但是排列不同
+    //      YUV422 按像素排列，例如: Y0 U0 Y1 V1 Y2 U2 Y3 V3
+    //      NV12 按通道排列，例如: Y0 Y1 Y2 Y3 U0 V1 U2 V3
+    const enum AVPixelFormat* pix_fmts = NULL;
+    int n = 0;
+    avcodec_get_supported_config(data->videoContext, data->videoCodec, AV_CODEC_CONFIG_PIX_FORMAT, 0, (const void**)&pix_fmts, &n);
+    enum AVPixelFormat srcFormat = pix_fmts ? pix_fmts[0] : params->format;
     avcodec_parameters_free(&params);
 
-    // 创建视频数据队列
-    data->videoQueue = createQueue(data->videoBufferSize);
-    data->videoPtsQueue = createQueue(sizeof(int64_t));
-    data->videoMutex = SDL_CreateMutex();
+    // 原始分辨率模式: 使用视频本身的尺寸，由渲染器缩放到窗口
+    // 像素格式有对应的纹理格式时，解码后的帧直接交给渲染线程上传，不经过 sws_scale
+    if (data->options.native)
+    {
+        width = data->videoParams->width;
+        height = data->videoParams->height;
+        if (decoderIsTextureFormat(srcFormat))
+        {
+            fmt = srcFormat;
+            data->passthrough = true;
+        }
+    }
+
+    data->width = width;
+    data->height = height;
+    data->pixFormat = fmt;
+
+    data->decodedVideoFrame = av_frame_alloc();
+
+    // 计算缩放后需要的视频缓冲区大小，每行按 SIMD 宽度对齐
+    data->videoBufferSize = av_image_get_buffer_size(
+        data->pixFormat, 
+        data->width, 
+        data->height, 
+        LINESIZE_ALIGN
+    );
+
+    // 帧队列的容量按内存预算确定，分辨率越高缓存的帧越少
+    int frames = QUEUE_CAPACITY;
+    if (data->videoBufferSize > 0)
+        frames = (int)FFMAX(MIN_QUEUE_CAPACITY, FFMIN(data->options.bufferBytes / FRAME_BUDGET_SHARE / data->videoBufferSize, QUEUE_CAPACITY));
+
+    // 缩放后的视频缓冲区由缓冲区池分配，帧在渲染线程释放后回到池中复用
+    // 池的大小为队列容量加上生产者正在写入和消费者正在读取的各一个
+    // 帧级多线程解码的帧成批输出，队列和池都加上解码延迟的帧数
+    // 直通模式下只有解码器输出格式意外改变时才需要缩放，只预留一个缓冲区
+    data->videoPool = createPool(data->videoBufferSize, data->passthrough ? 1 : frames + 2 + data->videoDelay);
+
+    // 创建视频数据队列，队列中保存帧的指针和时间戳，帧的所有权随出队转移给渲染线程
+    data->videoQueue = createWaitQueue(sizeof(VideoItem), frames + data->videoDelay, &(data->end), &(data->gauges[DECODER_GAUGE_VIDEO_FRAMES]));
+
+    if (data->passthrough)
+        return true;
+
+    data->swsContext = decoderCreateSwsContext(data, srcFormat);
+    if (data->swsContext == NULL)
+    {
+        fprintf(stderr, "sws_getContext failed\n");
+        return false;
+    }
+
+    // 源和目标的格式、尺寸匹配快速路径时不经过 sws_scale，上面的上下文留给解码器输出意外改变的帧
+    if (data->options.fastConvert)
+    {
+        data->converter = createConverter(srcFormat, data->videoParams->width, data->videoParams->height,
+            data->pixFormat, data->width, data->height, convertBestIsa());
+        if (data->converter != NULL)
+        {
+            snprintf(data->scalePath, sizeof(data->scalePath), "%s/%s",
+                converterName(data->converter), convertIsaName(converterIsa(data->converter)));
+        }
+    }
+
+    // 按线程数把输出画面分成水平条带，每个条带使用独立的缩放算法上下文并行缩放
+    // 共用线程池时按线程池的并行度划分，多个解码器的缩放任务在线程池中依次执行
+    int threads = data->options.scaleThreads > 0 ? data->options.scaleThreads : SDL_GetCPUCount();
+    if (data->options.workers != NULL)
+        threads = countWorkers(data->options.workers);
+    int slices = FFMIN(threads, data->height / MIN_SLICE_HEIGHT);
+    if (slices > 1)
+    {
+        data->swsSlices = calloc(slices, sizeof(struct SwsContext*));
+        data->workers = data->options.workers != NULL ? data->options.workers : createWorkers(slices);
+        if (data->swsSlices == NULL || data->workers == NULL)
+        {
+            fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+            return false;
+        }
+
+        for (data->swsSliceCount = 0; data->swsSliceCount < slices; data->swsSliceCount++)
+        {
+            data->swsSlices[data->swsSliceCount] = decoderCreateSwsContext(data, srcFormat);
+            if (data->swsSlices[data->swsSliceCount] == NULL)
+            {
+                fprintf(stderr, "sws_getContext failed\n");
+                return false;
+            }
+        }
+
+        // 条带的起始行需要对齐，例如 YUV420P 的色度平面行数减半，起始行必须是偶数，快速路径也按同样的条带划分
+        int align = FFMAX(sws_receive_slice_alignment(data->swsSlices[0]), 2);
+        data->sliceHeight = FFALIGN((data->height + slices - 1) / slices, align);
+        data->sliceSrcFormat = srcFormat;
+        data->sliceSrcWidth = data->videoParams->width;
+        data->sliceSrcHeight = data->videoParams->height;
+    }
+
+    return true;
+}
+
+// 初始化软件重采样算法
+bool decoderInitSwResample(DecoderData* data, const AVChannelLayout* layout, enum AVSampleFormat fmt, int rate)
+{
+    // data->layout = layout;
+    data->sampleFormat = fmt;
+    data->rate = rate;
+
+    // 为解码后的音频帧分配内存
+    data->decodedAudioFrame = av_frame_alloc();
+
+    /* 初始化音频重采样 */
+    data->swrContext = swr_alloc();
+    swr_alloc_set_opts2(
+        &(data->swrContext),
+        layout,                             // 输出声道布局
+        data->sampleFormat,                 // 输出音频数据格式
+        data->rate,                         // 输出采样率
+        &(data->audioParams->ch_layout),    // 输入声道布局
+        data->audioParams->format,          // 输入格式
+        data->audioParams->sample_rate,     // 输入采样频率
+        0,
+        NULL
+    );
+
+    swr_init(data->swrContext);
+
+    data->channels = layout->nb_channels;
+    data->frameBytes = data->channels * av_get_bytes_per_sample(data->sampleFormat);
+
+    // 音频回调一次请求的采样数，按一帧音频的时长计算；frame_size 可变的解码器没有给出时使用默认值
+    int frameSize = data->audioParams->frame_size;
+    data->samples = frameSize > 0 ? frameSize * data->rate / data->audioParams->sample_rate : DEFAULT_AUDIO_SAMPLES;
+    data->audioBufferSize = data->samples * data->frameBytes;
+
+    // 创建 PCM 环形缓冲区，音频回调按字节读取，与重采样输出的帧大小无关
+    size_t ringSize = (size_t)data->rate * AUDIO_RING_MS / 1000 * data->frameBytes;
+    if (ringSize < (size_t)data->audioBufferSize * 2)
+        ringSize = data->audioBufferSize * 2;
+
+    data->audioRing = createRing(ringSize);
+    data->audioMarks = createRing(AUDIO_MARK_CAPACITY * sizeof(AudioMark));
+    if (data->audioRing == NULL || data->audioMarks == NULL)
+        return false;
+
+    return true;
+}
+
+// 音频初始化线程的参数和结果
+typedef struct AudioInit
+{
+    DecoderData* data;
+    const AVChannelLayout* layout;
+    enum AVSampleFormat sampleFormat;
+    int rate;
+    bool ok;
+}AudioInit;
+
+static int decoderInitAudioThread(void* userdata)
+{
+    AudioInit* init = (AudioInit*)(userdata);
+    init->ok = decoderInitAudioCodec(init->data) && decoderInitSwResample(init->data, init->layout, init->sampleFormat, init->rate);
+    return EXIT_SUCCESS;
+}
+
+// 音视频两路只写各自的字段，打开解码器、创建缩放和重采样上下文可以同时进行
+bool decoderInit(DecoderData* data, int width, int height, enum AVPixelFormat fmt,
+    const AVChannelLayout* layout, enum AVSampleFormat sampleFormat, int rate, bool* hasVideo, bool* hasAudio)
+{
+    AudioInit init = {data, layout, sampleFormat, rate, false};
+    SDL_Thread* audioThread = NULL;
+    if (data->audioIndex != -1)
+    {
+        audioThread = SDL_CreateThread(decoderInitAudioThread, "decoderInitAudio", &init);
+        if (audioThread == NULL)
+            decoderInitAudioThread(&init);
+    }
+
+    *hasVideo = data->videoIndex != -1 && decoderInitVideoCodec(data) && decoderInitSwScale(data, width, height, fmt);
+    SDL_WaitThread(audioThread, NULL);
+    *hasAudio = init.ok;
+
+    decoderMarkMilestone(data, DECODER_MILESTONE_READY);
+    return *hasVideo || *hasAudio;
+}
+
+// 视频帧释放时将缓冲区归还到池中，只发生在解码线程和渲染线程，音频回调不会释放视频帧
+static void decoderReleaseVideoBuffer(void* opaque, uint8_t* buffer)
+{
+    releasePool((Pool*)opaque, buffer);
+}
+
+// 从缓冲区池获取一帧缩放后的视频帧
+static AVFrame* decoderAllocVideoFrame(DecoderData* data)
+{
+    AVFrame* frame = av_frame_alloc();
+    if (frame == NULL)
+        return NULL;
+
+    uint8_t* buffer = acquirePool(data->videoPool);
+    if (buffer == NULL)
+    {
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    frame->buf[0] = av_buffer_create(buffer, data->videoBufferSize, decoderReleaseVideoBuffer, data->videoPool, 0);
+    if (frame->buf[0] == NULL)
+    {
+        releasePool(data->videoPool, buffer);
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    frame->format = data->pixFormat;
+    frame->width = data->width;
+    frame->height = data->height;
+    av_image_fill_arrays(
+        frame->data, 
+        frame->linesize, 
+        frame->buf[0]->data, 
+        data->pixFormat,
+        data->width, 
+        data->height,
+        LINESIZE_ALIGN
+    );
+
+    return frame;
+}
+
+// 音频回调一次请求的一个通道的采样数
+int decoderSamples(DecoderData* data)
+{
+    return data->samples;
+}
+
+// 缩放后一帧视频数据的字节数
+int decoderVideoBufferSize(DecoderData* data)
+{
+    return data->videoBufferSize;
+}
+
+// 音频回调一次请求的字节数
+int decoderAudioBufferSize(DecoderData* data)
+{
+    return data->audioBufferSize;
+}
+
+// 处理阶段的名称
+const char* decoderStageName(DecoderStage stage)
+{
+    static const char* names[DECODER_STAGE_COUNT] = {
+        "demux",
+        "video_decode",
+        "audio_decode",
+        "scale",
+        "resample",
+        "seek",
+        "video_wait",
+        "upload",
+        "present",
+        "audio_callback",
+    };
+
+    return stage < DECODER_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+// 处理阶段的累计耗时
+void decoderStageStats(DecoderData* data, DecoderStage stage, StageStats* stats)
+{
+    readStage(&(data->stages[stage]), stats);
+}
+
+// 结束一个由调用者计时的阶段
+void decoderEndStage(DecoderData* data, DecoderStage stage, const StageTimer* timer)
+{
+    endStage(&(data->stages[stage]), timer);
+}
+
+// 队列深度的名称
+const char* decoderGaugeName(DecoderGauge gauge)
+{
+    static const char* names[DECODER_GAUGE_COUNT] = {
+        "video_packets",
+        "audio_packets",
+        "video_frames",
+        "audio_bytes",
+        "av_drift_us",
+        "packet_bytes",
+        "video_buffered_us",
+        "audio_buffered_us",
+        "video_target_us",
+        "audio_target_us",
+    };
+
+    return gauge < DECODER_GAUGE_COUNT ? names[gauge] : "unknown";
+}
+
+// 时间点的名称
+const char* decoderMilestoneName(DecoderMilestone milestone)
+{
+    static const char* names[DECODER_MILESTONE_COUNT] = {
+        "open",
+        "ready",
+        "first_video",
+        "first_audio",
+    };
+
+    return milestone < DECODER_MILESTONE_COUNT ? names[milestone] : "unknown";
+}
+
+// 记录到达时间点，只有第一次调用有效
+void decoderMarkMilestone(DecoderData* data, DecoderMilestone milestone)
+{
+    int64_t expected = -1;
+    int64_t us = (int64_t)((wallNs() - data->createNs) / 1000);
+    atomic_compare_exchange_strong(&(data->milestones[milestone]), &expected, us);
+}
+
+// 从创建解码器到时间点的微秒数
+int64_t decoderMilestone(DecoderData* data, DecoderMilestone milestone)
+{
+    return data->milestones[milestone];
+}
+
+// 记录一帧因为落后而没有显示的视频
+void decoderSkipVideo(DecoderData* data)
+{
+    data->videoCounters.skipped += 1;
+}
 
-    return true;
+// 记录一次重复显示上一帧
+void decoderRepeatVideo(DecoderData* data)
+{
+    data->videoCounters.repeated += 1;
 }
 
-// 初始化软件重采样算法
-bool decoderInitSwResample(DecoderData* data, const AVChannelLayout* layout, enum AVSampleFormat fmt, int rate)
+static void decoderReadCounters(StreamCounters* counters, DecoderCounters* result)
 {
-    // data->layout = layout;
-    data->sampleFormat = fmt;
-    data->rate = rate;
+    result->sent = counters->sent;
+    result->received = counters->received;
+    result->dropped = counters->dropped;
+    result->late = counters->late;
+    result->skipped = counters->skipped;
+    result->repeated = counters->repeated;
+}
 
-    // 为播放的音频帧分配内存
-    data->displayAudioFrame = av_frame_alloc();
-    data->decodedAudioFrame = av_frame_alloc();
+// 视频解码计数
+void decoderVideoCounters(DecoderData* data, DecoderCounters* counters)
+{
+    decoderReadCounters(&(data->videoCounters), counters);
+}
 
-    /* 初始化音频重采样 */
-    data->swrContext = swr_alloc();
-    swr_alloc_set_opts2(
-        &(data->swrContext),
-        layout,                             // 输出声道布局
-        data->sampleFormat,                 // 输出音频数据格式
-        data->rate,                         // 输出采样率
-        &(data->audioParams->ch_layout),    // 输入声道布局
-        data->audioParams->format,          // 输入格式
-        data->audioParams->sample_rate,     // 输入采样频率
-        0,
-        NULL
-    );
+// 音频解码计数
+void decoderAudioCounters(DecoderData* data, DecoderCounters* counters)
+{
+    decoderReadCounters(&(data->audioCounters), counters);
+}
 
-    swr_init(data->swrContext);
+// 获取全部运行统计
+void decoderGetStats(DecoderData* data, DecoderStats* stats)
+{
+    for (int i = 0; i < DECODER_STAGE_COUNT; i++)
+        readStage(&(data->stages[i]), &(stats->stages[i]));
+
+    for (int i = 0; i < DECODER_GAUGE_COUNT; i++)
+        readGauge(&(data->gauges[i]), &(stats->gauges[i]));
+
+    decoderReadCounters(&(data->videoCounters), &(stats->video));
+    decoderReadCounters(&(data->audioCounters), &(stats->audio));
+    stats->underruns = data->underruns;
+    stats->silenceBytes = data->silenceBytes;
+    for (int i = 0; i < DECODER_MILESTONE_COUNT; i++)
+        stats->milestones[i] = data->milestones[i];
+
+    if (data->input != NULL)
+        statInput(data->input, &(stats->input));
+    else
+        memset(&(stats->input), 0, sizeof(InputStats));
+
+    if (data->videoPool != NULL)
+        statPool(data->videoPool, &(stats->videoPool));
+    else
+        memset(&(stats->videoPool), 0, sizeof(PoolStats));
+}
 
-    // 计算重采样输出中，一个通道的采样个数
-    data->samples = data->audioParams->frame_size * data->rate / data->audioParams->sample_rate;
+// 缩放使用的方式
+const char* decoderScalePath(DecoderData* data)
+{
+    return data->passthrough ? "passthrough" : data->scalePath;
+}
 
-    // 计算重采样输出缓存空间大小
-    data->audioBufferSize = av_samples_get_buffer_size(
-        NULL, 
-        layout->nb_channels,   // 输出声道数
-        data->samples,              // 一个通道的采样个数
-        data->sampleFormat,         // 数据格式
-        1
-    );
+// 视频解码器的名称
+const char* decoderVideoCodecName(DecoderData* data)
+{
+    return data->videoCodec != NULL ? data->videoCodec->name : "none";
+}
+
+// 视频解码器的来源
+const char* decoderVideoCodecSource(DecoderData* data)
+{
+    return data->videoCodecSource;
+}
 
-    // 创建音频数据队列
-    data->audioQueue = createQueue(data->audioBufferSize);
-    data->audioPtsQueue = createQueue(sizeof(int64_t));
-    data->audioMutex = SDL_CreateMutex();
+// 选择视频解码器用的微秒数
+int64_t decoderCalibrateTime(DecoderData* data)
+{
+    return data->calibrateUs;
+}
 
-    // 创建音频缓存
-    data->displayAudioBuffer = av_malloc(data->audioBufferSize);
+// 送给渲染线程的视频宽度
+int decoderWidth(DecoderData* data)
+{
+    return data->width;
+}
 
-    return true;
+// 送给渲染线程的视频高度
+int decoderHeight(DecoderData* data)
+{
+    return data->height;
 }
 
-// 重采样后的一个通道的采样数
-int decoderSamples(DecoderData* data)
+// 送给渲染线程的视频像素格式
+enum AVPixelFormat decoderPixelFormat(DecoderData* data)
 {
-    return data->samples;
+    return data->pixFormat;
+}
+
+// 帧级多线程带来的视频解码延迟帧数
+int decoderVideoDelay(DecoderData* data)
+{
+    return data->videoDelay;
+}
+
+// 一帧视频的时长，单位微秒
+int64_t decoderFrameDuration(DecoderData* data)
+{
+    return data->frameDuration;
 }
 
 // 视频的帧率
@@ -565,136 +1940,549 @@ double decoderFps(DecoderData* data)
     return data->videoStream->avg_frame_rate.num / (double)data->videoStream->avg_frame_rate.den;
 }
 
-// 解码
-int decoderRun(DecoderData* data)
+// 文件的时长，单位微秒
+int64_t decoderDuration(DecoderData* data)
+{
+    int64_t duration = data->formatContext->duration;
+    return duration != AV_NOPTS_VALUE ? duration : CLOCK_NONE;
+}
+
+// 定位到 pts 微秒
+void decoderSeek(DecoderData* data, int64_t pts)
 {
-    AVPacket packet;
-    const int cacheMax = 5;
+    // 新位置的第一帧显示时重新设置播放时钟，与序号一起在锁中修改，音频回调不会用旧序号的数据修正重置后的时钟
+    SDL_LockMutex(data->seekMutex);
+    data->seekRequest = pts;
+    data->serial += 1;
+    data->seekPending = true;
+    resetClock(&(data->clock));
+    SDL_UnlockMutex(data->seekMutex);
+
+    // 解封装线程可能正在等待缓冲空间
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&(data->demuxWaiting), false))
+        SDL_SemPost(data->demuxSpace);
+}
 
-    // 计算毫秒级的时间基数
-    double videoTimebase = (double)(data->videoStream->time_base.num) / data->videoStream->time_base.den * 1000;
-    double audioTimebase = (double)(data->audioStream->time_base.num) / data->audioStream->time_base.den * 1000;
-    while (1)
-    {
-        if (decoderIsEnd(data))
-            break;
+// 关键帧索引中的关键帧个数
+int decoderKeyframes(DecoderData* data)
+{
+    return data->index != NULL ? countIndex(data->index) : 0;
+}
+
+// 关键帧索引是否已经完整
+bool decoderIndexReady(DecoderData* data)
+{
+    return data->index == NULL || isIndexReady(data->index);
+}
 
-        if (decoderCountVideo(data) > cacheMax && decoderCountAudio(data) > cacheMax)
+// 解码输出的一帧交给对应的处理函数，返回 false 表示该帧被丢弃
+typedef bool (*FrameHandler)(DecoderData* data, AVFrame* frame);
+
+// 解码一个数据包: 完整处理 send/receive 状态机，取出该数据包产生的全部帧
+// packet 为 NULL 时冲刷解码器，取出解码器内部缓存的剩余帧
+// 数据包的序号过时后不再继续处理
+static void decoderDecode(DecoderData* data, AVCodecContext* context, AVFrame* frame, const PacketItem* item, StreamCounters* counters, Stage* stage, FrameHandler handle)
+{
+    const AVPacket* packet = item->packet;
+    StageTimer timer;
+    bool sent = false;
+    while (!sent && !decoderIsEnd(data) && item->serial == data->serial)
+    {
+        // 将 packet 发送给解码器解码
+        beginStage(&timer);
+        int ret = avcodec_send_packet(context, packet);
+        endStage(stage, &timer);
+        if (ret == 0)
         {
-            decoderWaitBuffer(data);
-            continue;
+            sent = true;
+            if (packet != NULL)
+                counters->sent += 1;
         }
+        else if (ret != AVERROR(EAGAIN))
+        {
+            // AVERROR_EOF 表示解码器已经冲刷过
+            if (ret != AVERROR_EOF)
+                fprintf(stderr, "avcodec_send_packet failed: %d\n", ret);
 
-        if (av_read_frame(data->formatContext, &packet) < 0)
-            break;
+            sent = true;
+        }
 
-        // 解码视频
-        do
+        // 取出当前能得到的全部帧，EAGAIN 时解码器需要更多数据，EOF 时冲刷完成
+        // 如果上面 send 返回 EAGAIN，说明解码器输出已满，取出帧后重新发送同一个 packet
+        int received = 0;
+        while (!decoderIsEnd(data) && item->serial == data->serial)
         {
-            if (packet.stream_index != data->videoIndex)
-                break;
-            
-            // 将 packet 发送给视频解码器解码
-            int ret = avcodec_send_packet(data->videoContext, &packet);
-            if (ret < 0) 
-            {
-                // EAGAIN 是当前数据不完整，需要后续的 packet 补充数据
-                if (ret != AVERROR(EAGAIN))
-                    fprintf(stderr, "avcodec_send_packet failed: %d\n", ret);
-
+            beginStage(&timer);
+            ret = avcodec_receive_frame(context, frame);
+            endStage(stage, &timer);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
                 break;
-            }
 
-            // 从解码器接收解码后的视频数据
-            ret = avcodec_receive_frame(data->videoContext, data->decodedVideoFrame);
             if (ret < 0)
             {
-                if (ret != AVERROR(EAGAIN))
-                    fprintf(stderr, "avcodec_receive_frame failed\n");
-                    
-                break;
+                fprintf(stderr, "avcodec_receive_frame failed: %d\n", ret);
+                return;
             }
 
-            // 将解码后的数据进行缩放
-            ret = sws_scale(
-                data->swsContext, 
-                (const unsigned char * const*)(data->decodedVideoFrame->data), 
-                data->decodedVideoFrame->linesize, 
-                0, 
-                data->decodedVideoFrame->height, 
-                data->displayVideoFrame->data, 
-                data->displayVideoFrame->linesize
-            );
+            received += 1;
+            counters->received += 1;
+            if (!handle(data, frame))
+                counters->dropped += 1;
+
+            av_frame_unref(frame);
+        }
+
+        // send 要求先取帧，但又取不出帧，避免死循环
+        if (!sent && received == 0)
+        {
+            fprintf(stderr, "avcodec_send_packet stalled\n");
+            return;
+        }
+    }
+}
 
-            // 将最终显示的视频数据压入队列
-            decoderPushVideo(data, data->displayVideoBuffer, data->decodedVideoFrame->pts * videoTimebase);
+// 处理一帧解码后的视频: 缩放后送给渲染线程
+static bool decoderHandleVideo(DecoderData* data, AVFrame* frame)
+{
+    // 缺失时间戳的帧紧接着上一帧显示
+    int64_t videoPts = decoderFramePts(data, frame, data->videoStream->time_base);
+    if (videoPts == CLOCK_NONE)
+        videoPts = data->nextVideoPts;
+    data->nextVideoPts = videoPts + data->frameDuration;
+
+    // 定位时从关键帧开始解码，目标位置之前的帧只用于参考，不显示
+    if (data->videoSeek.serial != data->serial || videoPts + data->frameDuration <= data->videoSeek.skipUntil)
+        return false;
 
-            // 释放 frame
-            av_frame_unref(data->decodedVideoFrame);
+    // 播放时钟已经越过这一帧的整个显示时间，渲染线程取到后也只会丢弃，不必再缩放
+    // 在机器过载、解码追赶进度时省下缩放的开销
+    int64_t clock = decoderClock(data);
+    if (clock != CLOCK_NONE && videoPts + data->frameDuration < clock)
+    {
+        data->videoCounters.late += 1;
+        return false;
+    }
 
-            if (ret <= 0)
-            {
-                fprintf(stderr, "sws_scale failed\n");
-                break;
-            }
-        } while (0);
-        
-        // 解码音频
-        do
+    AVFrame* displayVideoFrame = NULL;
+    if (data->passthrough && frame->format == data->pixFormat && frame->width == data->width && frame->height == data->height)
+    {
+        // 直通模式: 只增加解码器输出帧的引用计数，像素数据不拷贝
+        displayVideoFrame = av_frame_clone(frame);
+        if (displayVideoFrame == NULL)
         {
-            if (packet.stream_index != data->audioIndex)
-                break;
+            fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+            return false;
+        }
+    }
+    else
+    {
+        displayVideoFrame = decoderAllocVideoFrame(data);
+        if (displayVideoFrame == NULL)
+        {
+            fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+            return false;
+        }
 
-            // 将 packet 发送给音频解码器解码
-            int ret = avcodec_send_packet(data->audioContext, &packet);
-            if (ret < 0) 
-            {
-                // EAGAIN 是当前数据不完整，需要后续的 packet 补充数据
-                if (ret != AVERROR(EAGAIN))
-                    fprintf(stderr, "avcodec_send_packet failed: %d\n", ret);
+        // 将解码后的数据直接缩放到将要交给渲染线程的帧中
+        if (!decoderScale(data, frame, displayVideoFrame))
+        {
+            fprintf(stderr, "sws_scale failed\n");
+            av_frame_free(&displayVideoFrame);
+            return false;
+        }
+    }
 
-                break;
-            }
+    // 将最终显示的视频帧压入队列，队列已满时等待渲染线程取走
+    if (!decoderPushVideoWait(data, displayVideoFrame, videoPts))
+    {
+        av_frame_free(&displayVideoFrame);
+        return false;
+    }
 
-            // 从解码器接收解码后的音频数据
-            ret = avcodec_receive_frame(data->audioContext, data->decodedAudioFrame);
-            if (ret < 0)
-            {
-                if (ret != AVERROR(EAGAIN))
-                    fprintf(stderr, "avcodec_receive_frame failed\n");
-                    
-                break;
-            }
+    return true;
+}
+
+// 处理一帧解码后的音频: 重采样后送给音频回调
+static bool decoderHandleAudio(DecoderData* data, AVFrame* frame)
+{
+    // 定位后丢弃结束时间不晚于目标位置的帧，跨越目标位置的帧完整保留
+    int64_t audioPts = decoderFramePts(data, frame, data->audioStream->time_base);
+    if (data->audioSeek.serial != data->serial)
+        return false;
 
-            // 进行重采样
-            ret = swr_convert(
-                data->swrContext, 
-                &(data->displayAudioBuffer), 
-                data->audioParams->frame_size, 
-                (const uint8_t**)(data->decodedAudioFrame->data), 
-                data->decodedAudioFrame->nb_samples
-            );
+    if (audioPts != CLOCK_NONE && data->audioSeek.skipUntil != CLOCK_NONE &&
+        audioPts + av_rescale(frame->nb_samples, AV_TIME_BASE, frame->sample_rate) <= data->audioSeek.skipUntil)
+        return false;
 
-            decoderPushAudio(data, data->displayAudioBuffer, data->decodedAudioFrame->pts * audioTimebase);
+    // 输出采样数按重采样器内部缓存的采样加上这一帧计算，frame_size 可能为 0 或每帧不同
+    int outSamples = swr_get_out_samples(data->swrContext, frame->nb_samples);
+    if (outSamples > data->resampleSamples)
+    {
+        av_freep(&(data->resampleBuffer));
+        data->resampleSamples = 0;
+        if (av_samples_alloc(&(data->resampleBuffer), NULL, data->channels, outSamples, data->sampleFormat, 0) < 0)
+        {
+            fprintf(stderr, "av_samples_alloc failed\n");
+            return false;
+        }
+        data->resampleSamples = outSamples;
+    }
 
-            // 释放 frame
-            av_frame_unref(data->decodedAudioFrame);
+    StageTimer timer;
+    beginStage(&timer);
+    int ret = swr_convert(
+        data->swrContext, 
+        &(data->resampleBuffer), 
+        data->resampleSamples, 
+        (const uint8_t**)(frame->data), 
+        frame->nb_samples
+    );
+    endStage(&(data->stages[DECODER_STAGE_RESAMPLE]), &timer);
 
-            if (ret < 0)
-            {
-                if (ret != AVERROR(EAGAIN))
-                    fprintf(stderr, "swr_convert failed\n");
-                    
+    if (ret < 0)
+    {
+        fprintf(stderr, "swr_convert failed\n");
+        return false;
+    }
+
+    // 空间不足时等待音频回调取走
+    return decoderWriteAudio(data, data->resampleBuffer, (size_t)ret * data->frameBytes, audioPts);
+}
+
+// 视频解码器定位后的重置: 缺失时间戳的帧从目标位置开始推算
+static void decoderResetVideo(DecoderData* data)
+{
+    data->nextVideoPts = data->videoSeek.skipUntil;
+}
+
+// 音频解码器定位后的重置: 丢弃重采样器内部缓存的旧采样
+static void decoderResetAudio(DecoderData* data)
+{
+    swr_init(data->swrContext);
+}
+
+// 更新抖动的峰值: 新样本更大时立即跟上，否则缓慢衰减，偶发的长时间卡顿在一段时间内仍然被记住
+static int64_t decoderTrackJitter(int64_t jitter, int64_t sample)
+{
+    if (sample < 0)
+        sample = 0;
+
+    if (sample >= jitter)
+        return sample;
+
+    return jitter - (jitter - sample + JITTER_DECAY - 1) / JITTER_DECAY;
+}
+
+// 数据包的时长，单位微秒，封装格式没有给出时视频按帧率、音频按编码帧的采样数推算，都推算不出时为 0
+static int64_t decoderPacketDuration(DecoderData* data, const AVPacket* packet)
+{
+    AVStream* stream = data->formatContext->streams[packet->stream_index];
+    if (packet->duration > 0)
+        return av_rescale_q(packet->duration, stream->time_base, AV_TIME_BASE_Q);
+
+    if (packet->stream_index == data->videoIndex)
+        return data->frameDuration;
+
+    if (stream->codecpar->frame_size > 0 && stream->codecpar->sample_rate > 0)
+        return av_rescale(stream->codecpar->frame_size, AV_TIME_BASE, stream->codecpar->sample_rate);
+
+    return 0;
+}
+
+// 取出下一个当前序号的数据包，过时的直接释放；序号改变时冲刷解码器，解码结束时返回 false
+static bool decoderNextPacket(DecoderData* data, WaitQueue* packets, StreamBuffer* buffer, AVCodecContext* context, StreamSeek* seek, void (*reset)(DecoderData*), PacketItem* item)
+{
+    while (popWaitQueue(packets, item, -1))
+    {
+        // 取走的数据包不再占用缓冲，解封装线程可能正在等待缓冲空间
+        buffer->bytes -= item->packet != NULL ? item->packet->size : 0;
+        buffer->duration -= item->duration;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_exchange(&(data->demuxWaiting), false))
+            SDL_SemPost(data->demuxSpace);
+
+        if (item->serial != data->serial)
+        {
+            av_packet_free(&(item->packet));
+            continue;
+        }
+
+        if (item->serial != seek->serial)
+        {
+            // 定位后的第一个数据包: 丢弃解码器中缓存的旧帧，流结束后的解码器也要冲刷才能继续使用
+            avcodec_flush_buffers(context);
+            seek->serial = item->serial;
+            seek->skipUntil = item->start;
+            reset(data);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+// 解码线程: 依次解码数据包，直到解码结束
+// 解码一个数据包的时间超出它的时长越多，数据包队列就需要缓冲越长的时间才不会被取空
+static void decoderStreamLoop(DecoderData* data, WaitQueue* packets, StreamBuffer* buffer, AVCodecContext* context, AVFrame* frame, StreamSeek* seek, void (*reset)(DecoderData*), StreamCounters* counters, Stage* stage, FrameHandler handle)
+{
+    PacketItem item;
+    while (decoderNextPacket(data, packets, buffer, context, seek, reset, &item))
+    {
+        // packet 为 NULL 表示流结束，冲刷解码器中剩余的帧，之后继续等待定位
+        // 只有这个线程累加 stage，前后两次读数之差就是解码这个数据包的时间，不包括等待帧队列的时间
+        uint64_t decodeNs = stage->wallNs;
+        decoderDecode(data, context, frame, &item, counters, stage, handle);
+        decodeNs = stage->wallNs - decodeNs;
+        if (item.packet != NULL)
+            buffer->jitter = decoderTrackJitter(buffer->jitter, (int64_t)(decodeNs / 1000) - item.duration);
+        if (item.packet == NULL)
+            seek->done = item.serial;
+
+        av_packet_free(&(item.packet));
+    }
+}
+
+// 视频解码线程: 解码数据包、缩放后送给渲染线程
+static int decoderVideoThread(void* userdata)
+{
+    DecoderData* data = (DecoderData*)(userdata);
+    decoderStreamLoop(data, data->videoPackets, &(data->videoBuffer), data->videoContext, data->decodedVideoFrame, &(data->videoSeek), decoderResetVideo,
+        &(data->videoCounters), &(data->stages[DECODER_STAGE_VIDEO_DECODE]), decoderHandleVideo);
+    return EXIT_SUCCESS;
+}
+
+// 音频解码线程: 解码数据包、重采样后送给音频回调
+static int decoderAudioThread(void* userdata)
+{
+    DecoderData* data = (DecoderData*)(userdata);
+    decoderStreamLoop(data, data->audioPackets, &(data->audioBuffer), data->audioContext, data->decodedAudioFrame, &(data->audioSeek), decoderResetAudio,
+        &(data->audioCounters), &(data->stages[DECODER_STAGE_AUDIO_DECODE]), decoderHandleAudio);
+    return EXIT_SUCCESS;
+}
+
+// 通过关键帧索引定位到 pts 之前最近的关键帧，索引中没有时返回 false
+static bool decoderSeekKeyframe(DecoderData* data, int64_t pts)
+{
+    if (data->index == NULL)
+        return false;
+
+    AVStream* stream = data->formatContext->streams[data->videoIndex];
+    Keyframe keyframe;
+    if (!findIndex(data->index, av_rescale_q(pts + data->startTime, AV_TIME_BASE_Q, stream->time_base), &keyframe))
+        return false;
+
+    // 扫描得到的字节位置直接定位，不依赖封装格式的时间戳查找（TS 等格式没有索引，按时间戳定位要二分读取文件）
+    if (isByteIndex(data->index) && keyframe.pos >= 0)
+        return av_seek_frame(data->formatContext, data->videoIndex, keyframe.pos, AVSEEK_FLAG_BYTE) >= 0;
+
+    return av_seek_frame(data->formatContext, data->videoIndex, keyframe.ts, AVSEEK_FLAG_BACKWARD) >= 0;
+}
+
+// 执行定位请求，返回新的序号，start 为新序号的数据开始显示的位置
+static int decoderDoSeek(DecoderData* data, int64_t* start)
+{
+    SDL_LockMutex(data->seekMutex);
+    int serial = data->serial;
+    int64_t pts = data->seekRequest;
+    data->seekPending = false;
+    SDL_UnlockMutex(data->seekMutex);
+
+    StageTimer timer;
+    beginStage(&timer);
+
+    // 索引中找不到时交给 FFmpeg 定位到目标位置之前的关键帧
+    if (!decoderSeekKeyframe(data, pts))
+    {
+        int64_t ts = pts + data->startTime;
+        if (avformat_seek_file(data->formatContext, -1, INT64_MIN, ts, ts, 0) < 0)
+            fprintf(stderr, "avformat_seek_file failed: %lld\n", (long long)pts);
+    }
+
+    endStage(&(data->stages[DECODER_STAGE_SEEK]), &timer);
+    *start = pts;
+    return serial;
+}
+
+// 解码线程是否已经解码完序号为 serial 的全部数据
+static bool decoderIsDrained(DecoderData* data, int serial, bool video, bool audio)
+{
+    return (!video || data->videoSeek.done == serial) && (!audio || data->audioSeek.done == serial);
+}
+
+// 一路数据包队列的目标缓冲时长: 最短时长加上解码和解封装抖动的若干倍，不超过最长时长
+static int64_t decoderBufferTarget(DecoderData* data, StreamBuffer* buffer)
+{
+    int64_t target = buffer->min + JITTER_MARGIN * (buffer->jitter + data->demuxJitter);
+    return FFMIN(target, buffer->max);
+}
+
+// 解封装是否应当暂停，只在解封装线程调用
+// 数据包的字节数达到上限时总是暂停；否则只要有一路低于最短时长就继续读取，交错不均匀的文件也不会饿死这一路
+// 没有一路不足时，有一路超过最长时长，或者各路都达到目标时长就暂停
+static bool decoderBufferFull(DecoderData* data, bool video, bool audio)
+{
+    int64_t bytes = data->videoBuffer.bytes + data->audioBuffer.bytes;
+    setGauge(&(data->gauges[DECODER_GAUGE_PACKET_BYTES]), bytes);
+    if (bytes >= data->packetBudget)
+        return true;
+
+    StreamBuffer* buffers[2] = {&(data->videoBuffer), &(data->audioBuffer)};
+    bool active[2] = {video, audio};
+    DecoderGauge buffered[2] = {DECODER_GAUGE_VIDEO_BUFFERED, DECODER_GAUGE_AUDIO_BUFFERED};
+    DecoderGauge targets[2] = {DECODER_GAUGE_VIDEO_TARGET, DECODER_GAUGE_AUDIO_TARGET};
+    bool starving = false;
+    bool over = false;
+    bool enough = true;
+    for (int i = 0; i < 2; i++)
+    {
+        if (!active[i])
+            continue;
+
+        int64_t duration = buffers[i]->duration;
+        int64_t target = decoderBufferTarget(data, buffers[i]);
+        setGauge(&(data->gauges[buffered[i]]), duration);
+        setGauge(&(data->gauges[targets[i]]), target);
+
+        starving = starving || duration < buffers[i]->min;
+        over = over || duration >= buffers[i]->max;
+        enough = enough && duration >= target;
+    }
+
+    return !starving && (over || enough);
+}
+
+// 数据包队列的字节上限: 内存预算减去帧队列和 PCM 缓冲区占满时的大小
+static int64_t decoderPacketBudget(DecoderData* data)
+{
+    int64_t frameBytes = 0;
+    if (data->videoQueue != NULL)
+        frameBytes += (int64_t)capacityWaitQueue(data->videoQueue) * data->videoBufferSize;
+
+    if (data->audioRing != NULL)
+        frameBytes += capacityRing(data->audioRing);
+
+    return FFMAX(data->options.bufferBytes - frameBytes, MIN_PACKET_BYTES);
+}
+
+// 解封装线程: 读取数据包分发给视频、音频解码线程
+// 两路数据包队列按字节预算和各自的缓冲时长共同反压，读完文件后等待定位请求，直到解码线程处理完剩余的数据包才结束
+int decoderRun(DecoderData* data)
+{
+    atomic_fetch_add(&runningDecoders, 1);
+    SDL_Thread* videoThread = NULL;
+    SDL_Thread* audioThread = NULL;
+    if (data->videoContext != NULL)
+        videoThread = SDL_CreateThread(decoderVideoThread, "decoderVideo", data);
+
+    if (data->audioContext != NULL)
+        audioThread = SDL_CreateThread(decoderAudioThread, "decoderAudio", data);
+
+    data->packetBudget = decoderPacketBudget(data);
+    data->videoBuffer.min = data->options.videoMinBuffer;
+    data->videoBuffer.max = data->options.videoMaxBuffer;
+    data->audioBuffer.min = data->options.audioMinBuffer;
+    data->audioBuffer.max = data->options.audioMaxBuffer;
+
+    int serial = 0;
+    int64_t start = CLOCK_NONE;
+    bool eof = false;
+    while (!decoderIsEnd(data))
+    {
+        if (data->seekPending)
+        {
+            serial = decoderDoSeek(data, &start);
+            eof = false;
+            continue;
+        }
+
+        if (eof)
+        {
+            if (decoderIsDrained(data, serial, videoThread != NULL, audioThread != NULL) && !data->seekPending)
                 break;
-            } 
-            
 
-        } while (0);
+            SDL_Delay(EOF_POLL_INTERVAL);
+            continue;
+        }
+
+        if (decoderBufferFull(data, videoThread != NULL, audioThread != NULL))
+        {
+            // 先声明正在等待再检查，解码线程在两者之间取走数据包时也会唤醒这里
+            data->demuxWaiting = true;
+            atomic_thread_fence(memory_order_seq_cst);
+            if (decoderBufferFull(data, videoThread != NULL, audioThread != NULL) && !decoderIsEnd(data) && !data->seekPending)
+                SDL_SemWait(data->demuxSpace);
+            data->demuxWaiting = false;
+            continue;
+        }
+
+        AVPacket* packet = av_packet_alloc();
+        if (packet == NULL)
+        {
+            fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+            break;
+        }
+
+        StageTimer timer;
+        beginStage(&timer);
+        int ret = av_read_frame(data->formatContext, packet);
+        endStage(&(data->stages[DECODER_STAGE_DEMUX]), &timer);
+        data->demuxJitter = decoderTrackJitter(data->demuxJitter, (int64_t)((wallNs() - timer.wallNs) / 1000));
+        if (ret < 0)
+        {
+            av_packet_free(&packet);
+
+            // 通知解码线程流结束，解码线程冲刷解码器后记录完成的序号
+            PacketItem endItem = {NULL, serial, start, 0};
+            if (videoThread != NULL)
+                pushWaitQueue(data->videoPackets, &endItem, true);
+
+            if (audioThread != NULL)
+                pushWaitQueue(data->audioPackets, &endItem, true);
+
+            eof = true;
+            continue;
+        }
+
+        WaitQueue* packets = NULL;
+        StreamBuffer* buffer = NULL;
+        if (packet->stream_index == data->videoIndex && videoThread != NULL)
+        {
+            packets = data->videoPackets;
+            buffer = &(data->videoBuffer);
+        }
+        else if (packet->stream_index == data->audioIndex && audioThread != NULL)
+        {
+            packets = data->audioPackets;
+            buffer = &(data->audioBuffer);
+        }
+
+        if (packets == NULL)
+        {
+            av_packet_free(&packet);
+            continue;
+        }
 
-        // 释放 packet
-        av_packet_unref(&packet);
+        // 先计入缓冲再压入，解码线程取走时减去的一定是已经加上的
+        PacketItem item = {packet, serial, start, decoderPacketDuration(data, packet)};
+        int size = packet->size;
+        buffer->bytes += size;
+        buffer->duration += item.duration;
+
+        // 槽位满时在这里等待，不会阻塞另一路解码线程
+        if (!pushWaitQueue(packets, &item, true))
+        {
+            buffer->bytes -= size;
+            buffer->duration -= item.duration;
+            av_packet_free(&packet);
+        }
     }
-    
+
+    // 先结束，唤醒在队列上等待数据包的解码线程
     decoderSetEnd(data, true);
+    SDL_WaitThread(videoThread, NULL);
+    SDL_WaitThread(audioThread, NULL);
+    atomic_fetch_sub(&runningDecoders, 1);
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -1,45 +1,195 @@
 #ifndef FFMPEG_PLAYER_DEMO_DECODER
 #define FFMPEG_PLAYER_DEMO_DECODER
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libavformat/avformat.h>   // libavformat-dev  : AVFormatContext、AVIOContext
+#include <libavcodec/avcodec.h>     // libavcodec-dev   : AVCodec、AVCodecContext
+#include <libavutil/frame.h>        // libavutil-dev    : AVFrame、AVChannelLayout、enum AVPixelFormat、enum AVSampleFormat
+
 #include "queue.h"
+#include "pool.h"
+#include "stats.h"
+#include "clock.h"
+#include "io.h"
+#include "worker.h"
 
 typedef struct DecoderData DecoderData;
 
+// 解码计数
+typedef struct DecoderCounters
+{
+    uint64_t sent;          // 送入解码器的数据包数
+    uint64_t received;      // 解码器输出的帧数
+    uint64_t dropped;       // 解码器输出后被丢弃的帧数
+    uint64_t late;          // 其中因为已经落后于播放时钟，未经缩放就丢弃的帧数
+    uint64_t skipped;       // 渲染线程取出后因为落后而没有显示的帧数
+    uint64_t repeated;      // 下一帧没有按时到达，渲染线程重复显示上一帧的次数
+}DecoderCounters;
+
+// 一帧数据经过的处理阶段
+typedef enum DecoderStage
+{
+    DECODER_STAGE_DEMUX,            // 解封装: av_read_frame
+    DECODER_STAGE_VIDEO_DECODE,     // 视频解码: avcodec_send_packet、avcodec_receive_frame
+    DECODER_STAGE_AUDIO_DECODE,     // 音频解码: avcodec_send_packet、avcodec_receive_frame
+    DECODER_STAGE_SCALE,            // 视频缩放
+    DECODER_STAGE_RESAMPLE,         // 音频重采样
+    DECODER_STAGE_SEEK,             // 解封装定位: 查找关键帧索引、av_seek_frame
+    DECODER_STAGE_VIDEO_WAIT,       // 渲染线程在 decoderWaitVideo 中等待视频帧
+    DECODER_STAGE_UPLOAD,           // 渲染线程上传纹理，由 decoderEndStage 记录
+    DECODER_STAGE_PRESENT,          // 渲染线程复制并显示纹理，由 decoderEndStage 记录
+    DECODER_STAGE_AUDIO_CALLBACK,   // 音频回调，由 decoderEndStage 记录
+    DECODER_STAGE_COUNT,
+}DecoderStage;
+
+// 队列深度
+typedef enum DecoderGauge
+{
+    DECODER_GAUGE_VIDEO_PACKETS,    // 等待视频解码的数据包
+    DECODER_GAUGE_AUDIO_PACKETS,    // 等待音频解码的数据包
+    DECODER_GAUGE_VIDEO_FRAMES,     // 等待渲染的视频帧
+    DECODER_GAUGE_AUDIO_BYTES,      // 等待播放的 PCM 字节数
+    DECODER_GAUGE_AV_DRIFT,         // 视频帧显示时与播放时钟的偏差，单位微秒，取绝对值
+    DECODER_GAUGE_PACKET_BYTES,     // 两路数据包队列中数据包的字节数
+    DECODER_GAUGE_VIDEO_BUFFERED,   // 视频数据包队列的缓冲时长，单位微秒
+    DECODER_GAUGE_AUDIO_BUFFERED,   // 音频数据包队列的缓冲时长，单位微秒
+    DECODER_GAUGE_VIDEO_TARGET,     // 按解码抖动调整后的视频目标缓冲时长，单位微秒
+    DECODER_GAUGE_AUDIO_TARGET,     // 按解码抖动调整后的音频目标缓冲时长，单位微秒
+    DECODER_GAUGE_COUNT,
+}DecoderGauge;
+
+// 启动过程中的时间点
+typedef enum DecoderMilestone
+{
+    DECODER_MILESTONE_OPEN,         // 读完流信息: avformat_find_stream_info 返回
+    DECODER_MILESTONE_READY,        // 解码器、缩放、重采样初始化完成
+    DECODER_MILESTONE_FIRST_VIDEO,  // 第一帧视频显示，由渲染线程通过 decoderMarkMilestone 记录
+    DECODER_MILESTONE_FIRST_AUDIO,  // 音频回调第一次读到 PCM 数据
+    DECODER_MILESTONE_COUNT,
+}DecoderMilestone;
+
+// 运行统计的快照
+typedef struct DecoderStats
+{
+    StageStats stages[DECODER_STAGE_COUNT];
+    GaugeStats gauges[DECODER_GAUGE_COUNT];
+    DecoderCounters video;
+    DecoderCounters audio;
+    uint64_t underruns;         // 音频回调数据不足的次数
+    uint64_t silenceBytes;      // 音频回调因数据不足填充的静音字节数
+    int64_t milestones[DECODER_MILESTONE_COUNT];    // 从创建解码器到各时间点的微秒数，没有到达时为 -1
+    InputStats input;           // 自定义输入的读取计数，使用 FFmpeg 自己的读取方式时都为 0
+    PoolStats videoPool;        // 视频缓冲区池的命中统计，视频还没有初始化时都为 0
+}DecoderStats;
+
+// 视频软件解码的多线程方式
+typedef enum DecoderThreadType
+{
+    DECODER_THREAD_AUTO,    // 帧级和片级都启用，由 FFmpeg 按解码器能力选择
+    DECODER_THREAD_FRAME,   // 帧级多线程: 吞吐量高，但增加 thread_count - 1 帧的延迟
+    DECODER_THREAD_SLICE,   // 片级多线程: 不增加延迟，但只对多 slice 编码的视频有效
+}DecoderThreadType;
+
+// 解码器选项
+typedef struct DecoderOptions
+{
+    DecoderThreadType threadType;   // 视频解码的多线程方式
+    int threadCount;                // 视频解码线程数，0 表示按 CPU 核心数自动选择
+    int scaleThreads;               // 并行缩放的线程数，0 表示按 CPU 核心数自动选择，1 表示不并行
+    int scaleFlags;                 // 缩放算法，SWS_BICUBIC、SWS_BILINEAR、SWS_FAST_BILINEAR 等
+    bool native;                    // 原始分辨率模式: 忽略 decoderInitSwScale 的尺寸，YUV420P/NV12 不经过缩放
+    bool fastConvert;               // 格式和尺寸匹配时用 SIMD 快速路径（拷贝、NV12 解交错、2/4 倍平均缩小）代替 sws_scale
+    int64_t probeSize;              // avformat 探测流信息最多读取的字节数，0 表示使用 FFmpeg 的默认值（5 MB）
+    int64_t analyzeDuration;        // avformat 探测流信息最多分析的时长，单位微秒，0 表示使用 FFmpeg 的默认值（5 秒）
+    bool mmap;                      // 用 mmap 读取本地文件，无法映射时退回 FFmpeg 自己的读取方式
+    int64_t prefetch;               // 预读窗口的字节数，大于 0 时由单独的 IO 线程提前读取文件，0 表示不预读
+    int ioDelayMs;                  // 注入的读取延迟，单位毫秒，用于模拟卡顿的存储，0 表示不注入
+    int ioDelayEvery;               // 每隔多少次读取注入一次延迟
+    int64_t bufferBytes;            // 数据包队列和解码后的帧共用的内存预算，字节数，无论哪一路超前都不会超过
+    int64_t videoMinBuffer;         // 视频数据包队列的最短缓冲时长，单位微秒，低于它时只受内存预算限制
+    int64_t videoMaxBuffer;         // 视频数据包队列的最长缓冲时长，单位微秒，目标时长随解码抖动在两者之间调整
+    int64_t audioMinBuffer;         // 音频数据包队列的最短缓冲时长，单位微秒
+    int64_t audioMaxBuffer;         // 音频数据包队列的最长缓冲时长，单位微秒
+    const char* videoDecoder;       // 视频解码器名称，NULL 或 auto 表示按缓存或校准结果自动选择，default 表示 FFmpeg 的默认解码器
+    const char* decoderCache;       // 解码器选择的缓存文件，NULL 表示使用默认位置
+    bool recalibrate;               // 忽略缓存，重新校准并更新缓存
+    bool verbose;                   // 把每个解码器的校准结果输出到 stderr
+    bool audio;                     // 解码音频，false 时解封装器直接丢弃音频数据包
+    Workers* workers;               // 多个解码器共用的缩放线程池，不由解码器删除，NULL 表示按 scaleThreads 创建自己的线程池
+}DecoderOptions;
+
+// 默认选项
+void decoderDefaultOptions(DecoderOptions* options);
+
+// 以下几个函数按选项设置 FFmpeg，解码器和提取缩略图（thumbs.c）共用，不需要 DecoderData
+
+// 按 mmap、prefetch、ioDelayMs 创建读取文件的自定义输入，都没有设置或平台不支持时返回 NULL，使用 FFmpeg 自己的读取方式
+// 播放、索引扫描和解码器校准用同一种方式读取文件，需要在关闭使用它的 AVFormatContext 之后用 deleteInput 删除
+Input* decoderCreateInput(const char* file, const DecoderOptions* options);
+
+// 按 probeSize、analyzeDuration 打开文件并读取流信息，pb 不为 NULL 时通过它读取文件
+// 失败时输出错误并返回 false，*formatContext 为 NULL
+bool decoderOpenFormat(AVFormatContext** formatContext, const char* file, AVIOContext* pb, const DecoderOptions* options);
+
+// 按名称查找能解码 id 的解码器，name 为 NULL、auto 或 default 时返回 NULL
+// 找不到或不能解码 id 时输出警告并返回 NULL，由调用者使用 FFmpeg 的默认解码器
+const AVCodec* decoderFindNamedCodec(const char* name, enum AVCodecID id);
+
+// 按 threadCount、threadType 设置解码器上下文的多线程方式，在 avcodec_open2 之前调用
+void decoderSetThreads(AVCodecContext* context, const DecoderOptions* options);
+
 // 初始化
 DecoderData* createDecoder();
 
 // 删除 
 void deleteDecoder(DecoderData* data);
 
+// 设置选项，需要在初始化解码器之前调用
+void decoderSetOptions(DecoderData* data, const DecoderOptions* options);
+
 // 设置解码结束
 void decoderSetEnd(DecoderData* data, bool n);
 
 // 是否解码结束
 int decoderIsEnd(const DecoderData* data);
 
-// 压入一帧视频数据
-void decoderPushVideo(DecoderData* data, void* videoBuffer, int64_t pts);
+// 所有时间戳的单位都是微秒，从文件的起始时间开始计算
 
-// 弹出一帧视频数据
-void* decoderPopVideo(DecoderData* data, int64_t* pts);
+// 设置播放时钟: 当前时刻的播放位置为 pts
+void decoderSetClock(DecoderData* data, int64_t pts);
 
-// 获取视频队列缓存帧数
-int decoderCountVideo(DecoderData* data);
+// 用主时钟（音频）的参考时间修正播放时钟，返回修正前的偏差，偏差小于 jitter 时平滑修正
+// serial 为 decoderReadAudio 读取参考时间时的序号，之后发生过定位时不修正，返回 0
+int64_t decoderAdjustClock(DecoderData* data, int64_t pts, int64_t jitter, int serial);
 
-// 压入一帧音频数据
-void decoderPushAudio(DecoderData* data, void* audioBuffer, int64_t pts);
+// 当前的播放位置，还没开始播放时返回 CLOCK_NONE
+int64_t decoderClock(DecoderData* data);
 
-// 弹出一帧音频数据
-void* decoderPopAudio(DecoderData* data, int64_t* pts);
+// 记录一帧视频显示时与播放时钟的偏差，即帧的时间戳减去显示时的播放位置
+void decoderRecordDrift(DecoderData* data, int64_t drift);
 
-// 获取音频队列缓存帧数
-int decoderCountAudio(DecoderData* data);
+// 视频队列是单生产者单消费者的无锁队列: 压入只能在解码线程中，弹出只能在渲染线程中
+
+// 压入一帧视频数据，成功时帧的所有权转移给队列，队列满时返回 false
+bool decoderPushVideo(DecoderData* data, AVFrame* frame, int64_t pts);
 
-// 等待队列空间
-void decoderWaitBuffer(DecoderData* data);
+// 弹出一帧视频数据，所有权转移给调用者，使用后由 av_frame_free 释放，队列空时返回 NULL
+AVFrame* decoderPopVideo(DecoderData* data, int64_t* pts);
 
-// 通知解码器,队列有空间
-void decoderNotifyBuffer(DecoderData* data);
+// 等待并弹出一帧视频数据，最多等待 ms 毫秒，超时或解码结束时返回 NULL
+AVFrame* decoderWaitVideo(DecoderData* data, int64_t* pts, uint32_t ms);
+
+// 获取视频队列缓存帧数
+int decoderCountVideo(DecoderData* data);
+
+// 读取 len 字节重采样后的 PCM 数据，不足的部分填充静音，不加锁也不会阻塞，只能由一个线程调用
+// 返回实际读取的字节数，pts 为第一个字节的时间戳，没有读到数据时为 CLOCK_NONE，serial 为读取时的定位序号
+int decoderReadAudio(DecoderData* data, uint8_t* stream, int len, int64_t* pts, int* serial);
+
+// 获取缓存的 PCM 数据字节数
+int decoderCountAudio(DecoderData* data);
 
 // 解封装: 从 MP4、AVI 等封装格式中提取出 H.264、pcm 等音视频编码数据
 bool decoderUnpack(DecoderData* data, const char* file);
@@ -50,19 +200,107 @@ bool decoderInitVideoCodec(DecoderData* data);
 // 初始化音频解码器
 bool decoderInitAudioCodec(DecoderData* data);
 
-// 初始化软件缩放算法
+// 初始化软件缩放算法，原始分辨率模式下 width、height、fmt 只在需要转换像素格式时作为参考
 bool decoderInitSwScale(DecoderData* data, int width, int height, enum AVPixelFormat fmt);
 
 // 初始化软件重采样算法
 bool decoderInitSwResample(DecoderData* data, const AVChannelLayout* layout, enum AVSampleFormat fmt, int rate);
 
+// 初始化视频解码器和缩放算法、音频解码器和重采样算法，音频在单独的线程中与视频并行初始化
+// hasVideo、hasAudio 返回两路各自是否可用，两路都不可用时返回 false
+bool decoderInit(DecoderData* data, int width, int height, enum AVPixelFormat fmt,
+    const AVChannelLayout* layout, enum AVSampleFormat sampleFormat, int rate, bool* hasVideo, bool* hasAudio);
+
 // 重采样后的一个通道的采样数
 int decoderSamples(DecoderData* data);
 
+// 缩放后一帧视频数据的字节数
+int decoderVideoBufferSize(DecoderData* data);
+
+// 音频回调一次请求的字节数
+int decoderAudioBufferSize(DecoderData* data);
+
+// 处理阶段的名称
+const char* decoderStageName(DecoderStage stage);
+
+// 处理阶段的累计耗时，并行缩放时 CPU 时间包括所有工作线程
+void decoderStageStats(DecoderData* data, DecoderStage stage, StageStats* stats);
+
+// 结束一个由调用者计时的阶段，timer 由 beginStage 开始，可以在任意线程调用
+void decoderEndStage(DecoderData* data, DecoderStage stage, const StageTimer* timer);
+
+// 队列深度的名称
+const char* decoderGaugeName(DecoderGauge gauge);
+
+// 时间点的名称
+const char* decoderMilestoneName(DecoderMilestone milestone);
+
+// 记录到达时间点，只有第一次调用有效，可以在任意线程调用
+void decoderMarkMilestone(DecoderData* data, DecoderMilestone milestone);
+
+// 从创建解码器到时间点的微秒数，没有到达时返回 -1
+int64_t decoderMilestone(DecoderData* data, DecoderMilestone milestone);
+
+// 记录一帧因为落后而没有显示的视频
+void decoderSkipVideo(DecoderData* data);
+
+// 记录一次因为下一帧没有按时到达而重复显示上一帧
+void decoderRepeatVideo(DecoderData* data);
+
+// 获取全部运行统计，可以在任意线程调用
+void decoderGetStats(DecoderData* data, DecoderStats* stats);
+
+// 视频解码计数
+void decoderVideoCounters(DecoderData* data, DecoderCounters* counters);
+
+// 音频解码计数
+void decoderAudioCounters(DecoderData* data, DecoderCounters* counters);
+
+// 缩放使用的方式: 快速路径和指令集（例如 box2/avx2）、sws_scale 或直通模式的 passthrough
+const char* decoderScalePath(DecoderData* data);
+
+// 视频解码器的名称
+const char* decoderVideoCodecName(DecoderData* data);
+
+// 视频解码器的来源: override（命令行指定）、default、cached、remembered（本进程已经校准过）、calibrated、
+// busy（校准时有其它文件在解码，结果不写入缓存文件）或 only（只有一个可用的解码器）
+const char* decoderVideoCodecSource(DecoderData* data);
+
+// 选择视频解码器用的微秒数，校准时在第一帧之前解码第一个 GOP，计入启动时间
+int64_t decoderCalibrateTime(DecoderData* data);
+
+// 送给渲染线程的视频宽度
+int decoderWidth(DecoderData* data);
+
+// 送给渲染线程的视频高度
+int decoderHeight(DecoderData* data);
+
+// 送给渲染线程的视频像素格式: YUV420P、YUVJ420P 或 NV12
+enum AVPixelFormat decoderPixelFormat(DecoderData* data);
+
+// 帧级多线程带来的视频解码延迟帧数
+int decoderVideoDelay(DecoderData* data);
+
+// 一帧视频的时长，单位微秒，流信息中没有帧率时为 40 毫秒
+int64_t decoderFrameDuration(DecoderData* data);
+
 // 视频的帧率
 double decoderFps(DecoderData* data);
 
-// 解码器线程
+// 文件的时长，未知时返回 CLOCK_NONE
+int64_t decoderDuration(DecoderData* data);
+
+// 定位到 pts: 解封装从 pts 之前最近的关键帧开始读取，解码后丢弃 pts 之前的帧，可以在任意线程调用
+// 之前解码的视频帧和 PCM 数据都被丢弃，播放时钟被重置为 CLOCK_NONE，需要用新位置的第一帧重新设置
+void decoderSeek(DecoderData* data, int64_t pts);
+
+// 关键帧索引中的关键帧个数，后台扫描时逐渐增加
+int decoderKeyframes(DecoderData* data);
+
+// 关键帧索引是否已经完整，没有视频流时也返回 true
+bool decoderIndexReady(DecoderData* data);
+
+// 解码器线程: 负责解封装，并启动视频、音频解码线程，全部解码完成后返回
 int decoderRun(DecoderData* data);
 
 #endif // FFMPEG_PLAYER_DEMO_DECODER
\ No newline at end of file
@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+/* ffmpeg */
+#include <libavformat/avformat.h>   // libavformat-dev  : Audio-Video Foramt - 用于音视频文件封装、解封装
+#include <libavcodec/avcodec.h>     // libavcodec-dev   : Audio-Video Codec - 用于音视频数据编解码
+
+#include "index.h"
+#include "tempfile.h"
+
+// 旁路缓存文件的扩展名和文件头标识，格式改变时修改标识使旧文件失效
+#define SIDECAR_EXT     ".kfi"
+#define SIDECAR_MAGIC   "KFI1"
+
+// 旁路缓存文件头，之后是 count 个 Keyframe
+typedef struct SidecarHeader
+{
+    char magic[4];
+    int32_t streamIndex;
+    int64_t size;       // 视频文件大小
+    int64_t mtime;      // 视频文件修改时间
+    int64_t count;
+}SidecarHeader;
+
+struct KeyframeIndex
+{
+    char* file;
+    int streamIndex;
+    DecoderOptions options;     // 扫描线程打开文件用的选项
+    SDL_mutex* mutex;           // 保护 keyframes、count、capacity，扫描线程追加时与查找互斥
+    Keyframe* keyframes;        // 按时间戳递增排列
+    int count;
+    int capacity;
+    bool byteIndex;
+    SDL_Thread* scanThread;
+    atomic_bool stop;           // 要求扫描线程停止
+    atomic_bool ready;          // 扫描已经完成
+    int64_t size;
+    int64_t mtime;
+};
+
+// 追加一个关键帧，保持按时间戳递增，解码顺序下关键帧的时间戳通常已经递增，很少需要移动
+static bool appendIndex(KeyframeIndex* index, int64_t ts, int64_t pos)
+{
+    SDL_LockMutex(index->mutex);
+    if (index->count == index->capacity)
+    {
+        int capacity = index->capacity > 0 ? index->capacity * 2 : 256;
+        Keyframe* keyframes = realloc(index->keyframes, sizeof(Keyframe) * capacity);
+        if (keyframes == NULL)
+        {
+            SDL_UnlockMutex(index->mutex);
+            fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+            return false;
+        }
+
+        index->keyframes = keyframes;
+        index->capacity = capacity;
+    }
+
+    int i = index->count;
+    while (i > 0 && index->keyframes[i - 1].ts > ts)
+    {
+        index->keyframes[i] = index->keyframes[i - 1];
+        i--;
+    }
+
+    index->keyframes[i].ts = ts;
+    index->keyframes[i].pos = pos;
+    index->count += 1;
+    SDL_UnlockMutex(index->mutex);
+    return true;
+}
+
+static char* sidecarPath(const char* file)
+{
+    size_t length = strlen(file) + sizeof(SIDECAR_EXT);
+    char* path = malloc(length);
+    if (path == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    snprintf(path, length, "%s%s", file, SIDECAR_EXT);
+    return path;
+}
+
+// 读取旁路缓存文件，文件不存在或与视频文件不匹配时返回 false
+static bool loadSidecar(KeyframeIndex* index)
+{
+    char* path = sidecarPath(index->file);
+    if (path == NULL)
+        return false;
+
+    FILE* fp = fopen(path, "rb");
+    free(path);
+    if (fp == NULL)
+        return false;
+
+    SidecarHeader header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+        memcmp(header.magic, SIDECAR_MAGIC, sizeof(header.magic)) == 0 &&
+        header.streamIndex == index->streamIndex &&
+        header.size == index->size &&
+        header.mtime == index->mtime &&
+        header.count > 0 && header.count < INT32_MAX;
+
+    if (ok)
+    {
+        index->keyframes = malloc(sizeof(Keyframe) * header.count);
+        ok = index->keyframes != NULL && fread(index->keyframes, sizeof(Keyframe), header.count, fp) == (size_t)header.count;
+        if (ok)
+        {
+            index->count = header.count;
+            index->capacity = header.count;
+        }
+        else
+        {
+            free(index->keyframes);
+            index->keyframes = NULL;
+        }
+    }
+
+    fclose(fp);
+    return ok;
+}
+
+// 写入旁路缓存文件，先写临时文件再改名，其它进程不会读到写了一半的文件；目录不可写时放弃
+static void saveSidecar(KeyframeIndex* index)
+{
+    char* path = sidecarPath(index->file);
+    if (path == NULL)
+        return;
+
+    size_t length = strlen(path) + TEMP_FILE_EXTRA;
+    char* temp = malloc(length);
+    if (temp == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        free(path);
+        return;
+    }
+
+    FILE* fp = openTempFile(path, temp, length, "wb");
+    if (fp != NULL)
+    {
+        SidecarHeader header;
+        memcpy(header.magic, SIDECAR_MAGIC, sizeof(header.magic));
+        header.streamIndex = index->streamIndex;
+        header.size = index->size;
+        header.mtime = index->mtime;
+        header.count = index->count;
+
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(index->keyframes, sizeof(Keyframe), index->count, fp) == (size_t)index->count;
+        replaceFile(fp, temp, path, ok);
+    }
+
+    free(temp);
+    free(path);
+}
+
+// 后台扫描: 只解封装不解码，记录视频流所有关键帧数据包的时间戳和位置
+static int scanIndex(void* userdata)
+{
+    KeyframeIndex* index = (KeyframeIndex*)(userdata);
+    Input* input = decoderCreateInput(index->file, &(index->options));
+    AVIOContext* pb = input != NULL ? inputContext(input) : NULL;
+    AVFormatContext* formatContext = NULL;
+    if (!decoderOpenFormat(&formatContext, index->file, pb, &(index->options)))
+    {
+        fprintf(stderr, "index scan: cannot open %s\n", index->file);
+        deleteInput(input);
+        index->ready = true;
+        return EXIT_FAILURE;
+    }
+
+    if (index->streamIndex >= (int)formatContext->nb_streams)
+    {
+        fprintf(stderr, "index scan: cannot find stream %d\n", index->streamIndex);
+        avformat_close_input(&formatContext);
+        deleteInput(input);
+        index->ready = true;
+        return EXIT_FAILURE;
+    }
+
+    // 其它流的数据包直接丢弃，不解析
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+    {
+        if ((int)i != index->streamIndex)
+            formatContext->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    bool complete = packet != NULL;
+    while (packet != NULL && av_read_frame(formatContext, packet) >= 0)
+    {
+        if (index->stop)
+        {
+            complete = false;
+            av_packet_unref(packet);
+            break;
+        }
+
+        if (packet->stream_index == index->streamIndex && (packet->flags & AV_PKT_FLAG_KEY))
+        {
+            int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (ts != AV_NOPTS_VALUE && packet->pos >= 0)
+                complete = appendIndex(index, ts, packet->pos) && complete;
+        }
+        av_packet_unref(packet);
+    }
+
+    av_packet_free(&packet);
+    avformat_close_input(&formatContext);
+    deleteInput(input);
+
+    // 扫描完整才写入缓存，被中途停止的索引不完整
+    if (complete && index->count > 0)
+        saveSidecar(index);
+
+    index->ready = true;
+    return EXIT_SUCCESS;
+}
+
+KeyframeIndex* createIndex(const char* file, AVFormatContext* formatContext, int streamIndex, const DecoderOptions* options)
+{
+    KeyframeIndex* index = malloc(sizeof(KeyframeIndex));
+    if (index == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    index->file = strdup(file);
+    index->streamIndex = streamIndex;
+    index->options = *options;
+    index->mutex = SDL_CreateMutex();
+    index->keyframes = NULL;
+    index->count = 0;
+    index->capacity = 0;
+    index->byteIndex = false;
+    index->scanThread = NULL;
+    index->stop = false;
+    index->ready = true;
+    index->size = -1;
+    index->mtime = -1;
+    if (index->file == NULL || index->mutex == NULL)
+    {
+        deleteIndex(index);
+        return NULL;
+    }
+
+    // 1. 封装格式自带的索引
+    AVStream* stream = formatContext->streams[streamIndex];
+    int entries = avformat_index_get_entries_count(stream);
+    for (int i = 0; i < entries; i++)
+    {
+        const AVIndexEntry* entry = avformat_index_get_entry(stream, i);
+        if (entry != NULL && (entry->flags & AVINDEX_KEYFRAME))
+            appendIndex(index, entry->timestamp, entry->pos);
+    }
+
+    if (index->count > 0)
+        return index;
+
+    // 2. 旁路缓存文件，以文件大小和修改时间判断是否过期
+    struct stat st;
+    if (stat(file, &st) == 0)
+    {
+        index->size = st.st_size;
+        index->mtime = st.st_mtime;
+    }
+
+    index->byteIndex = !(formatContext->iformat->flags & AVFMT_NO_BYTE_SEEK);
+    if (index->size >= 0 && loadSidecar(index))
+        return index;
+
+    // 3. 后台扫描
+    index->ready = false;
+    index->scanThread = SDL_CreateThread(scanIndex, "indexScan", index);
+    if (index->scanThread == NULL)
+        index->ready = true;
+
+    return index;
+}
+
+void deleteIndex(KeyframeIndex* index)
+{
+    if (index == NULL)
+        return;
+
+    if (index->scanThread != NULL)
+    {
+        index->stop = true;
+        SDL_WaitThread(index->scanThread, NULL);
+    }
+
+    if (index->mutex != NULL)
+        SDL_DestroyMutex(index->mutex);
+
+    free(index->keyframes);
+    free(index->file);
+    free(index);
+}
+
+bool findIndex(KeyframeIndex* index, int64_t ts, Keyframe* keyframe)
+{
+    SDL_LockMutex(index->mutex);
+
+    // 二分查找最后一个时间戳不大于 ts 的关键帧
+    int low = 0;
+    int high = index->count;
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (index->keyframes[mid].ts <= ts)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    bool found = low > 0;
+    if (found)
+        *keyframe = index->keyframes[low - 1];
+
+    SDL_UnlockMutex(index->mutex);
+    return found;
+}
+
+int countIndex(KeyframeIndex* index)
+{
+    SDL_LockMutex(index->mutex);
+    int n = index->count;
+    SDL_UnlockMutex(index->mutex);
+    return n;
+}
+
+bool isByteIndex(KeyframeIndex* index)
+{
+    return index->byteIndex;
+}
+
+bool isIndexReady(KeyframeIndex* index)
+{
+    return index->ready;
+}
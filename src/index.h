@@ -0,0 +1,44 @@
+#ifndef FFMPEG_PLAYER_DEMO_INDEX
+#define FFMPEG_PLAYER_DEMO_INDEX
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libavformat/avformat.h>   // libavformat-dev  : AVFormatContext
+
+#include "decoder.h"
+
+typedef struct KeyframeIndex KeyframeIndex;
+
+// 一个关键帧: 流时间基下的时间戳和在文件中的字节位置，位置未知时为 -1
+typedef struct Keyframe
+{
+    int64_t ts;
+    int64_t pos;
+}Keyframe;
+
+// 创建视频流的关键帧索引，依次尝试:
+// 1. 封装格式自带的索引（MP4 的 stss、MKV 的 Cues）
+// 2. 与文件大小、修改时间匹配的旁路缓存文件 <file>.kfi
+// 3. 后台线程用独立的 AVFormatContext 扫描整个文件，只解封装不解码，完成后写入旁路缓存文件
+//    按 options 打开文件，与播放使用相同的读取方式（mmap、预读）和探测流信息的限制
+// formatContext 只在创建时读取，之后可以在其它线程中继续使用
+KeyframeIndex* createIndex(const char* file, AVFormatContext* formatContext, int streamIndex, const DecoderOptions* options);
+
+// 删除索引，后台扫描没有完成时先停止扫描
+void deleteIndex(KeyframeIndex* index);
+
+// 查找时间戳不大于 ts 的最后一个关键帧，没有时返回 false，可以在扫描进行中调用
+bool findIndex(KeyframeIndex* index, int64_t ts, Keyframe* keyframe);
+
+// 已知的关键帧个数
+int countIndex(KeyframeIndex* index);
+
+// 索引中的字节位置是否可以直接用于 AVSEEK_FLAG_BYTE 定位
+// 扫描得到的位置都来自数据包本身，可以；封装格式自带的索引按时间戳定位即可
+bool isByteIndex(KeyframeIndex* index);
+
+// 后台扫描是否已经完成，没有扫描时也返回 true
+bool isIndexReady(KeyframeIndex* index);
+
+#endif // FFMPEG_PLAYER_DEMO_INDEX
@@ -0,0 +1,548 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define IO_HAS_POSIX 1
+#endif
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+/* ffmpeg */
+#include <libavformat/avformat.h>   // libavformat-dev  : Audio-Video Foramt - 用于音视频文件封装、解封装
+
+#include "io.h"
+#include "ring.h"
+#include "stats.h"
+
+// 解封装器一次读取的字节数，FFmpeg 默认只有 32 KB
+#define IO_BUFFER_SIZE  (1 << 20)
+
+// 提示内核预读的窗口大小，读取位置越过半个窗口时提示下一个窗口
+#define READAHEAD_SIZE  (8 << 20)
+
+// IO 线程一次读取的字节数，预读窗口至少能容纳两次读取
+#define IO_CHUNK_SIZE   (256 << 10)
+
+struct Input
+{
+    AVIOContext* context;
+    int64_t size;
+    int64_t position;           // 解封装器下一次读取的位置，只由解封装线程读写
+
+    // mmap 输入
+    uint8_t* data;              // 映射的文件内容
+    int64_t readahead;          // 已经提示预读到的位置
+
+    // 文件输入
+    int fd;
+    int delayMs;                // 注入的读取延迟
+    int delayEvery;
+    uint64_t sourceReads;       // 实际读取文件的次数，只由读取文件的线程读写
+
+    // 预读: IO 线程写入 ring，解封装线程读出；定位时在 mutex 中丢弃窗口并通知 IO 线程换位置
+    Ring* ring;
+    uint8_t* chunk;             // IO 线程的读取缓冲区
+    SDL_Thread* thread;
+    SDL_mutex* mutex;           // 保护以下字段，IO 线程写入 ring 时也持有，保证不会写入已经作废的数据
+    SDL_cond* filled;           // IO 线程写入了数据，或读到结尾、出错
+    SDL_cond* drained;          // 解封装器取走了数据，或定位、停止
+    int64_t fileOffset;         // IO 线程下一次读取的位置
+    int generation;             // 每次丢弃窗口加一，IO 线程丢弃换位置之前读到的数据
+    bool eof;
+    int error;
+    bool stop;
+
+    _Atomic uint64_t reads;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t seeks;
+    _Atomic uint64_t syscalls;
+    _Atomic uint64_t stalls;
+    _Atomic uint64_t stallNs;
+    _Atomic uint64_t invalidations;
+};
+
+#ifdef IO_HAS_POSIX
+
+static Input* allocInput(int64_t size)
+{
+    Input* input = malloc(sizeof(Input));
+    if (input == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    input->context = NULL;
+    input->size = size;
+    input->position = 0;
+    input->data = NULL;
+    input->readahead = 0;
+    input->fd = -1;
+    input->delayMs = 0;
+    input->delayEvery = 1;
+    input->sourceReads = 0;
+    input->ring = NULL;
+    input->chunk = NULL;
+    input->thread = NULL;
+    input->mutex = NULL;
+    input->filled = NULL;
+    input->drained = NULL;
+    input->fileOffset = 0;
+    input->generation = 0;
+    input->eof = false;
+    input->error = 0;
+    input->stop = false;
+    input->reads = 0;
+    input->bytes = 0;
+    input->seeks = 0;
+    input->syscalls = 0;
+    input->stalls = 0;
+    input->stallNs = 0;
+    input->invalidations = 0;
+    return input;
+}
+
+// 创建 IO 上下文
+static bool openContext(Input* input, int (*read)(void*, uint8_t*, int), int64_t (*seek)(void*, int64_t, int))
+{
+    uint8_t* buffer = av_malloc(IO_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return false;
+    }
+
+    input->context = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, input, read, NULL, seek);
+    if (input->context == NULL)
+    {
+        fprintf(stderr, "avio_alloc_context failed\n");
+        av_free(buffer);
+        return false;
+    }
+
+    return true;
+}
+
+// 计算定位的目标位置，AVSEEK_SIZE 时返回文件大小
+static int64_t seekTarget(Input* input, int64_t offset, int whence)
+{
+    switch (whence & ~AVSEEK_FORCE)
+    {
+    case AVSEEK_SIZE:
+        return input->size;
+    case SEEK_SET:
+        return offset;
+    case SEEK_CUR:
+        return input->position + offset;
+    case SEEK_END:
+        return input->size + offset;
+    default:
+        return AVERROR(EINVAL);
+    }
+}
+
+// 提示内核预读 position 之后的一个窗口
+static void readaheadInput(Input* input, int64_t position)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    int64_t start = position - position % page;
+    int64_t end = FFMIN(start + READAHEAD_SIZE, input->size);
+    if (start >= end)
+        return;
+
+    madvise(input->data + start, end - start, MADV_WILLNEED);
+    input->syscalls += 1;
+    input->readahead = end;
+}
+
+static int readMmap(void* opaque, uint8_t* buffer, int size)
+{
+    Input* input = (Input*)(opaque);
+    int64_t n = FFMIN((int64_t)size, input->size - input->position);
+    if (n <= 0)
+        return AVERROR_EOF;
+
+    // 顺序读取时，在当前窗口读完之前提示下一个窗口，缺页时数据已经在页缓存中
+    if (input->position + n + READAHEAD_SIZE / 2 > input->readahead)
+        readaheadInput(input, input->readahead);
+
+    memcpy(buffer, input->data + input->position, n);
+    input->position += n;
+    input->reads += 1;
+    input->bytes += n;
+    return (int)n;
+}
+
+static int64_t seekMmap(void* opaque, int64_t offset, int whence)
+{
+    Input* input = (Input*)(opaque);
+    int64_t position = seekTarget(input, offset, whence);
+    if ((whence & ~AVSEEK_FORCE) == AVSEEK_SIZE)
+        return position;
+
+    if (position < 0 || position > input->size)
+        return AVERROR(EINVAL);
+
+    // 跳到已经预读的窗口之外时从新位置重新预读
+    if (position < input->position || position >= input->readahead)
+        readaheadInput(input, position);
+
+    input->position = position;
+    input->seeks += 1;
+    return position;
+}
+
+Input* createMmapInput(const char* file)
+{
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // 映射建立后文件描述符就不再需要
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "mmap failed: %s\n", file);
+        return NULL;
+    }
+
+    Input* input = allocInput(st.st_size);
+    if (input == NULL)
+    {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+
+    input->data = data;
+
+    // 整个映射按顺序访问: 内核加大预读，已经读过的页优先回收
+    madvise(input->data, input->size, MADV_SEQUENTIAL);
+    input->syscalls += 1;
+    readaheadInput(input, 0);
+
+    if (!openContext(input, readMmap, seekMmap))
+    {
+        deleteInput(input);
+        return NULL;
+    }
+
+    return input;
+}
+
+// 从文件的 offset 处读取，按选项注入延迟，返回读取的字节数，出错时返回负数
+static int64_t readSource(Input* input, int64_t offset, uint8_t* buffer, size_t size)
+{
+    input->sourceReads += 1;
+    if (input->delayMs > 0 && input->sourceReads % input->delayEvery == 0)
+        SDL_Delay(input->delayMs);
+
+    input->syscalls += 1;
+    ssize_t n = pread(input->fd, buffer, size, offset);
+    return n >= 0 ? n : AVERROR(errno);
+}
+
+// 不预读: 在解封装线程中直接读取
+static int readFile(void* opaque, uint8_t* buffer, int size)
+{
+    Input* input = (Input*)(opaque);
+    int64_t n = readSource(input, input->position, buffer, size);
+    if (n == 0)
+        return AVERROR_EOF;
+
+    if (n < 0)
+        return (int)n;
+
+    input->position += n;
+    input->reads += 1;
+    input->bytes += n;
+    return (int)n;
+}
+
+static int64_t seekFile(void* opaque, int64_t offset, int whence)
+{
+    Input* input = (Input*)(opaque);
+    int64_t position = seekTarget(input, offset, whence);
+    if ((whence & ~AVSEEK_FORCE) == AVSEEK_SIZE)
+        return position;
+
+    if (position < 0 || position > input->size)
+        return AVERROR(EINVAL);
+
+    input->position = position;
+    input->seeks += 1;
+    return position;
+}
+
+// IO 线程: 窗口有空间时从 fileOffset 读取一块，读取期间不持有锁，解封装器可以同时取数据
+static int prefetchThread(void* userdata)
+{
+    Input* input = (Input*)(userdata);
+    SDL_LockMutex(input->mutex);
+    while (!input->stop)
+    {
+        if (input->eof || input->error != 0 || freeRing(input->ring) < IO_CHUNK_SIZE)
+        {
+            SDL_CondWait(input->drained, input->mutex);
+            continue;
+        }
+
+        int generation = input->generation;
+        int64_t offset = input->fileOffset;
+        SDL_UnlockMutex(input->mutex);
+
+        int64_t n = readSource(input, offset, input->chunk, IO_CHUNK_SIZE);
+
+        SDL_LockMutex(input->mutex);
+
+        // 读取期间解封装器定位到了窗口之外，这块数据已经作废
+        if (generation != input->generation)
+            continue;
+
+        if (n > 0)
+        {
+            writeRing(input->ring, input->chunk, n);
+            input->fileOffset += n;
+        }
+        else if (n == 0)
+        {
+            input->eof = true;
+        }
+        else
+        {
+            input->error = (int)n;
+        }
+
+        SDL_CondSignal(input->filled);
+    }
+
+    SDL_UnlockMutex(input->mutex);
+    return EXIT_SUCCESS;
+}
+
+static int readPrefetch(void* opaque, uint8_t* buffer, int size)
+{
+    Input* input = (Input*)(opaque);
+
+    // 窗口为空时等待 IO 线程，这就是存储卡顿传到解封装器的时间
+    SDL_LockMutex(input->mutex);
+    if (usedRing(input->ring) == 0 && !input->eof && input->error == 0)
+    {
+        uint64_t start = wallNs();
+        while (usedRing(input->ring) == 0 && !input->eof && input->error == 0 && !input->stop)
+            SDL_CondWait(input->filled, input->mutex);
+
+        input->stalls += 1;
+        input->stallNs += wallNs() - start;
+    }
+
+    size_t n = readRing(input->ring, buffer, size);
+    int error = input->error;
+    SDL_CondSignal(input->drained);
+    SDL_UnlockMutex(input->mutex);
+
+    if (n == 0)
+        return error != 0 ? error : AVERROR_EOF;
+
+    input->position += n;
+    input->reads += 1;
+    input->bytes += n;
+    return (int)n;
+}
+
+static int64_t seekPrefetch(void* opaque, int64_t offset, int whence)
+{
+    Input* input = (Input*)(opaque);
+    int64_t position = seekTarget(input, offset, whence);
+    if ((whence & ~AVSEEK_FORCE) == AVSEEK_SIZE)
+        return position;
+
+    if (position < 0 || position > input->size)
+        return AVERROR(EINVAL);
+
+    SDL_LockMutex(input->mutex);
+    size_t used = usedRing(input->ring);
+    if (position >= input->position && position <= input->position + (int64_t)used)
+    {
+        // 目标在窗口之内，跳过中间的数据即可，MP4 等格式在数据包之间的小跳转都走这里
+        skipRing(input->ring, position - input->position);
+    }
+    else
+    {
+        // 目标在窗口之外，丢弃整个窗口，IO 线程从新位置重新读取
+        skipRing(input->ring, used);
+        input->fileOffset = position;
+        input->generation += 1;
+        input->eof = false;
+        input->error = 0;
+        input->invalidations += 1;
+    }
+
+    SDL_CondSignal(input->drained);
+    SDL_UnlockMutex(input->mutex);
+
+    input->position = position;
+    input->seeks += 1;
+    return position;
+}
+
+Input* createFileInput(const char* file, const FileInputOptions* options)
+{
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    Input* input = allocInput(st.st_size);
+    if (input == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    input->fd = fd;
+    input->delayMs = options->delayMs;
+    input->delayEvery = options->delayEvery > 0 ? options->delayEvery : 1;
+    if (options->prefetch <= 0)
+    {
+        if (!openContext(input, readFile, seekFile))
+        {
+            deleteInput(input);
+            return NULL;
+        }
+
+        return input;
+    }
+
+    // 预读窗口至少容纳两块，IO 线程读一块时解封装器还能取另一块
+    size_t window = FFMAX(options->prefetch, 2 * IO_CHUNK_SIZE);
+    if (!openContext(input, readPrefetch, seekPrefetch))
+    {
+        deleteInput(input);
+        return NULL;
+    }
+
+    input->ring = createRing(window);
+    input->chunk = malloc(IO_CHUNK_SIZE);
+    input->mutex = SDL_CreateMutex();
+    input->filled = SDL_CreateCond();
+    input->drained = SDL_CreateCond();
+    if (input->ring == NULL || input->chunk == NULL || input->mutex == NULL || input->filled == NULL || input->drained == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        deleteInput(input);
+        return NULL;
+    }
+
+    input->thread = SDL_CreateThread(prefetchThread, "ioPrefetch", input);
+    if (input->thread == NULL)
+    {
+        fprintf(stderr, "SDL_CreateThread failed\n");
+        deleteInput(input);
+        return NULL;
+    }
+
+    return input;
+}
+
+void deleteInput(Input* input)
+{
+    if (input == NULL)
+        return;
+
+    if (input->thread != NULL)
+    {
+        SDL_LockMutex(input->mutex);
+        input->stop = true;
+        SDL_CondSignal(input->drained);
+        SDL_UnlockMutex(input->mutex);
+        SDL_WaitThread(input->thread, NULL);
+    }
+
+    // IO 上下文的缓冲区可能已经被 FFmpeg 替换，释放当前的缓冲区
+    if (input->context != NULL)
+    {
+        av_freep(&(input->context->buffer));
+        avio_context_free(&(input->context));
+    }
+
+    if (input->drained != NULL)
+        SDL_DestroyCond(input->drained);
+
+    if (input->filled != NULL)
+        SDL_DestroyCond(input->filled);
+
+    if (input->mutex != NULL)
+        SDL_DestroyMutex(input->mutex);
+
+    deleteRing(input->ring);
+    free(input->chunk);
+
+    if (input->data != NULL)
+        munmap(input->data, input->size);
+
+    if (input->fd >= 0)
+        close(input->fd);
+
+    free(input);
+}
+
+#else
+
+Input* createMmapInput(const char* file)
+{
+    (void)file;
+    fprintf(stderr, "mmap input is not supported on this platform\n");
+    return NULL;
+}
+
+Input* createFileInput(const char* file, const FileInputOptions* options)
+{
+    (void)file;
+    (void)options;
+    fprintf(stderr, "file input is not supported on this platform\n");
+    return NULL;
+}
+
+void deleteInput(Input* input)
+{
+    (void)input;
+}
+
+#endif // IO_HAS_POSIX
+
+AVIOContext* inputContext(Input* input)
+{
+    return input->context;
+}
+
+void statInput(Input* input, InputStats* stats)
+{
+    stats->reads = input->reads;
+    stats->bytes = input->bytes;
+    stats->seeks = input->seeks;
+    stats->syscalls = input->syscalls;
+    stats->stalls = input->stalls;
+    stats->stallNs = input->stallNs;
+    stats->invalidations = input->invalidations;
+}
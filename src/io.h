@@ -0,0 +1,50 @@
+#ifndef FFMPEG_PLAYER_DEMO_IO
+#define FFMPEG_PLAYER_DEMO_IO
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libavformat/avio.h>       // libavformat-dev  : AVIOContext
+
+typedef struct Input Input;
+
+// 自定义输入的读取计数
+typedef struct InputStats
+{
+    uint64_t reads;         // 解封装器调用读取回调的次数
+    uint64_t bytes;         // 读取的字节数
+    uint64_t seeks;         // 定位次数
+    uint64_t syscalls;      // 读取、定位、预读提示实际进入内核的次数
+    uint64_t stalls;        // 预读缓冲区为空，解封装器等待 IO 线程的次数
+    uint64_t stallNs;       // 解封装器等待 IO 线程的累计时间
+    uint64_t invalidations; // 定位到预读窗口之外，丢弃已预读数据的次数
+}InputStats;
+
+// 普通文件输入的选项
+typedef struct FileInputOptions
+{
+    int64_t prefetch;       // 预读窗口的字节数，IO 线程提前读入这么多数据，0 表示不预读，在解封装线程中直接读取
+    int delayMs;            // 注入的读取延迟，模拟偶尔卡顿的存储，0 表示不注入
+    int delayEvery;         // 每隔多少次读取注入一次延迟
+}FileInputOptions;
+
+// 用 mmap 映射整个本地文件，解封装器直接从页缓存复制数据，不再调用 read
+// 按读取位置用 madvise 提示内核顺序预读，平台不支持或文件无法映射时返回 NULL，调用者使用 FFmpeg 自己的读取方式
+Input* createMmapInput(const char* file);
+
+// 用 pread 读取本地文件，prefetch 大于 0 时由单独的 IO 线程把读取位置之后的数据读入预读窗口
+// 解封装器从窗口中取数据，单次读取卡顿时只要窗口中还有数据就不会阻塞解封装
+// 定位到窗口之内时直接跳过中间的数据，定位到窗口之外时丢弃窗口，IO 线程从新位置重新读取
+// 平台不支持时返回 NULL
+Input* createFileInput(const char* file, const FileInputOptions* options);
+
+// 删除输入，需要先用 avformat_close_input 关闭使用它的 AVFormatContext
+void deleteInput(Input* input);
+
+// 交给 AVFormatContext->pb 的 IO 上下文，使用时 AVFormatContext 需要设置 AVFMT_FLAG_CUSTOM_IO
+AVIOContext* inputContext(Input* input);
+
+// 读取计数，可以在任意线程调用
+void statInput(Input* input, InputStats* stats);
+
+#endif // FFMPEG_PLAYER_DEMO_IO
@@ -1,5 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdatomic.h>
 
 #include <SDL2/SDL.h>               // libsdl2-dev
 
@@ -11,63 +14,219 @@
 
 #include "queue.h"
 #include "decoder.h"
+#include "bench.h"
+#include "mosaic.h"
+#include "thumbs.h"
+#include "report.h"
 
-/* 视频通常使用 16:9 的分辨率 */
+/* 窗口尺寸，视频通常使用 16:9 的分辨率，非 --native 模式下也是缩放后的视频尺寸 */
 static const int WIDTH = 1920;
 static const int HEIGHT = 1080;
 
+/* 等待视频帧的最长时间，超时后回到事件循环处理 SDL 事件 */
+static const uint32_t EVENT_INTERVAL = 10;
+
+/* 丢帧阈值的范围，单位微秒: 阈值取一帧的时长，限制在这个范围内，帧落后播放时钟超过阈值时丢弃 */
+static const int64_t SYNC_THRESHOLD_MIN = 40000;
+static const int64_t SYNC_THRESHOLD_MAX = 100000;
+
+/* 帧与播放时钟相差超过这个值时不再同步，直接显示，避免时间戳跳变时长时间等待 */
+static const int64_t NOSYNC_THRESHOLD = 10000000;
+
+/* 连续丢帧的上限，持续过载时每隔这么多帧至少显示一帧，避免画面停住 */
+static const int MAX_SKIPPED_FRAMES = 5;
+
+/* 音频回调修正播放时钟时视为抖动的偏差，单位微秒 */
+static const int64_t AUDIO_JITTER = 10000;
+
+/* --fast-open 探测流信息的上限: 读取的字节数和分析的时长（微秒），足够 MP4/MKV 读出头部和 TS 读到第一个关键帧 */
+static const int64_t FAST_PROBESIZE = 262144;
+static const int64_t FAST_ANALYZE_DURATION = 200000;
+
+/* 缩略图的默认宽度和默认输出的拼图 */
+static const int THUMB_WIDTH = 160;
+static const char* const THUMB_OUTPUT = "thumbs.ppm";
+
+/* 方向键定位的步长，单位微秒: 左右键 10 秒，上下键 1 分钟 */
+static const int64_t SEEK_STEP = 10000000;
+static const int64_t SEEK_STEP_LONG = 60000000;
+
+/* 收到 SIGUSR1 后由主循环写出运行统计 */
+static volatile sig_atomic_t dumpStats = 0;
+
 /* 音频线程数据 */
 typedef struct AudioUserData
 {
-    DecoderData* decoder;
-    int64_t startTicks;
-    bool end;
+    DecoderData* _Atomic decoder;   // 回调读取的解码器，播放列表切换时由回调自己换成 next
+    DecoderData* _Atomic next;      // 播放列表的下一项，当前项的音频读完后在同一次回调中接着读取，中间不插入静音
+    int64_t latency;                // 音频设备的延迟: 回调写入的数据要在这么多微秒后才开始播放
+    int64_t bytesPerSecond;         // 音频设备每秒播放的字节数
+    atomic_bool end;                // 音频已经播完或者没有音频设备，由回调和主线程共同读写
 }AudioUserData;
 
+/* 视频同步状态，只在渲染线程中使用 */
+typedef struct VideoSync
+{
+    int64_t duration;       // 一帧的时长
+    int64_t threshold;      // 丢帧阈值
+    int64_t lastPts;        // 最近显示的帧的时间戳，重复显示时按帧时长前移
+    int skipped;            // 连续丢弃的帧数
+}VideoSync;
+
+/* delayTo 对一帧的处理 */
+typedef enum SyncAction
+{
+    SYNC_SHOW,              // 到了显示时间，显示
+    SYNC_DROP,              // 已经落后太多，丢弃
+    SYNC_WAIT,              // 还没到显示时间，先回到事件循环，下一轮再等
+}SyncAction;
+
+/* 播放列表中的一项，第一项与创建窗口同时打开，之后的每一项在前一项播放时由后台线程打开并开始解码 */
+typedef struct OpenData
+{
+    DecoderData* decoder;
+    const char* file;
+    bool hasVideo;
+    bool hasAudio;
+    SDL_Thread* openThread;     // 打开文件的线程
+    SDL_Thread* decodeThread;   // 解码线程
+    atomic_bool opened;         // 预加载线程已经结束，ok 表示是否可以播放
+    bool ok;
+}OpenData;
+
+/* 可选的缩放算法，从快到慢 */
+typedef struct Scaler
+{
+    const char* name;
+    int flags;
+}Scaler;
+
+static const Scaler SCALERS[] = {
+    {"point",           SWS_POINT},
+    {"fast_bilinear",   SWS_FAST_BILINEAR},
+    {"bilinear",        SWS_BILINEAR},
+    {"area",            SWS_AREA},
+    {"bicubic",         SWS_BICUBIC},
+    {"spline",          SWS_SPLINE},
+    {"lanczos",         SWS_LANCZOS},
+};
+
+/* 命令行参数 */
+typedef struct Args
+{
+    const char* file;       // 第一个文件，性能测试模式只使用这个文件
+    char** files;           // 播放列表，按顺序无缝播放
+    int fileCount;
+    bool bench;
+    bool benchSeek;
+    bool benchConvert;
+    bool mosaic;
+    int thumbs;             // 提取缩略图的个数，0 表示每个关键帧一张，-1 表示不提取
+    int thumbWidth;
+    const char* thumbOutput;
+    const char* stats;
+    DecoderOptions options;
+}Args;
+
+int threadOpen(void* userdata);
+int threadPreload(void* userdata);
 int threadDecode(void* userdata);
+OpenData* createItem(const char* file, const DecoderOptions* options);
+OpenData* preloadItem(const char* file, const DecoderOptions* options);
+void deleteItem(OpenData* item);
+SDL_Texture* createVideoTexture(SDL_Renderer* renderer, SDL_Texture* texture, DecoderData* decoder);
+void resetSync(VideoSync* sync, DecoderData* decoder);
 void getAudioData(void *userdata, Uint8* stream, int len);
-bool delayTo(AudioUserData* audio, uint32_t ms);
+SyncAction delayTo(DecoderData* decoder, VideoSync* sync, int64_t pts);
+bool repeatDue(DecoderData* decoder, VideoSync* sync);
+bool seekKey(DecoderData* decoder, VideoSync* sync, SDL_Keycode key);
+void uploadFrame(SDL_Texture* texture, const AVFrame* frame);
+void usage(const char* name);
+bool parseArgs(int argc, char* argv[], Args* args);
+bool parseBufferRange(const char* value, int64_t* min, int64_t* max);
+
+void requestStats(int signum);
 
 int main(int argc, char* argv[])
 {   
     /* 参数检查 */
-    if (argc != 2)
+    Args args;
+    if (!parseArgs(argc, argv, &args))
     {
-        printf("Usage: %s <file>\n", argv[0]);
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    /* 提取缩略图 */
+    if (args.thumbs >= 0)
+        return runThumbs(args.files, args.fileCount, &args.options, args.thumbs, args.thumbWidth, args.thumbOutput);
+
+    /* 马赛克模式，与 --bench 同时使用时不显示窗口 */
+    if (args.mosaic)
+        return runMosaic(args.files, args.fileCount, &args.options, WIDTH, HEIGHT, args.bench);
+
+    /* 性能测试模式 */
+    if (args.bench)
+        return runBench(args.file, &args.options, WIDTH, HEIGHT, args.stats);
+
+    if (args.benchSeek)
+        return runSeekBench(args.file, &args.options, WIDTH, HEIGHT, args.stats);
+
+    if (args.benchConvert)
+        return runConvertBench(&args.options, WIDTH, HEIGHT);
+
+#ifdef SIGUSR1
+    if (args.stats != NULL)
+        signal(SIGUSR1, requestStats);
+#endif
+
     /* 初始化 */
     SDL_Init(SDL_INIT_EVERYTHING);
 
+    // 创建跨线程交互数据，启动时间从这里开始计算
+    OpenData* item = createItem(args.file, &args.options);
+    if (item == NULL)
+    {
+        SDL_Quit();
+        return EXIT_FAILURE;
+    }
+
+    // 打开文件、初始化解码器的同时在主线程创建窗口，窗口只能在主线程创建
+    item->openThread = SDL_CreateThread(threadOpen, "threadOpen", item);
+
     /* 创建窗口 */
     SDL_Window* window = NULL;
     SDL_Renderer* renderer = NULL;
-    if (SDL_CreateWindowAndRenderer(WIDTH, HEIGHT, SDL_WINDOW_SHOWN, &window, &renderer) < 0)
+    int ret = SDL_CreateWindowAndRenderer(WIDTH, HEIGHT, SDL_WINDOW_SHOWN, &window, &renderer);
+
+    int status = EXIT_FAILURE;
+    SDL_WaitThread(item->openThread, &status);
+    item->openThread = NULL;
+    if (ret < 0 || status != EXIT_SUCCESS || !item->hasVideo)
     {
-        fprintf(stderr, "SDL_CreateWindowAndRenderer failed\n");
+        if (ret < 0)
+            fprintf(stderr, "SDL_CreateWindowAndRenderer failed\n");
+
+        deleteItem(item);
+        SDL_Quit();
         return EXIT_FAILURE;
     }
 
-    // 创建纹理
-    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_TARGET|SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
-    
-    // 创建跨线程交互数据
-    DecoderData* data = createDecoder();
-    decoderUnpack(data, argv[1]);
-    decoderInitVideoCodec(data);
-    decoderInitSwScale(data, WIDTH, HEIGHT, AV_PIX_FMT_YUV420P);
-    decoderInitAudioCodec(data);
-    AVChannelLayout layout = AV_CHANNEL_LAYOUT_STEREO;
-    decoderInitSwResample(data, &layout, AV_SAMPLE_FMT_FLT, 44100);
-    av_channel_layout_uninit(&layout);
+    // 创建纹理，尺寸和格式与解码器输出一致，由渲染器缩放到窗口大小
+    DecoderData* data = item->decoder;
+    SDL_Texture* texture = createVideoTexture(renderer, NULL, data);
 
     AudioUserData audio;
-    audio.decoder = data;
-    audio.end = false;
-    audio.startTicks = 0;
+    atomic_init(&(audio.decoder), data);
+    atomic_init(&(audio.next), NULL);
+    audio.latency = 0;
+    audio.bytesPerSecond = 0;
+    atomic_init(&(audio.end), false);
+
+    VideoSync sync;
+    resetSync(&sync, data);
 
-    /* 打开音频设备 */
+    /* 打开音频设备，播放列表的每一项都输出相同的格式，整个播放过程只打开一次 */
     SDL_AudioSpec audioSpec;
     audioSpec.channels = 2;             // stereo
     audioSpec.format = AUDIO_F32;       // 32bit 小端浮点数
@@ -77,20 +236,37 @@ int main(int argc, char* argv[])
 
     audioSpec.userdata = &audio;
     audioSpec.callback = getAudioData;
-    SDL_AudioDeviceID audioDeviceId = SDL_OpenAudioDevice(NULL, 0, &audioSpec, NULL, 0);
+    SDL_AudioSpec obtainedSpec;
+    SDL_AudioDeviceID audioDeviceId = SDL_OpenAudioDevice(NULL, 0, &audioSpec, &obtainedSpec, 0);
     if (audioDeviceId <= 0)
     {
         printf("cannot open audio device\n");
-        audio.end = true;
+        atomic_store(&(audio.end), true);
+    }
+    else
+    {
+        // 回调填充的缓冲区要等设备中正在播放的一个缓冲区播完才开始播放
+        audio.latency = (int64_t)obtainedSpec.samples * 1000000 / obtainedSpec.freq;
+        audio.bytesPerSecond = (int64_t)obtainedSpec.freq * obtainedSpec.channels * SDL_AUDIO_BITSIZE(obtainedSpec.format) / 8;
     }
 
     /* 创建线程进行解码 */
-    SDL_Thread* thread = SDL_CreateThread(threadDecode, "threadDecode", data);
+    item->decodeThread = SDL_CreateThread(threadDecode, "threadDecode", data);
 
     /* 开始播放音频 */
     SDL_PauseAudioDevice(audioDeviceId, 0);
 
+    // 播放列表的下一项，当前项显示出第一帧后才开始预加载，不与当前项的启动争抢 CPU
+    OpenData* next = NULL;
+    int nextIndex = 1;
+    bool shown = false;         // 当前项已经显示过画面
+    bool handedOver = false;    // 下一项已经交给音频回调
+
     SDL_Event event;
+    StageTimer timer;
+    DecoderStats stats;
+    AVFrame* frame = NULL;      // 已经取出但还没到显示时间的帧
+    int64_t pts = 0;
     bool running = true;
     while (running)
     {
@@ -99,41 +275,120 @@ int main(int argc, char* argv[])
         {
             if (event.type == SDL_QUIT)
             {
-                decoderNotifyBuffer(data);
                 decoderSetEnd(data, true);
-                audio.end = true;
+                atomic_store(&(audio.end), true);
                 running = false;
                 break;
             }
+
+            // 定位之前取出的帧不再显示
+            if (event.type == SDL_KEYDOWN && seekKey(data, &sync, event.key.keysym.sym))
+                av_frame_free(&frame);
         }
 
-        int64_t pts = 0;
-        void* videoBuffer = decoderPopVideo(data, &pts); // TODO: 这里没有消息同步，一直读，导致CPU占用高
-        if (videoBuffer != NULL)
+        if (dumpStats)
+        {
+            dumpStats = 0;
+            decoderGetStats(data, &stats);
+            writeStats(args.stats, &stats);
+        }
+
+        if (next == NULL && nextIndex < args.fileCount && (shown || decoderIsEnd(data)))
+            next = preloadItem(args.files[nextIndex++], &args.options);
+
+        // 打不开的项直接跳过
+        if (next != NULL && atomic_load(&(next->opened)) && !next->ok)
+        {
+            fprintf(stderr, "skip %s\n", next->file);
+            deleteItem(next);
+            next = NULL;
+            continue;
+        }
+
+        // 下一项准备好后交给音频回调；当前项没有音频时等视频播完再交，避免下一项的声音提前响起
+        if (next != NULL && !handedOver && atomic_load(&(next->opened)) && (item->hasAudio || decoderIsEnd(data)))
+        {
+            atomic_store(&(audio.next), next->decoder);
+            handedOver = true;
+        }
+
+        // 阻塞等待解码线程送来新帧，没有新帧时线程休眠，不再空转
+        if (frame == NULL)
+            frame = decoderWaitVideo(data, &pts, EVENT_INTERVAL);
+
+        if (frame != NULL)
         {
-            decoderNotifyBuffer(data);
-            
-            // 如果进度落后就跳过当前
-            if (delayTo(&audio, pts))
+            // 等到帧的显示时间，落后太多就跳过当前帧，还没到时间的帧留到下一轮
+            SyncAction action = delayTo(data, &sync, pts);
+            if (action == SYNC_SHOW)
             {
-                SDL_UpdateTexture(texture, NULL, videoBuffer, WIDTH);
+                beginStage(&timer);
+                uploadFrame(texture, frame);
+                decoderEndStage(data, DECODER_STAGE_UPLOAD, &timer);
+
+                beginStage(&timer);
                 SDL_RenderCopy(renderer, texture, NULL, NULL);
                 SDL_RenderPresent(renderer);
+                decoderEndStage(data, DECODER_STAGE_PRESENT, &timer);
+                decoderRecordDrift(data, pts - decoderClock(data));
+                decoderMarkMilestone(data, DECODER_MILESTONE_FIRST_VIDEO);
+                shown = true;
+                av_frame_free(&frame);
+            }
+            else if (action == SYNC_DROP)
+            {
+                decoderSkipVideo(data);
+                av_frame_free(&frame);
             }
-            
-            free(videoBuffer);
         }
-        else if(decoderIsEnd(data) && audio.end)
+        else if (decoderIsEnd(data) && handedOver && (audioDeviceId <= 0 || atomic_load(&(audio.decoder)) == next->decoder))
+        {
+            // 当前项的视频已经播完，音频回调也已经切换到下一项（或者没有音频设备），视频跟着切换
+            // 窗口、渲染器、纹理和音频设备继续使用，下一项已经打开并解码好了开头的帧
+            atomic_store(&(audio.decoder), next->decoder);
+            deleteItem(item);
+            item = next;
+            data = item->decoder;
+            next = NULL;
+            shown = false;
+            handedOver = false;
+
+            texture = createVideoTexture(renderer, texture, data);
+            resetSync(&sync, data);
+        }
+        else if(decoderIsEnd(data))
+        {
+            if (atomic_load(&(audio.end)) && next == NULL && nextIndex >= args.fileCount)
+                break;
+
+            // 视频已播放完，休眠等待音频播放结束、下一项准备好或 SDL 事件
+            SDL_WaitEventTimeout(NULL, EVENT_INTERVAL);
+        }
+        else if (repeatDue(data, &sync))
         {
-            break;
+            // 解码跟不上时下一帧没有按时到达，重复显示上一帧，保持画面按帧率刷新
+            SDL_RenderCopy(renderer, texture, NULL, NULL);
+            SDL_RenderPresent(renderer);
+            decoderRepeatVideo(data);
         }
     }
 
-    SDL_WaitThread(thread, NULL);       // 等待解码线程退出
+    av_frame_free(&frame);
+
+    // 先关闭音频设备，回调不再访问任何一项
     SDL_PauseAudioDevice(audioDeviceId, 1);
     SDL_CloseAudioDevice(audioDeviceId);
-    
-    deleteDecoder(data);
+
+    if (args.stats != NULL)
+    {
+        decoderGetStats(data, &stats);
+        writeStats(args.stats, &stats);
+    }
+
+    // 等待解码线程和预加载线程退出
+    if (next != NULL)
+        deleteItem(next);
+    deleteItem(item);
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -142,20 +397,495 @@ int main(int argc, char* argv[])
     return EXIT_SUCCESS;
 }
 
-bool delayTo(AudioUserData* audio, uint32_t ms)
+void usage(const char* name)
+{
+    DecoderOptions options;
+    decoderDefaultOptions(&options);
+
+    printf("Usage: %s [options] <file> [<file>...]\n", name);
+    printf("       %s [options] --bench-convert\n", name);
+    printf("Several files play back to back as a playlist: the next file is opened and starts decoding\n");
+    printf("in the background while the current one plays, so switching has no open delay or audio gap.\n");
+    printf("--bench and --bench-seek use the first file only.\n");
+    printf("Options:\n");
+    printf("  --threads <n>           video decode threads, 0 means one per CPU core (default 0)\n");
+    printf("  --thread-type <type>    video decode threading: auto, frame or slice (default auto)\n");
+    printf("                          frame threading adds (threads - 1) frames of decode latency\n");
+    printf("  --bench                 decode headless as fast as possible and report throughput\n");
+    printf("  --bench-seek            seek headless to random positions and report seek latency\n");
+    printf("  --bench-convert         compare the SIMD fast conversion paths with sws_scale on synthetic frames, no file needed\n");
+    printf("  --mosaic                play all files at once in a grid in one window, sharing one scaling pool and\n");
+    printf("                          splitting decode threads across the cores; with --bench runs headless\n");
+    printf("                          and prints throughput and per-tile drop rates\n");
+    printf("  --thumbs <n>            extract n evenly spaced thumbnails per file headless, decoding only the keyframe\n");
+    printf("                          before each position, 0 means one per keyframe; prints thumbnails per second\n");
+    printf("  --thumb-width <px>      thumbnail width, the height follows the display aspect ratio (default %d)\n", THUMB_WIDTH);
+    printf("  --thumb-out <path>      a .ppm contact sheet, or an existing directory for one PPM per thumbnail (default %s)\n", THUMB_OUTPUT);
+    printf("  --stats <file>          write stage latency histograms, queue depths and drop counters at exit\n");
+    printf("                          and on SIGUSR1, as CSV if the file ends in .csv, otherwise JSON\n");
+    printf("  --fast-open             bound stream probing to start playback sooner (probesize %lld, analyzeduration %lld us)\n",
+        (long long)FAST_PROBESIZE, (long long)FAST_ANALYZE_DURATION);
+    printf("  --probesize <bytes>     maximum bytes read while probing stream info (default FFmpeg's 5000000)\n");
+    printf("  --analyzeduration <us>  maximum microseconds analyzed while probing stream info (default FFmpeg's 5000000)\n");
+    printf("  --mmap                  read local files through mmap with sequential readahead hints\n");
+    printf("  --prefetch <MB>         read the file ahead on a separate IO thread into a window of this size\n");
+    printf("  --io-delay <ms>         inject this read latency to simulate slow storage (default every read)\n");
+    printf("  --io-delay-every <n>    inject the --io-delay latency on every n-th read only\n");
+    printf("  --buffer <MB>           memory budget for queued packets and decoded frames, a hard ceiling (default %lld)\n",
+        (long long)(options.bufferBytes / 1024 / 1024));
+    printf("  --video-buffer <min,max>  video packet buffering in ms, the target adapts to decode jitter (default %lld,%lld)\n",
+        (long long)(options.videoMinBuffer / 1000), (long long)(options.videoMaxBuffer / 1000));
+    printf("  --audio-buffer <min,max>  audio packet buffering in ms (default %lld,%lld)\n",
+        (long long)(options.audioMinBuffer / 1000), (long long)(options.audioMaxBuffer / 1000));
+    printf("  --native                decode at the source size and upload YUV420P/NV12 planes without sws_scale\n");
+    printf("  --no-fast-convert       always scale with sws_scale, even when a SIMD fast path (copy, nv12, box2, box4) matches\n");
+    printf("  --decoder <name>        video decoder to use, auto calibrates on the first GOP and caches the fastest,\n");
+    printf("                          default uses FFmpeg's default decoder (default auto)\n");
+    printf("  --recalibrate           ignore the cached decoder choice, calibrate again and update the cache\n");
+    printf("  --verbose               print the per-decoder calibration results to stderr (implied by --bench)\n");
+    printf("  --scale-threads <n>     parallel scaling threads, 0 means one per CPU core, 1 disables (default 0)\n");
+    printf("  --scaler <name>         scaling algorithm, fastest first:");
+    for (size_t i = 0; i < sizeof(SCALERS) / sizeof(SCALERS[0]); i++)
+        printf(" %s", SCALERS[i].name);
+    printf(" (default bicubic)\n");
+}
+
+bool parseArgs(int argc, char* argv[], Args* args)
+{
+    args->file = NULL;
+    args->files = NULL;
+    args->fileCount = 0;
+    args->bench = false;
+    args->benchSeek = false;
+    args->benchConvert = false;
+    args->mosaic = false;
+    args->thumbs = -1;
+    args->thumbWidth = THUMB_WIDTH;
+    args->thumbOutput = THUMB_OUTPUT;
+    args->stats = NULL;
+    decoderDefaultOptions(&(args->options));
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--threads") == 0 && value != NULL)
+        {
+            args->options.threadCount = atoi(value);
+            if (args->options.threadCount < 0)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--thread-type") == 0 && value != NULL)
+        {
+            if (strcmp(value, "auto") == 0)
+                args->options.threadType = DECODER_THREAD_AUTO;
+            else if (strcmp(value, "frame") == 0)
+                args->options.threadType = DECODER_THREAD_FRAME;
+            else if (strcmp(value, "slice") == 0)
+                args->options.threadType = DECODER_THREAD_SLICE;
+            else
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--bench") == 0)
+        {
+            args->bench = true;
+            args->options.verbose = true;
+        }
+        else if (strcmp(arg, "--bench-seek") == 0)
+        {
+            args->benchSeek = true;
+        }
+        else if (strcmp(arg, "--bench-convert") == 0)
+        {
+            args->benchConvert = true;
+        }
+        else if (strcmp(arg, "--mosaic") == 0)
+        {
+            args->mosaic = true;
+        }
+        else if (strcmp(arg, "--thumbs") == 0 && value != NULL)
+        {
+            args->thumbs = atoi(value);
+            if (args->thumbs < 0)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--thumb-width") == 0 && value != NULL)
+        {
+            args->thumbWidth = atoi(value);
+            if (args->thumbWidth < 2)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--thumb-out") == 0 && value != NULL)
+        {
+            args->thumbOutput = value;
+            i++;
+        }
+        else if (strcmp(arg, "--stats") == 0 && value != NULL)
+        {
+            args->stats = value;
+            i++;
+        }
+        else if (strcmp(arg, "--fast-open") == 0)
+        {
+            args->options.probeSize = FAST_PROBESIZE;
+            args->options.analyzeDuration = FAST_ANALYZE_DURATION;
+        }
+        else if (strcmp(arg, "--probesize") == 0 && value != NULL)
+        {
+            args->options.probeSize = atoll(value);
+            if (args->options.probeSize < 32)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--analyzeduration") == 0 && value != NULL)
+        {
+            args->options.analyzeDuration = atoll(value);
+            if (args->options.analyzeDuration <= 0)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--mmap") == 0)
+        {
+            args->options.mmap = true;
+        }
+        else if (strcmp(arg, "--prefetch") == 0 && value != NULL)
+        {
+            args->options.prefetch = atoll(value) * 1024 * 1024;
+            if (args->options.prefetch <= 0)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--io-delay") == 0 && value != NULL)
+        {
+            args->options.ioDelayMs = atoi(value);
+            if (args->options.ioDelayMs < 0)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--io-delay-every") == 0 && value != NULL)
+        {
+            args->options.ioDelayEvery = atoi(value);
+            if (args->options.ioDelayEvery <= 0)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--buffer") == 0 && value != NULL)
+        {
+            args->options.bufferBytes = atoll(value) * 1024 * 1024;
+            if (args->options.bufferBytes <= 0)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--video-buffer") == 0 && value != NULL)
+        {
+            if (!parseBufferRange(value, &(args->options.videoMinBuffer), &(args->options.videoMaxBuffer)))
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--audio-buffer") == 0 && value != NULL)
+        {
+            if (!parseBufferRange(value, &(args->options.audioMinBuffer), &(args->options.audioMaxBuffer)))
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--native") == 0)
+        {
+            args->options.native = true;
+        }
+        else if (strcmp(arg, "--no-fast-convert") == 0)
+        {
+            args->options.fastConvert = false;
+        }
+        else if (strcmp(arg, "--decoder") == 0 && value != NULL)
+        {
+            args->options.videoDecoder = value;
+            i++;
+        }
+        else if (strcmp(arg, "--recalibrate") == 0)
+        {
+            args->options.recalibrate = true;
+        }
+        else if (strcmp(arg, "--verbose") == 0)
+        {
+            args->options.verbose = true;
+        }
+        else if (strcmp(arg, "--scale-threads") == 0 && value != NULL)
+        {
+            args->options.scaleThreads = atoi(value);
+            if (args->options.scaleThreads < 0)
+                return false;
+            i++;
+        }
+        else if (strcmp(arg, "--scaler") == 0 && value != NULL)
+        {
+            size_t n = sizeof(SCALERS) / sizeof(SCALERS[0]);
+            size_t k = 0;
+            while (k < n && strcmp(value, SCALERS[k].name) != 0)
+                k++;
+
+            if (k == n)
+                return false;
+
+            args->options.scaleFlags = SCALERS[k].flags;
+            i++;
+        }
+        else if (arg[0] == '-')
+        {
+            return false;
+        }
+        else
+        {
+            // 文件按顺序移到 argv 的开头，写入的位置不会超过正在读取的位置
+            argv[1 + args->fileCount] = argv[i];
+            args->fileCount += 1;
+        }
+    }
+
+    args->files = argv + 1;
+    args->file = args->fileCount > 0 ? args->files[0] : NULL;
+    return args->file != NULL || args->benchConvert;
+}
+
+// 解析 "最短,最长" 毫秒数，转换为微秒
+bool parseBufferRange(const char* value, int64_t* min, int64_t* max)
+{
+    long long minMs = 0;
+    long long maxMs = 0;
+    if (sscanf(value, "%lld,%lld", &minMs, &maxMs) != 2 || minMs <= 0 || maxMs < minMs)
+        return false;
+
+    *min = minMs * 1000;
+    *max = maxMs * 1000;
+    return true;
+}
+
+void requestStats(int signum)
+{
+    (void)signum;
+    dumpStats = 1;
+}
+
+// 等待到帧的显示时间，每次最多等待 EVENT_INTERVAL 毫秒，还没到时间时返回 SYNC_WAIT，由调用者先处理事件再来等待
+// 时间戳跳变到 NOSYNC_THRESHOLD 以内时也不会长时间不响应退出和定位
+SyncAction delayTo(DecoderData* decoder, VideoSync* sync, int64_t pts)
+{
+    int64_t clock = decoderClock(decoder);
+    if (clock == CLOCK_NONE)
+    {
+        // 音频还没开始播放时以第一帧为起点，之后由音频回调修正
+        decoderSetClock(decoder, pts);
+        clock = pts;
+    }
+
+    int64_t diff = pts - clock;
+    if (diff < -sync->threshold && diff > -NOSYNC_THRESHOLD && sync->skipped < MAX_SKIPPED_FRAMES)
+    {
+        sync->skipped += 1;
+        return SYNC_DROP;
+    }
+
+    if (diff > 0 && diff < NOSYNC_THRESHOLD)
+    {
+        int64_t wait = diff < (int64_t)EVENT_INTERVAL * 1000 ? diff : (int64_t)EVENT_INTERVAL * 1000;
+        SDL_Delay((Uint32)((wait + 500) / 1000));
+        if (wait < diff)
+            return SYNC_WAIT;
+    }
+
+    sync->skipped = 0;
+    sync->lastPts = pts;
+    return SYNC_SHOW;
+}
+
+// 上一帧的显示时间已过而下一帧还没到，每过一帧的时长返回一次 true
+bool repeatDue(DecoderData* decoder, VideoSync* sync)
+{
+    int64_t clock = decoderClock(decoder);
+    if (clock == CLOCK_NONE || sync->lastPts == CLOCK_NONE)
+        return false;
+
+    if (clock < sync->lastPts + 2 * sync->duration)
+        return false;
+
+    sync->lastPts += sync->duration;
+    return true;
+}
+
+// 方向键定位: 左右键前后 10 秒，上下键前后 1 分钟，从当前显示的帧开始计算，返回是否定位
+bool seekKey(DecoderData* decoder, VideoSync* sync, SDL_Keycode key)
 {
-    if (audio->startTicks == 0)
+    int64_t step = 0;
+    switch (key)
     {
-        audio->startTicks = SDL_GetTicks();
+    case SDLK_LEFT:
+        step = -SEEK_STEP;
+        break;
+    case SDLK_RIGHT:
+        step = SEEK_STEP;
+        break;
+    case SDLK_DOWN:
+        step = -SEEK_STEP_LONG;
+        break;
+    case SDLK_UP:
+        step = SEEK_STEP_LONG;
+        break;
+    default:
+        return false;
     }
 
-    if (audio->startTicks + ms > SDL_GetTicks())
+    int64_t pts = sync->lastPts != CLOCK_NONE ? sync->lastPts + step : step;
+    int64_t duration = decoderDuration(decoder);
+    if (duration != CLOCK_NONE && pts > duration)
+        pts = duration;
+    if (pts < 0)
+        pts = 0;
+
+    decoderSeek(decoder, pts);
+
+    // 新位置的第一帧重新设置播放时钟
+    sync->lastPts = CLOCK_NONE;
+    sync->skipped = 0;
+    return true;
+}
+
+// 直接从解码线程送来的帧上传到纹理，按帧自身的行宽读取，不经过中间缓冲区
+void uploadFrame(SDL_Texture* texture, const AVFrame* frame)
+{
+    if (frame->format == AV_PIX_FMT_NV12)
+    {
+        SDL_UpdateNVTexture(
+            texture, NULL,
+            frame->data[0], frame->linesize[0],
+            frame->data[1], frame->linesize[1]
+        );
+    }
+    else
+    {
+        SDL_UpdateYUVTexture(
+            texture, NULL,
+            frame->data[0], frame->linesize[0],
+            frame->data[1], frame->linesize[1],
+            frame->data[2], frame->linesize[2]
+        );
+    }
+}
+
+// 打开文件并并行初始化音视频解码器
+int threadOpen(void* userdata)
+{
+    OpenData* openData = (OpenData*)(userdata);
+    if (!decoderUnpack(openData->decoder, openData->file))
+        return EXIT_FAILURE;
+
+    AVChannelLayout layout = AV_CHANNEL_LAYOUT_STEREO;
+    bool ok = decoderInit(openData->decoder, WIDTH, HEIGHT, AV_PIX_FMT_YUV420P, &layout, AV_SAMPLE_FMT_FLT, 44100, &(openData->hasVideo), &(openData->hasAudio));
+    av_channel_layout_uninit(&layout);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// 在后台打开播放列表的下一项并开始解码，切换到这一项时不再有打开文件和探测流信息的延迟，开头的帧也已经解码好
+int threadPreload(void* userdata)
+{
+    OpenData* item = (OpenData*)(userdata);
+    item->ok = threadOpen(item) == EXIT_SUCCESS && item->hasVideo;
+    if (item->ok)
+        item->decodeThread = SDL_CreateThread(threadDecode, "threadDecode", item->decoder);
+
+    atomic_store(&(item->opened), true);
+    return item->ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// 创建播放列表的一项，还没有打开文件
+OpenData* createItem(const char* file, const DecoderOptions* options)
+{
+    OpenData* item = (OpenData*)malloc(sizeof(OpenData));
+    if (item == NULL)
     {
-        SDL_Delay(audio->startTicks + ms - SDL_GetTicks());
-        return true;
+        fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
     }
 
-    return false;
+    item->decoder = createDecoder();
+    if (item->decoder == NULL)
+    {
+        free(item);
+        return NULL;
+    }
+
+    decoderSetOptions(item->decoder, options);
+    item->file = file;
+    item->hasVideo = false;
+    item->hasAudio = false;
+    item->openThread = NULL;
+    item->decodeThread = NULL;
+    atomic_init(&(item->opened), false);
+    item->ok = false;
+    return item;
+}
+
+// 创建播放列表的一项并在后台预加载
+OpenData* preloadItem(const char* file, const DecoderOptions* options)
+{
+    OpenData* item = createItem(file, options);
+    if (item == NULL)
+        return NULL;
+
+    item->openThread = SDL_CreateThread(threadPreload, "threadPreload", item);
+    if (item->openThread == NULL)
+    {
+        fprintf(stderr, "SDL_CreateThread failed: %s\n", SDL_GetError());
+        deleteItem(item);
+        return NULL;
+    }
+
+    return item;
+}
+
+// 结束解码，等待预加载线程和解码线程退出后删除
+void deleteItem(OpenData* item)
+{
+    decoderSetEnd(item->decoder, true);
+    if (item->openThread != NULL)
+        SDL_WaitThread(item->openThread, NULL);
+    if (item->decodeThread != NULL)
+        SDL_WaitThread(item->decodeThread, NULL);
+
+    deleteDecoder(item->decoder);
+    free(item);
+}
+
+// 创建与解码器输出的尺寸和格式一致的纹理，已有的纹理一致时继续使用
+SDL_Texture* createVideoTexture(SDL_Renderer* renderer, SDL_Texture* texture, DecoderData* decoder)
+{
+    Uint32 format = decoderPixelFormat(decoder) == AV_PIX_FMT_NV12 ? SDL_PIXELFORMAT_NV12 : SDL_PIXELFORMAT_IYUV;
+    int width = decoderWidth(decoder);
+    int height = decoderHeight(decoder);
+    if (texture != NULL)
+    {
+        Uint32 oldFormat = 0;
+        int oldWidth = 0;
+        int oldHeight = 0;
+        SDL_QueryTexture(texture, &oldFormat, NULL, &oldWidth, &oldHeight);
+        if (oldFormat == format && oldWidth == width && oldHeight == height)
+            return texture;
+
+        SDL_DestroyTexture(texture);
+    }
+
+    return SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_TARGET|SDL_TEXTUREACCESS_STREAMING, width, height);
+}
+
+// 按解码器的帧率重置视频同步状态
+void resetSync(VideoSync* sync, DecoderData* decoder)
+{
+    sync->duration = decoderFrameDuration(decoder);
+    sync->threshold = sync->duration < SYNC_THRESHOLD_MIN ? SYNC_THRESHOLD_MIN : sync->duration > SYNC_THRESHOLD_MAX ? SYNC_THRESHOLD_MAX : sync->duration;
+    sync->lastPts = CLOCK_NONE;
+    sync->skipped = 0;
 }
 
 int threadDecode(void* userdata)
@@ -167,23 +897,36 @@ int threadDecode(void* userdata)
 void getAudioData(void *userdata, Uint8* stream, int len)
 {
     AudioUserData* data = (AudioUserData*)(userdata);
-    DecoderData* decoder = data->decoder;
+    DecoderData* decoder = atomic_load(&(data->decoder));
+    StageTimer timer;
+    beginStage(&timer);
+
+    // 无论有多少数据都填满 len 字节，数据不足时补静音，不加锁也不会阻塞
     int64_t pts;
-    void* audioBuffer = decoderPopAudio(decoder, &pts);
-    if (audioBuffer != NULL)
-    {
-        data->startTicks = SDL_GetTicks() - pts;
-        SDL_memcpy(stream, audioBuffer, len);
-        free(audioBuffer);
-        decoderNotifyBuffer(decoder);
-    }
-    else if (decoderIsEnd(decoder))
+    int serial;
+    int n = decoderReadAudio(decoder, stream, len, &pts, &serial);
+    if (pts != CLOCK_NONE)
+        decoderAdjustClock(decoder, pts - data->latency, AUDIO_JITTER, serial);
+
+    // 当前项的音频已经读完，缓冲区剩下的部分接着从播放列表的下一项读取，两项之间不留静音
+    // 切换之后不再访问当前项，主线程看到 decoder 改变后就可以删除它
+    DecoderData* next = NULL;
+    if (n < len && decoderIsEnd(decoder) && (next = atomic_exchange(&(data->next), NULL)) != NULL)
     {
-        data->end = true;
+        atomic_store(&(data->decoder), next);
+        decoder = next;
+        atomic_store(&(data->end), false);
+
+        // 下一项的第一个采样在 n 字节之后才播放
+        int64_t offset = data->bytesPerSecond > 0 ? (int64_t)n * 1000000 / data->bytesPerSecond : 0;
+        n += decoderReadAudio(decoder, stream + n, len - n, &pts, &serial);
+        if (pts != CLOCK_NONE)
+            decoderAdjustClock(decoder, pts - data->latency - offset, AUDIO_JITTER, serial);
     }
-    else
+    else if (n == 0 && decoderIsEnd(decoder))
     {
-        // 清除开始时的噪音
-        memset(stream, 0, len);
+        atomic_store(&(data->end), true);
     }
+
+    decoderEndStage(decoder, DECODER_STAGE_AUDIO_CALLBACK, &timer);
 }
\ No newline at end of file
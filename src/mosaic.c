@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+/* ffmpeg */
+#include <libavformat/avformat.h>   // libavformat-dev  : Audio-Video Foramt - 用于音视频文件封装、解封装
+#include <libavcodec/avcodec.h>     // libavcodec-dev   : Audio-Video Codec - 用于音视频数据编解码
+
+#include "mosaic.h"
+#include "worker.h"
+
+/* 刷新周期的范围，单位微秒: 取所有格子中最短的帧时长，限制在 120 Hz 到 10 Hz 之间 */
+static const int64_t REFRESH_MIN = 8333;
+static const int64_t REFRESH_MAX = 100000;
+
+/* 帧超前播放时钟超过这个值时认为时间戳跳变，直接把时钟设置到这一帧 */
+static const int64_t NOSYNC_THRESHOLD = 10000000;
+
+/* 网格中的一格 */
+typedef struct MosaicTile
+{
+    DecoderData* decoder;
+    const char* file;
+    SDL_Rect rect;              // 在纹理中的区域
+    bool opened;                // 打开失败的格子保持黑色，不解码也不输出统计
+    bool hasVideo;
+    bool hasAudio;
+    SDL_Thread* thread;         // 打开文件的线程，之后是解码线程
+    AVFrame* pending;           // 已经取出但还没到显示时间的帧
+    int64_t pendingPts;
+    uint64_t shown;             // 显示的帧数
+}MosaicTile;
+
+static int openTile(void* userdata)
+{
+    MosaicTile* tile = (MosaicTile*)(userdata);
+    if (!decoderUnpack(tile->decoder, tile->file))
+        return EXIT_FAILURE;
+
+    AVChannelLayout layout = AV_CHANNEL_LAYOUT_STEREO;
+    bool ok = decoderInit(tile->decoder, tile->rect.w, tile->rect.h, AV_PIX_FMT_YUV420P, &layout, AV_SAMPLE_FMT_FLT, 44100, &(tile->hasVideo), &(tile->hasAudio));
+    av_channel_layout_uninit(&layout);
+    return ok && tile->hasVideo ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int decodeTile(void* userdata)
+{
+    MosaicTile* tile = (MosaicTile*)(userdata);
+    return decoderRun(tile->decoder);
+}
+
+// 取出到显示时间的最新一帧，更早的帧已经过时，计为渲染线程丢帧；没有到显示时间的帧时返回 NULL
+static AVFrame* takeTileFrame(MosaicTile* tile)
+{
+    AVFrame* show = NULL;
+    while (true)
+    {
+        if (tile->pending == NULL)
+        {
+            tile->pending = decoderWaitVideo(tile->decoder, &(tile->pendingPts), 0);
+            if (tile->pending == NULL)
+                break;
+        }
+
+        // 每一格以自己的第一帧为起点
+        int64_t clock = decoderClock(tile->decoder);
+        if (clock == CLOCK_NONE || tile->pendingPts - clock > NOSYNC_THRESHOLD)
+        {
+            decoderSetClock(tile->decoder, tile->pendingPts);
+            clock = tile->pendingPts;
+        }
+
+        if (tile->pendingPts > clock)
+            break;
+
+        if (show != NULL)
+        {
+            av_frame_free(&show);
+            decoderSkipVideo(tile->decoder);
+        }
+
+        show = tile->pending;
+        tile->pending = NULL;
+    }
+
+    return show;
+}
+
+// 把纹理填成黑色，格子没有铺满窗口时剩下的区域保持黑色
+static void clearTexture(SDL_Texture* texture, int width, int height)
+{
+    uint8_t* luma = malloc((size_t)width * height);
+    uint8_t* chroma = malloc((size_t)width * height / 4);
+    if (luma == NULL || chroma == NULL)
+    {
+        fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+        free(luma);
+        free(chroma);
+        return;
+    }
+
+    memset(luma, 16, (size_t)width * height);
+    memset(chroma, 128, (size_t)width * height / 4);
+    SDL_UpdateYUVTexture(texture, NULL, luma, width, chroma, width / 2, chroma, width / 2);
+    free(luma);
+    free(chroma);
+}
+
+// 输出总吞吐量和每一格的丢帧率
+static void printMosaic(MosaicTile* tiles, int count, int cores, uint64_t presents, double seconds)
+{
+    uint64_t decoded = 0;
+    uint64_t shown = 0;
+    printf("cores:          %d\n", cores);
+    for (int i = 0; i < count; i++)
+    {
+        if (!tiles[i].opened)
+            continue;
+
+        DecoderCounters counters;
+        decoderVideoCounters(tiles[i].decoder, &counters);
+        uint64_t dropped = counters.dropped + counters.skipped;
+        printf("tile %-2d         %s: decoded %llu, shown %llu, dropped %llu (%.1f%%)\n", i, tiles[i].file,
+            (unsigned long long)counters.received, (unsigned long long)tiles[i].shown, (unsigned long long)dropped,
+            counters.received > 0 ? 100.0 * dropped / counters.received : 0);
+        decoded += counters.received;
+        shown += tiles[i].shown;
+    }
+
+    printf("wall time:      %.3f s\n", seconds);
+    printf("decoded fps:    %.1f\n", seconds > 0 ? decoded / seconds : 0);
+    printf("shown fps:      %.1f\n", seconds > 0 ? shown / seconds : 0);
+    printf("present fps:    %.1f\n", seconds > 0 ? presents / seconds : 0);
+}
+
+int runMosaic(char** files, int count, const DecoderOptions* options, int width, int height, bool headless)
+{
+    if (headless)
+    {
+        // 使用 dummy 驱动，没有显示器的机器上也可以运行
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    }
+    SDL_Init(SDL_INIT_EVERYTHING);
+
+    // 网格尽量接近正方形，格子的宽高取偶数，YUV420P 的色度平面宽高减半
+    int cols = (int)ceil(sqrt(count));
+    int rows = (count + cols - 1) / cols;
+    int tileWidth = (width / cols) & ~1;
+    int tileHeight = (height / rows) & ~1;
+
+    // 所有解码器共用一个缩放线程池，各格的缩放同时提交、交错执行；视频解码线程数按核心数平分，避免 N 套线程互相争抢
+    int cores = SDL_GetCPUCount();
+    Workers* workers = createWorkers(options->scaleThreads);
+    MosaicTile* tiles = calloc(count, sizeof(MosaicTile));
+    if (workers == NULL || tiles == NULL)
+    {
+        fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+        if (workers != NULL)
+            deleteWorkers(workers);
+        free(tiles);
+        SDL_Quit();
+        return EXIT_FAILURE;
+    }
+
+    DecoderOptions tileOptions = *options;
+    tileOptions.audio = false;
+    tileOptions.native = false;
+    tileOptions.workers = workers;
+    tileOptions.bufferBytes = options->bufferBytes / count;
+    if (tileOptions.threadCount == 0)
+        tileOptions.threadCount = cores > count ? cores / count : 1;
+
+    // 并行打开所有文件
+    for (int i = 0; i < count; i++)
+    {
+        tiles[i].decoder = createDecoder();
+        tiles[i].file = files[i];
+        tiles[i].rect.x = i % cols * tileWidth;
+        tiles[i].rect.y = i / cols * tileHeight;
+        tiles[i].rect.w = tileWidth;
+        tiles[i].rect.h = tileHeight;
+
+        // 分配失败的格子和打开失败的一样保持黑色
+        if (tiles[i].decoder == NULL)
+            continue;
+
+        decoderSetOptions(tiles[i].decoder, &tileOptions);
+        tiles[i].thread = SDL_CreateThread(openTile, "threadOpen", &(tiles[i]));
+    }
+
+    /* 创建窗口 */
+    SDL_Window* window = NULL;
+    SDL_Renderer* renderer = NULL;
+    int ret = SDL_CreateWindowAndRenderer(width, height, SDL_WINDOW_SHOWN, &window, &renderer);
+    SDL_Texture* texture = ret < 0 ? NULL : SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, width, height);
+
+    if (ret < 0)
+        fprintf(stderr, "SDL_CreateWindowAndRenderer failed\n");
+
+    // 打开失败的文件只留下一个黑色的格子，全部失败时才退出
+    int opened = 0;
+    int64_t refresh = REFRESH_MAX;
+    for (int i = 0; i < count; i++)
+    {
+        int status = EXIT_FAILURE;
+        SDL_WaitThread(tiles[i].thread, &status);
+        tiles[i].thread = NULL;
+        tiles[i].opened = status == EXIT_SUCCESS;
+        if (!tiles[i].opened)
+        {
+            fprintf(stderr, "cannot play %s\n", tiles[i].file);
+            continue;
+        }
+
+        opened += 1;
+        int64_t duration = decoderFrameDuration(tiles[i].decoder);
+        if (duration > 0 && duration < refresh)
+            refresh = duration;
+    }
+    refresh = refresh < REFRESH_MIN ? REFRESH_MIN : refresh;
+
+    bool ok = texture != NULL && opened > 0;
+    if (opened == 0)
+        fprintf(stderr, "no file can be played\n");
+
+    uint64_t presents = 0;
+    uint64_t startNs = wallNs();
+    if (ok)
+    {
+        clearTexture(texture, width, height);
+        for (int i = 0; i < count; i++)
+        {
+            if (tiles[i].opened)
+                tiles[i].thread = SDL_CreateThread(decodeTile, "threadDecode", &(tiles[i]));
+        }
+
+        // 每个刷新周期取出每一格到显示时间的最新一帧，上传到纹理中对应的区域，全部上传后只显示一次
+        SDL_Event event;
+        uint64_t nextNs = wallNs();
+        bool running = true;
+        while (running)
+        {
+            while (SDL_PollEvent(&event) > 0)
+            {
+                if (event.type == SDL_QUIT)
+                    running = false;
+            }
+
+            bool updated = false;
+            bool ended = true;
+            for (int i = 0; i < count; i++)
+            {
+                MosaicTile* tile = &(tiles[i]);
+                if (!tile->opened)
+                    continue;
+
+                AVFrame* frame = takeTileFrame(tile);
+                if (frame != NULL)
+                {
+                    StageTimer timer;
+                    beginStage(&timer);
+                    SDL_UpdateYUVTexture(
+                        texture, &(tile->rect),
+                        frame->data[0], frame->linesize[0],
+                        frame->data[1], frame->linesize[1],
+                        frame->data[2], frame->linesize[2]
+                    );
+                    decoderEndStage(tile->decoder, DECODER_STAGE_UPLOAD, &timer);
+                    decoderMarkMilestone(tile->decoder, DECODER_MILESTONE_FIRST_VIDEO);
+                    av_frame_free(&frame);
+                    tile->shown += 1;
+                    updated = true;
+                }
+
+                if (tile->pending != NULL || !decoderIsEnd(tile->decoder))
+                    ended = false;
+            }
+
+            if (updated)
+            {
+                SDL_RenderCopy(renderer, texture, NULL, NULL);
+                SDL_RenderPresent(renderer);
+                presents += 1;
+            }
+
+            if (ended)
+                break;
+
+            // 按固定的刷新周期显示，处理慢了不补，从当前时刻重新计时
+            nextNs += (uint64_t)refresh * 1000;
+            uint64_t now = wallNs();
+            if (nextNs > now)
+                SDL_Delay((Uint32)((nextNs - now + 500000) / 1000000));
+            else
+                nextNs = now;
+        }
+    }
+
+    double seconds = (wallNs() - startNs) / 1e9;
+    for (int i = 0; i < count; i++)
+    {
+        if (tiles[i].decoder != NULL)
+            decoderSetEnd(tiles[i].decoder, true);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        SDL_WaitThread(tiles[i].thread, NULL);
+        av_frame_free(&(tiles[i].pending));
+    }
+
+    if (ok)
+        printMosaic(tiles, count, cores, presents, seconds);
+
+    // 解码器删除后才能删除共用的线程池
+    for (int i = 0; i < count; i++)
+        deleteDecoder(tiles[i].decoder);
+    deleteWorkers(workers);
+    free(tiles);
+
+    if (texture != NULL)
+        SDL_DestroyTexture(texture);
+    if (renderer != NULL)
+        SDL_DestroyRenderer(renderer);
+    if (window != NULL)
+        SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,15 @@
+#ifndef FFMPEG_PLAYER_DEMO_MOSAIC
+#define FFMPEG_PLAYER_DEMO_MOSAIC
+
+#include <stdbool.h>
+
+#include "decoder.h"
+
+// 马赛克模式: 在一个 width x height 的窗口中同时播放 count 个文件，每个文件占网格中的一格，不播放声音
+// 所有解码器共用一个按 CPU 核心数创建的缩放线程池，视频解码线程数按核心数平分（--threads 指定时按指定的值）
+// 每一格的帧直接缩放到格子的尺寸，按各自的时间戳上传到同一个纹理中对应的区域，每个刷新周期只显示一次
+// headless 为 true 时使用 dummy 驱动，没有显示器也可以运行；结束后输出总吞吐量和每一格的丢帧率
+// 打开失败的文件所在的格子保持黑色，不计入统计，所有文件都打开失败时返回 EXIT_FAILURE
+int runMosaic(char** files, int count, const DecoderOptions* options, int width, int height, bool headless);
+
+#endif // FFMPEG_PLAYER_DEMO_MOSAIC
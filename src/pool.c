@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+#include <libavutil/mem.h>          // libavutil-dev : av_malloc 按 SIMD 指令要求对齐
+
+#include "pool.h"
+
+typedef struct Pool{
+    SDL_mutex* mutex;
+    size_t itemSize;
+    void** items;       // 池拥有的全部缓冲区
+    void** free;        // 空闲缓冲区栈，容量与 items 相同，归还时不需要扩容
+    size_t count;       // 缓冲区总数
+    size_t freeCount;   // 空闲缓冲区数
+    size_t hits;
+    size_t misses;
+}Pool;
+
+Pool* createPool(size_t itemSize, size_t count)
+{
+    Pool* pool = malloc(sizeof(Pool));
+    if (pool == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    pool->mutex = SDL_CreateMutex();
+    pool->itemSize = itemSize;
+    pool->items = malloc(sizeof(void*) * count);
+    pool->free = malloc(sizeof(void*) * count);
+    pool->count = 0;
+    pool->freeCount = 0;
+    pool->hits = 0;
+    pool->misses = 0;
+    if (pool->items == NULL || pool->free == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        deletePool(pool);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        void* item = av_malloc(itemSize);
+        if (item == NULL)
+        {
+            fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+            deletePool(pool);
+            return NULL;
+        }
+
+        pool->items[pool->count++] = item;
+        pool->free[pool->freeCount++] = item;
+    }
+
+    return pool;
+}
+
+void deletePool(Pool* pool)
+{
+    if (pool == NULL)
+        return;
+
+    for (size_t i = 0; i < pool->count; i++)
+        av_free(pool->items[i]);
+
+    if (pool->items != NULL)
+        free(pool->items);
+
+    if (pool->free != NULL)
+        free(pool->free);
+
+    if (pool->mutex != NULL)
+        SDL_DestroyMutex(pool->mutex);
+
+    free(pool);
+}
+
+void* acquirePool(Pool* pool)
+{
+    void* item = NULL;
+    SDL_LockMutex(pool->mutex);
+    if (pool->freeCount > 0)
+    {
+        item = pool->free[--pool->freeCount];
+        pool->hits += 1;
+        SDL_UnlockMutex(pool->mutex);
+        return item;
+    }
+
+    // 未命中: 扩容两个数组后新分配一个缓冲区，只发生在生产者线程
+    void** items = realloc(pool->items, sizeof(void*) * (pool->count + 1));
+    if (items != NULL)
+        pool->items = items;
+
+    void** freeItems = realloc(pool->free, sizeof(void*) * (pool->count + 1));
+    if (freeItems != NULL)
+        pool->free = freeItems;
+
+    if (items != NULL && freeItems != NULL)
+        item = av_malloc(pool->itemSize);
+
+    if (item != NULL)
+    {
+        pool->items[pool->count++] = item;
+        pool->misses += 1;
+    }
+    else
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+    }
+    SDL_UnlockMutex(pool->mutex);
+    return item;
+}
+
+void releasePool(Pool* pool, void* item)
+{
+    if (pool == NULL || item == NULL)
+        return;
+
+    SDL_LockMutex(pool->mutex);
+    pool->free[pool->freeCount++] = item;
+    SDL_UnlockMutex(pool->mutex);
+}
+
+size_t itemSizePool(Pool* pool)
+{
+    return pool->itemSize;
+}
+
+void statPool(Pool* pool, PoolStats* stats)
+{
+    SDL_LockMutex(pool->mutex);
+    stats->hits = pool->hits;
+    stats->misses = pool->misses;
+    stats->count = pool->count;
+    SDL_UnlockMutex(pool->mutex);
+}
@@ -0,0 +1,30 @@
+#ifndef FFMPEG_PLAYER_DEMO_POOL
+#define FFMPEG_PLAYER_DEMO_POOL
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct Pool Pool;
+
+typedef struct PoolStats
+{
+    size_t hits;        // 直接从池中取得空闲缓冲区的次数
+    size_t misses;      // 池中没有空闲缓冲区，需要新分配的次数
+    size_t count;       // 池拥有的缓冲区总数
+}PoolStats;
+
+// 创建缓冲区池，预先分配 count 个 itemSize 大小的 SIMD 对齐缓冲区
+Pool* createPool(size_t itemSize, size_t count);
+void deletePool(Pool* pool);
+
+// 取出一个空闲缓冲区，池为空时新分配一个并交给池管理
+void* acquirePool(Pool* pool);
+
+// 归还缓冲区，不会释放内存
+// 池内部用互斥锁保护，不能在音频回调等实时线程中调用；池只管理视频帧，只在解码、渲染线程中取出和归还
+void releasePool(Pool* pool, void* item);
+
+size_t itemSizePool(Pool* pool);
+void statPool(Pool* pool, PoolStats* stats);
+
+#endif // FFMPEG_PLAYER_DEMO_POOL
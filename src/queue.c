@@ -1,15 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "queue.h"
 
+// 读写位置是只增不减的累计元素数，二者之差就是元素个数
+// 写入位置只由生产者修改，读取位置只由消费者修改，
+// 修改时使用 release，读取对方的位置时使用 acquire，保证看到位置时元素已经拷贝完成
 typedef struct Queue{
-    void* data;
+    char* data;
     size_t itemSize;
-    size_t count;
+    size_t capacity;
+    _Atomic size_t head;    // 累计弹出的元素数
+    _Atomic size_t tail;    // 累计压入的元素数
 }Queue;
-
-Queue* createQueue(size_t itemSize)
+Queue* createQueue(size_t itemSize, size_t capacity)
 {
     Queue* queue = malloc(sizeof(Queue));
     if (queue == NULL)
@@ -18,9 +23,18 @@ Queue* createQueue(size_t itemSize)
         return NULL;
     }
 
-    queue->data = NULL;
+    queue->data = malloc(itemSize * capacity);
+    if (queue->data == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        free(queue);
+        return NULL;
+    }
+
     queue->itemSize = itemSize;
-    queue->count = 0;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->tail = 0;
     return queue;
 }
 
@@ -39,35 +53,40 @@ bool pushQueue(Queue* queue, const void* item)
 {
     if (queue == NULL || item == NULL)
         return false;
-    
-    void* data = realloc(queue->data, queue->itemSize * (queue->count + 1));
-    if (data == NULL)
-    {
-        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+
+    size_t tail = atomic_load_explicit(&(queue->tail), memory_order_relaxed);
+    size_t head = atomic_load_explicit(&(queue->head), memory_order_acquire);
+    if (tail - head == queue->capacity)
         return false;
-    }
 
-    queue->data = data;
-    memcpy(data + queue->itemSize * queue->count, item, queue->itemSize);
-    queue->count += 1;
+    memcpy(queue->data + queue->itemSize * (tail % queue->capacity), item, queue->itemSize);
+    atomic_store_explicit(&(queue->tail), tail + 1, memory_order_release);
     return true;
 }
 
-void* popQueue(Queue* queue)
+bool popQueue(Queue* queue, void* item)
 {
-    if (queue == NULL || queue->data == NULL)
-        return NULL;
+    if (queue == NULL || item == NULL)
+        return false;
 
-    void* item = malloc(queue->itemSize);
-    memcpy(item, queue->data, queue->itemSize);
-    memcpy(queue->data, queue->data + queue->itemSize, queue->itemSize * (queue->count - 1));
-    queue->data = realloc(queue->data, queue->itemSize * (queue->count - 1));
-    queue->count -= 1;
+    size_t head = atomic_load_explicit(&(queue->head), memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&(queue->tail), memory_order_acquire);
+    if (tail == head)
+        return false;
 
-    return item;
+    memcpy(item, queue->data + queue->itemSize * (head % queue->capacity), queue->itemSize);
+    atomic_store_explicit(&(queue->head), head + 1, memory_order_release);
+    return true;
 }
 
 int countQueue(Queue* queue)
 {
-    return queue->count;
-}
\ No newline at end of file
+    size_t head = atomic_load_explicit(&(queue->head), memory_order_acquire);
+    size_t tail = atomic_load_explicit(&(queue->tail), memory_order_acquire);
+    return tail - head;
+}
+
+int capacityQueue(Queue* queue)
+{
+    return queue->capacity;
+}
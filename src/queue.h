@@ -6,10 +6,19 @@
 
 typedef struct Queue Queue;
 
-Queue* createQueue(size_t itemSize);
+// 创建定长环形队列，capacity 个 itemSize 大小的槽位一次性分配
+// 单生产者单消费者无锁: 同一时刻只能有一个线程压入、一个线程弹出，两边都不需要加锁
+Queue* createQueue(size_t itemSize, size_t capacity);
 void deleteQueue(Queue* queue);
+
+// 队列满时返回 false，不会扩容
 bool pushQueue(Queue* queue, const void* item);
-void* popQueue(Queue* queue);
+
+// 将队首元素拷贝到调用者提供的 item 中，队列空时返回 false
+bool popQueue(Queue* queue, void* item);
+
+// 另一端可能同时在修改，返回值只是某一时刻的快照
 int countQueue(Queue* queue);
+int capacityQueue(Queue* queue);
 
-#endif // FFMPEG_PLAYER_DEMO_QUEUQ
\ No newline at end of file
+#endif // FFMPEG_PLAYER_DEMO_QUEUQ
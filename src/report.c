@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+/* ffmpeg */
+#include <libavformat/avformat.h>   // libavformat-dev  : Audio-Video Foramt - 用于音视频文件封装、解封装
+#include <libavcodec/avcodec.h>     // libavcodec-dev   : Audio-Video Codec - 用于音视频数据编解码
+
+#include "report.h"
+#include "tempfile.h"
+
+static bool isCsv(const char* file)
+{
+    const char* ext = strrchr(file, '.');
+    return ext != NULL && strcmp(ext, ".csv") == 0;
+}
+
+static void writeCountersJson(FILE* fp, const char* name, const DecoderCounters* counters)
+{
+    fprintf(fp, "  \"%s\": {\"sent\": %llu, \"received\": %llu, \"dropped\": %llu, \"late\": %llu, \"skipped\": %llu, \"repeated\": %llu}",
+        name,
+        (unsigned long long)counters->sent,
+        (unsigned long long)counters->received,
+        (unsigned long long)counters->dropped,
+        (unsigned long long)counters->late,
+        (unsigned long long)counters->skipped,
+        (unsigned long long)counters->repeated
+    );
+}
+
+// {"stages": {名称: {...}}, "gauges": {名称: {...}}, "video": {...}, "audio": {...}, "audio_output": {...}, "startup_us": {...}, "input": {...}, "video_pool": {...}}
+// histogram_us 的第 i 项是耗时不超过 2^i 微秒（且超过上一个桶的上限）的次数
+static void writeJson(FILE* fp, const DecoderStats* stats)
+{
+    fprintf(fp, "{\n  \"stages\": {\n");
+    for (int i = 0; i < DECODER_STAGE_COUNT; i++)
+    {
+        const StageStats* stage = &(stats->stages[i]);
+        fprintf(fp, "    \"%s\": {\"count\": %llu, \"wall_ns\": %llu, \"cpu_ns\": %llu, \"max_ns\": %llu, \"p50_us\": %llu, \"p99_us\": %llu, \"histogram_us\": [",
+            decoderStageName(i),
+            (unsigned long long)stage->count,
+            (unsigned long long)stage->wallNs,
+            (unsigned long long)stage->cpuNs,
+            (unsigned long long)stage->maxNs,
+            (unsigned long long)stagePercentileUs(stage, 50),
+            (unsigned long long)stagePercentileUs(stage, 99)
+        );
+        for (int k = 0; k < STAGE_BUCKETS; k++)
+            fprintf(fp, k > 0 ? ", %llu" : "%llu", (unsigned long long)stage->buckets[k]);
+        fprintf(fp, "]}%s\n", i + 1 < DECODER_STAGE_COUNT ? "," : "");
+    }
+
+    fprintf(fp, "  },\n  \"gauges\": {\n");
+    for (int i = 0; i < DECODER_GAUGE_COUNT; i++)
+    {
+        fprintf(fp, "    \"%s\": {\"value\": %lld, \"max\": %lld}%s\n",
+            decoderGaugeName(i),
+            (long long)stats->gauges[i].value,
+            (long long)stats->gauges[i].max,
+            i + 1 < DECODER_GAUGE_COUNT ? "," : ""
+        );
+    }
+
+    fprintf(fp, "  },\n");
+    writeCountersJson(fp, "video", &(stats->video));
+    fprintf(fp, ",\n");
+    writeCountersJson(fp, "audio", &(stats->audio));
+    fprintf(fp, ",\n  \"audio_output\": {\"underruns\": %llu, \"silence_bytes\": %llu},\n",
+        (unsigned long long)stats->underruns,
+        (unsigned long long)stats->silenceBytes
+    );
+
+    // 从创建解码器到各时间点的微秒数，没有到达时为 -1
+    fprintf(fp, "  \"startup_us\": {");
+    for (int i = 0; i < DECODER_MILESTONE_COUNT; i++)
+        fprintf(fp, "%s\"%s\": %lld", i > 0 ? ", " : "", decoderMilestoneName(i), (long long)stats->milestones[i]);
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "  \"input\": {\"reads\": %llu, \"bytes\": %llu, \"seeks\": %llu, \"syscalls\": %llu, \"stalls\": %llu, \"stall_ns\": %llu, \"invalidations\": %llu},\n",
+        (unsigned long long)stats->input.reads,
+        (unsigned long long)stats->input.bytes,
+        (unsigned long long)stats->input.seeks,
+        (unsigned long long)stats->input.syscalls,
+        (unsigned long long)stats->input.stalls,
+        (unsigned long long)stats->input.stallNs,
+        (unsigned long long)stats->input.invalidations
+    );
+
+    fprintf(fp, "  \"video_pool\": {\"hits\": %llu, \"misses\": %llu, \"count\": %llu}\n}\n",
+        (unsigned long long)stats->videoPool.hits,
+        (unsigned long long)stats->videoPool.misses,
+        (unsigned long long)stats->videoPool.count
+    );
+}
+
+static void writeCountersCsv(FILE* fp, const char* name, const DecoderCounters* counters)
+{
+    fprintf(fp, "counter,%s,sent,%llu\n", name, (unsigned long long)counters->sent);
+    fprintf(fp, "counter,%s,received,%llu\n", name, (unsigned long long)counters->received);
+    fprintf(fp, "counter,%s,dropped,%llu\n", name, (unsigned long long)counters->dropped);
+    fprintf(fp, "counter,%s,late,%llu\n", name, (unsigned long long)counters->late);
+    fprintf(fp, "counter,%s,skipped,%llu\n", name, (unsigned long long)counters->skipped);
+    fprintf(fp, "counter,%s,repeated,%llu\n", name, (unsigned long long)counters->repeated);
+}
+
+// 每行一个值: 类别,名称,指标,值，直方图的指标名为 le_<上限微秒>_us
+static void writeCsv(FILE* fp, const DecoderStats* stats)
+{
+    fprintf(fp, "kind,name,metric,value\n");
+    for (int i = 0; i < DECODER_STAGE_COUNT; i++)
+    {
+        const StageStats* stage = &(stats->stages[i]);
+        const char* name = decoderStageName(i);
+        fprintf(fp, "stage,%s,count,%llu\n", name, (unsigned long long)stage->count);
+        fprintf(fp, "stage,%s,wall_ns,%llu\n", name, (unsigned long long)stage->wallNs);
+        fprintf(fp, "stage,%s,cpu_ns,%llu\n", name, (unsigned long long)stage->cpuNs);
+        fprintf(fp, "stage,%s,max_ns,%llu\n", name, (unsigned long long)stage->maxNs);
+        fprintf(fp, "stage,%s,p50_us,%llu\n", name, (unsigned long long)stagePercentileUs(stage, 50));
+        fprintf(fp, "stage,%s,p99_us,%llu\n", name, (unsigned long long)stagePercentileUs(stage, 99));
+        for (int k = 0; k < STAGE_BUCKETS; k++)
+            fprintf(fp, "stage,%s,le_%llu_us,%llu\n", name, (unsigned long long)stageBucketUs(k), (unsigned long long)stage->buckets[k]);
+    }
+
+    for (int i = 0; i < DECODER_GAUGE_COUNT; i++)
+    {
+        fprintf(fp, "gauge,%s,value,%lld\n", decoderGaugeName(i), (long long)stats->gauges[i].value);
+        fprintf(fp, "gauge,%s,max,%lld\n", decoderGaugeName(i), (long long)stats->gauges[i].max);
+    }
+
+    writeCountersCsv(fp, "video", &(stats->video));
+    writeCountersCsv(fp, "audio", &(stats->audio));
+    fprintf(fp, "counter,audio_output,underruns,%llu\n", (unsigned long long)stats->underruns);
+    fprintf(fp, "counter,audio_output,silence_bytes,%llu\n", (unsigned long long)stats->silenceBytes);
+    for (int i = 0; i < DECODER_MILESTONE_COUNT; i++)
+        fprintf(fp, "startup,%s,us,%lld\n", decoderMilestoneName(i), (long long)stats->milestones[i]);
+
+    fprintf(fp, "counter,input,reads,%llu\n", (unsigned long long)stats->input.reads);
+    fprintf(fp, "counter,input,bytes,%llu\n", (unsigned long long)stats->input.bytes);
+    fprintf(fp, "counter,input,seeks,%llu\n", (unsigned long long)stats->input.seeks);
+    fprintf(fp, "counter,input,syscalls,%llu\n", (unsigned long long)stats->input.syscalls);
+    fprintf(fp, "counter,input,stalls,%llu\n", (unsigned long long)stats->input.stalls);
+    fprintf(fp, "counter,input,stall_ns,%llu\n", (unsigned long long)stats->input.stallNs);
+    fprintf(fp, "counter,input,invalidations,%llu\n", (unsigned long long)stats->input.invalidations);
+
+    fprintf(fp, "counter,video_pool,hits,%llu\n", (unsigned long long)stats->videoPool.hits);
+    fprintf(fp, "counter,video_pool,misses,%llu\n", (unsigned long long)stats->videoPool.misses);
+    fprintf(fp, "counter,video_pool,count,%llu\n", (unsigned long long)stats->videoPool.count);
+}
+
+bool writeStats(const char* file, const DecoderStats* stats)
+{
+    size_t length = strlen(file) + TEMP_FILE_EXTRA;
+    char* temp = malloc(length);
+    if (temp == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return false;
+    }
+
+    FILE* fp = openTempFile(file, temp, length, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "cannot open temporary file for %s\n", file);
+        free(temp);
+        return false;
+    }
+
+    if (isCsv(file))
+        writeCsv(fp, stats);
+    else
+        writeJson(fp, stats);
+
+    // 写入失败时 replaceFile 删除临时文件，不留在统计文件旁边
+    bool ok = replaceFile(fp, temp, file, ferror(fp) == 0);
+    if (!ok)
+        fprintf(stderr, "cannot write %s\n", file);
+
+    free(temp);
+    return ok;
+}
@@ -0,0 +1,12 @@
+#ifndef FFMPEG_PLAYER_DEMO_REPORT
+#define FFMPEG_PLAYER_DEMO_REPORT
+
+#include <stdbool.h>
+
+#include "decoder.h"
+
+// 把运行统计写入文件，扩展名为 .csv 时输出 CSV，否则输出 JSON
+// 先写入临时文件再改名，读取方不会读到写了一半的文件
+bool writeStats(const char* file, const DecoderStats* stats);
+
+#endif // FFMPEG_PLAYER_DEMO_REPORT
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "ring.h"
+
+// 读写位置是只增不减的累计字节数，二者之差就是已用空间，不需要额外的计数
+// 写入位置只由生产者修改，读取位置只由消费者修改，
+// 修改时使用 release，读取对方的位置时使用 acquire，保证看到位置时数据已经拷贝完成
+struct Ring
+{
+    unsigned char* data;
+    size_t capacity;
+    _Atomic uint64_t readPosition;
+    _Atomic uint64_t writePosition;
+};
+
+Ring* createRing(size_t capacity)
+{
+    Ring* ring = malloc(sizeof(Ring));
+    if (ring == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    ring->data = malloc(capacity);
+    if (ring->data == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        free(ring);
+        return NULL;
+    }
+
+    ring->capacity = capacity;
+    ring->readPosition = 0;
+    ring->writePosition = 0;
+    return ring;
+}
+
+void deleteRing(Ring* ring)
+{
+    if (ring == NULL)
+        return;
+
+    free(ring->data);
+    free(ring);
+}
+
+// 从累计位置 position 开始，在环形空间中拷贝 size 字节，超过末尾时分两段
+static void copyIn(Ring* ring, uint64_t position, const unsigned char* data, size_t size)
+{
+    size_t offset = position % ring->capacity;
+    size_t first = ring->capacity - offset < size ? ring->capacity - offset : size;
+    memcpy(ring->data + offset, data, first);
+    memcpy(ring->data, data + first, size - first);
+}
+
+static void copyOut(Ring* ring, uint64_t position, unsigned char* data, size_t size)
+{
+    size_t offset = position % ring->capacity;
+    size_t first = ring->capacity - offset < size ? ring->capacity - offset : size;
+    memcpy(data, ring->data + offset, first);
+    memcpy(data + first, ring->data, size - first);
+}
+
+size_t writeRing(Ring* ring, const void* data, size_t size)
+{
+    uint64_t write = atomic_load_explicit(&(ring->writePosition), memory_order_relaxed);
+    uint64_t read = atomic_load_explicit(&(ring->readPosition), memory_order_acquire);
+    size_t space = ring->capacity - (size_t)(write - read);
+    if (size > space)
+        size = space;
+
+    copyIn(ring, write, data, size);
+    atomic_store_explicit(&(ring->writePosition), write + size, memory_order_release);
+    return size;
+}
+
+size_t peekRing(Ring* ring, void* data, size_t size)
+{
+    uint64_t read = atomic_load_explicit(&(ring->readPosition), memory_order_relaxed);
+    uint64_t write = atomic_load_explicit(&(ring->writePosition), memory_order_acquire);
+    size_t used = (size_t)(write - read);
+    if (size > used)
+        size = used;
+
+    copyOut(ring, read, data, size);
+    return size;
+}
+
+size_t readRing(Ring* ring, void* data, size_t size)
+{
+    size = peekRing(ring, data, size);
+    uint64_t read = atomic_load_explicit(&(ring->readPosition), memory_order_relaxed);
+    atomic_store_explicit(&(ring->readPosition), read + size, memory_order_release);
+    return size;
+}
+
+size_t skipRing(Ring* ring, size_t size)
+{
+    uint64_t read = atomic_load_explicit(&(ring->readPosition), memory_order_relaxed);
+    uint64_t write = atomic_load_explicit(&(ring->writePosition), memory_order_acquire);
+    size_t used = (size_t)(write - read);
+    if (size > used)
+        size = used;
+
+    atomic_store_explicit(&(ring->readPosition), read + size, memory_order_release);
+    return size;
+}
+
+size_t usedRing(Ring* ring)
+{
+    uint64_t read = atomic_load_explicit(&(ring->readPosition), memory_order_acquire);
+    uint64_t write = atomic_load_explicit(&(ring->writePosition), memory_order_acquire);
+    return (size_t)(write - read);
+}
+
+size_t freeRing(Ring* ring)
+{
+    return ring->capacity - usedRing(ring);
+}
+
+size_t capacityRing(Ring* ring)
+{
+    return ring->capacity;
+}
+
+uint64_t readPositionRing(Ring* ring)
+{
+    return atomic_load_explicit(&(ring->readPosition), memory_order_acquire);
+}
+
+uint64_t writePositionRing(Ring* ring)
+{
+    return atomic_load_explicit(&(ring->writePosition), memory_order_acquire);
+}
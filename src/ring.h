@@ -0,0 +1,38 @@
+#ifndef FFMPEG_PLAYER_DEMO_RING
+#define FFMPEG_PLAYER_DEMO_RING
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Ring Ring;
+
+// 单生产者单消费者的无锁字节环形缓冲区，capacity 字节一次性分配
+// 生产者只调用 writeRing，消费者只调用 readRing、peekRing、skipRing，两边都不加锁，也不会阻塞
+Ring* createRing(size_t capacity);
+void deleteRing(Ring* ring);
+
+// 写入最多 size 字节，返回实际写入的字节数，空间不足时只写入一部分
+size_t writeRing(Ring* ring, const void* data, size_t size);
+
+// 读出最多 size 字节，返回实际读出的字节数
+size_t readRing(Ring* ring, void* data, size_t size);
+
+// 与 readRing 相同，但不移动读取位置
+size_t peekRing(Ring* ring, void* data, size_t size);
+
+// 丢弃最多 size 字节，返回实际丢弃的字节数，只能由消费者调用
+size_t skipRing(Ring* ring, size_t size);
+
+// 可读的字节数
+size_t usedRing(Ring* ring);
+
+// 可写的字节数
+size_t freeRing(Ring* ring);
+
+size_t capacityRing(Ring* ring);
+
+// 从创建开始累计读出、写入的字节数
+uint64_t readPositionRing(Ring* ring);
+uint64_t writePositionRing(Ring* ring);
+
+#endif // FFMPEG_PLAYER_DEMO_RING
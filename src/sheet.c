@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sheet.h"
+
+// 保留的缩略图依次排列，第 i 张是追加的第 i * stride 张
+struct Sheet
+{
+    int width;
+    int height;
+    int max;
+    uint8_t* pixels;
+    int count;          // 保留的张数
+    int capacity;       // pixels 能容纳的张数，按需翻倍，不超过 max
+    int stride;         // 每隔几张保留一张
+    int added;          // 追加的总张数
+};
+
+Sheet* createSheet(int width, int height, int max)
+{
+    Sheet* sheet = malloc(sizeof(Sheet));
+    if (sheet == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    sheet->width = width;
+    sheet->height = height;
+    sheet->max = max < 2 ? 2 : max & ~1;
+    sheet->pixels = NULL;
+    sheet->count = 0;
+    sheet->capacity = 0;
+    sheet->stride = 1;
+    sheet->added = 0;
+    return sheet;
+}
+
+void deleteSheet(Sheet* sheet)
+{
+    if (sheet == NULL)
+        return;
+
+    free(sheet->pixels);
+    free(sheet);
+}
+
+bool addSheet(Sheet* sheet, const uint8_t* thumb)
+{
+    int index = sheet->added++;
+    if (index % sheet->stride != 0)
+        return true;
+
+    size_t size = (size_t)sheet->width * sheet->height * 3;
+    if (sheet->count == sheet->capacity)
+    {
+        int capacity = sheet->capacity > 0 ? sheet->capacity * 2 : 64;
+        capacity = capacity < sheet->max ? capacity : sheet->max;
+        uint8_t* pixels = realloc(sheet->pixels, size * capacity);
+        if (pixels == NULL)
+        {
+            fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+            return false;
+        }
+
+        sheet->pixels = pixels;
+        sheet->capacity = capacity;
+    }
+
+    memcpy(sheet->pixels + size * sheet->count, thumb, size);
+    sheet->count += 1;
+
+    // 满了: 保留偶数位置的一半，之后的缩略图间隔加倍
+    if (sheet->count == sheet->max)
+    {
+        for (int i = 1; i < sheet->count / 2; i++)
+            memcpy(sheet->pixels + size * i, sheet->pixels + size * 2 * i, size);
+
+        sheet->count /= 2;
+        sheet->stride *= 2;
+    }
+
+    return true;
+}
+
+int countSheet(const Sheet* sheet)
+{
+    return sheet->count;
+}
+
+int strideSheet(const Sheet* sheet)
+{
+    return sheet->stride;
+}
+
+void layoutSheet(int count, int* cols, int* rows)
+{
+    *cols = count > 0 ? (int)ceil(sqrt(count)) : 0;
+    *rows = count > 0 ? (count + *cols - 1) / *cols : 0;
+}
+
+bool writeSheet(const Sheet* sheet, const char* path)
+{
+    int cols = 0;
+    int rows = 0;
+    layoutSheet(sheet->count, &cols, &rows);
+
+    size_t row = (size_t)sheet->width * 3;
+    uint8_t* line = calloc(cols, row);
+    FILE* fp = line != NULL ? fopen(path, "wb") : NULL;
+    if (fp == NULL)
+    {
+        if (line == NULL)
+            fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+        else
+            fprintf(stderr, "cannot write %s\n", path);
+        free(line);
+        return false;
+    }
+
+    // 一次拼出一行像素: 这一行格子中各张缩略图的同一行，最后一行空余的格子保持黑色
+    bool ok = fprintf(fp, "P6\n%d %d\n255\n", cols * sheet->width, rows * sheet->height) > 0;
+    for (int r = 0; r < rows && ok; r++)
+    {
+        int first = r * cols;
+        int n = sheet->count - first < cols ? sheet->count - first : cols;
+        if (n < cols)
+            memset(line, 0, row * cols);
+
+        for (int y = 0; y < sheet->height && ok; y++)
+        {
+            for (int c = 0; c < n; c++)
+                memcpy(line + row * c, sheet->pixels + row * ((size_t)sheet->height * (first + c) + y), row);
+
+            ok = fwrite(line, row, cols, fp) == (size_t)cols;
+        }
+    }
+
+    ok = fclose(fp) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "cannot write %s\n", path);
+    free(line);
+    return ok;
+}
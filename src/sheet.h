@@ -0,0 +1,29 @@
+#ifndef FFMPEG_PLAYER_DEMO_SHEET
+#define FFMPEG_PLAYER_DEMO_SHEET
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Sheet Sheet;
+
+// 缩略图拼图: 按顺序收集 width x height 的 RGB24 缩略图，最多保留 max 张（max 为偶数）
+// 满了以后去掉奇数位置的一半，之后每两张只保留一张，依此类推，保留的缩略图始终均匀分布在整个文件中
+Sheet* createSheet(int width, int height, int max);
+void deleteSheet(Sheet* sheet);
+
+// 追加一张缩略图，不保留时直接跳过，只在分配失败时返回 false
+bool addSheet(Sheet* sheet, const uint8_t* thumb);
+
+// 保留的张数
+int countSheet(const Sheet* sheet);
+
+// 每隔几张保留一张
+int strideSheet(const Sheet* sheet);
+
+// count 张缩略图排成接近正方形的网格的列数和行数
+void layoutSheet(int count, int* cols, int* rows);
+
+// 写成一张 PPM，空余的格子为黑色，逐行写出，不另外分配整张拼图
+bool writeSheet(const Sheet* sheet, const char* path);
+
+#endif // FFMPEG_PLAYER_DEMO_SHEET
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "stats.h"
+
+static uint64_t clockNs(clockid_t id)
+{
+    struct timespec ts;
+    if (clock_gettime(id, &ts) != 0)
+        return 0;
+
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+uint64_t wallNs(void)
+{
+    return clockNs(CLOCK_MONOTONIC);
+}
+
+uint64_t threadCpuNs(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    return clockNs(CLOCK_THREAD_CPUTIME_ID);
+#else
+    return 0;
+#endif
+}
+
+uint64_t processCpuNs(void)
+{
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+    return clockNs(CLOCK_PROCESS_CPUTIME_ID);
+#else
+    return 0;
+#endif
+}
+
+void processIo(ProcessIo* io)
+{
+    memset(io, 0, sizeof(ProcessIo));
+
+#ifdef __linux__
+    FILE* fp = fopen("/proc/self/io", "r");
+    if (fp != NULL)
+    {
+        char name[32];
+        unsigned long long value = 0;
+        while (fscanf(fp, "%31[^:]: %llu\n", name, &value) == 2)
+        {
+            if (strcmp(name, "syscr") == 0)
+                io->readCalls = value;
+            else if (strcmp(name, "rchar") == 0)
+                io->readBytes = value;
+        }
+        fclose(fp);
+    }
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        io->minorFaults = usage.ru_minflt;
+        io->majorFaults = usage.ru_majflt;
+    }
+#endif
+}
+
+// 单次耗时所在的直方图桶: 按微秒数的二进制位数分桶，只需要一次 clz
+static int stageBucket(uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    if (us == 0)
+        return 0;
+
+    int bucket = 64 - __builtin_clzll(us);
+    return bucket < STAGE_BUCKETS ? bucket : STAGE_BUCKETS - 1;
+}
+
+void resetStage(Stage* stage)
+{
+    stage->count = 0;
+    stage->wallNs = 0;
+    stage->cpuNs = 0;
+    stage->maxNs = 0;
+    for (int i = 0; i < STAGE_BUCKETS; i++)
+        stage->buckets[i] = 0;
+}
+
+void beginStage(StageTimer* timer)
+{
+    timer->wallNs = wallNs();
+    timer->cpuNs = threadCpuNs();
+}
+
+void endStage(Stage* stage, const StageTimer* timer)
+{
+    endStageWall(stage, timer);
+    addStageCpu(stage, threadCpuNs() - timer->cpuNs);
+}
+
+void endStageWall(Stage* stage, const StageTimer* timer)
+{
+    uint64_t ns = wallNs() - timer->wallNs;
+    atomic_fetch_add_explicit(&(stage->count), 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&(stage->wallNs), ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&(stage->buckets[stageBucket(ns)]), 1, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&(stage->maxNs), memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&(stage->maxNs), &max, ns, memory_order_relaxed, memory_order_relaxed));
+}
+
+void addStageCpu(Stage* stage, uint64_t cpuNs)
+{
+    atomic_fetch_add_explicit(&(stage->cpuNs), cpuNs, memory_order_relaxed);
+}
+
+void readStage(Stage* stage, StageStats* stats)
+{
+    stats->count = atomic_load_explicit(&(stage->count), memory_order_relaxed);
+    stats->wallNs = atomic_load_explicit(&(stage->wallNs), memory_order_relaxed);
+    stats->cpuNs = atomic_load_explicit(&(stage->cpuNs), memory_order_relaxed);
+    stats->maxNs = atomic_load_explicit(&(stage->maxNs), memory_order_relaxed);
+    for (int i = 0; i < STAGE_BUCKETS; i++)
+        stats->buckets[i] = atomic_load_explicit(&(stage->buckets[i]), memory_order_relaxed);
+}
+
+uint64_t stageBucketUs(int index)
+{
+    return (uint64_t)1 << index;
+}
+
+uint64_t stagePercentileUs(const StageStats* stats, double p)
+{
+    // 各个桶是分别读取的，总数以桶内计数之和为准
+    uint64_t total = 0;
+    for (int i = 0; i < STAGE_BUCKETS; i++)
+        total += stats->buckets[i];
+
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(p / 100 * (total - 1));
+    uint64_t seen = 0;
+    for (int i = 0; i < STAGE_BUCKETS; i++)
+    {
+        seen += stats->buckets[i];
+        if (seen > rank)
+            return stageBucketUs(i);
+    }
+
+    return stageBucketUs(STAGE_BUCKETS - 1);
+}
+
+void resetGauge(Gauge* gauge)
+{
+    gauge->value = 0;
+    gauge->max = 0;
+}
+
+void setGauge(Gauge* gauge, int64_t value)
+{
+    atomic_store_explicit(&(gauge->value), value, memory_order_relaxed);
+
+    int64_t max = atomic_load_explicit(&(gauge->max), memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&(gauge->max), &max, value, memory_order_relaxed, memory_order_relaxed));
+}
+
+void readGauge(Gauge* gauge, GaugeStats* stats)
+{
+    stats->value = atomic_load_explicit(&(gauge->value), memory_order_relaxed);
+    stats->max = atomic_load_explicit(&(gauge->max), memory_order_relaxed);
+}
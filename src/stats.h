@@ -0,0 +1,93 @@
+#ifndef FFMPEG_PLAYER_DEMO_STATS
+#define FFMPEG_PLAYER_DEMO_STATS
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// 耗时直方图的桶数: 第 0 个桶统计不到 1 微秒的耗时，第 i 个桶统计 [2^(i-1), 2^i) 微秒，最后一个桶包含更长的耗时
+#define STAGE_BUCKETS 24
+
+// 一个处理阶段的累计耗时，可以在多个线程中同时累加
+typedef struct Stage
+{
+    _Atomic uint64_t count;     // 调用次数
+    _Atomic uint64_t wallNs;    // 累计经过的时间
+    _Atomic uint64_t cpuNs;     // 累计占用的线程 CPU 时间
+    _Atomic uint64_t maxNs;     // 单次经过的最长时间
+    _Atomic uint64_t buckets[STAGE_BUCKETS];    // 单次经过时间的直方图
+}Stage;
+
+// 开始计时时的时间点
+typedef struct StageTimer
+{
+    uint64_t wallNs;
+    uint64_t cpuNs;
+}StageTimer;
+
+// 阶段耗时的快照
+typedef struct StageStats
+{
+    uint64_t count;
+    uint64_t wallNs;
+    uint64_t cpuNs;
+    uint64_t maxNs;
+    uint64_t buckets[STAGE_BUCKETS];
+}StageStats;
+
+// 队列深度等瞬时值，同时记录出现过的最大值
+typedef struct Gauge
+{
+    _Atomic int64_t value;
+    _Atomic int64_t max;
+}Gauge;
+
+typedef struct GaugeStats
+{
+    int64_t value;
+    int64_t max;
+}GaugeStats;
+
+// 单调时钟，单位纳秒
+uint64_t wallNs(void);
+
+// 当前线程占用的 CPU 时间，单位纳秒，平台不支持时返回 0
+uint64_t threadCpuNs(void);
+
+// 当前进程占用的 CPU 时间，单位纳秒，平台不支持时返回 0
+uint64_t processCpuNs(void);
+
+// 进程的 IO 计数，平台不支持的项为 0
+typedef struct ProcessIo
+{
+    uint64_t readCalls;     // read 类系统调用的次数（Linux /proc/self/io 的 syscr）
+    uint64_t readBytes;     // 通过这些系统调用读取的字节数（rchar）
+    uint64_t minorFaults;   // 不需要读盘的缺页次数，mmap 读取页缓存时产生
+    uint64_t majorFaults;   // 需要读盘的缺页次数
+}ProcessIo;
+
+// 当前进程从启动开始累计的 IO 计数
+void processIo(ProcessIo* io);
+
+void resetStage(Stage* stage);
+void beginStage(StageTimer* timer);
+
+// 结束计时，累加经过的时间和 CPU 时间
+void endStage(Stage* stage, const StageTimer* timer);
+
+// 只累加经过的时间，CPU 时间由实际执行的线程通过 addStageCpu 累加
+void endStageWall(Stage* stage, const StageTimer* timer);
+void addStageCpu(Stage* stage, uint64_t cpuNs);
+
+void readStage(Stage* stage, StageStats* stats);
+
+// 直方图第 index 个桶的上限，单位微秒
+uint64_t stageBucketUs(int index);
+
+// 估算单次耗时的百分位数，返回所在桶的上限，单位微秒，p 取值 0~100
+uint64_t stagePercentileUs(const StageStats* stats, double p);
+
+void resetGauge(Gauge* gauge);
+void setGauge(Gauge* gauge, int64_t value);
+void readGauge(Gauge* gauge, GaugeStats* stats);
+
+#endif // FFMPEG_PLAYER_DEMO_STATS
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+#include "queue.h"
+#include "waitqueue.h"
+#include "stats.h"
+
+// 两个线程通过小容量队列传递 count 个连续编号的元素，消费者检查顺序和个数
+// 容量越小，两端越频繁地在满和空之间切换，越容易暴露可见性和丢失唤醒的问题
+
+#define STRESS_COUNT        200000
+
+// 元素比一个字长大，拷贝不完整时 check 与 seq 对不上
+typedef struct StressItem
+{
+    uint64_t seq;
+    uint64_t check;
+}StressItem;
+
+typedef struct StressData
+{
+    Queue* queue;
+    WaitQueue* waitQueue;
+    int32_t ms;                 // 消费者等待的毫秒数，-1 表示一直等待
+    uint64_t count;
+    uint64_t received;          // 消费者收到的元素数
+    uint64_t errors;            // 顺序错误或内容错误的元素数
+    atomic_bool end;
+}StressData;
+
+static void makeItem(StressItem* item, uint64_t seq)
+{
+    item->seq = seq;
+    item->check = ~seq;
+}
+
+static void checkItem(StressData* data, const StressItem* item)
+{
+    if (item->seq != data->received || item->check != ~item->seq)
+    {
+        if (data->errors == 0)
+            fprintf(stderr, "expect %llu, got %llu (check %llx)\n",
+                (unsigned long long)data->received, (unsigned long long)item->seq, (unsigned long long)item->check);
+        data->errors += 1;
+    }
+
+    data->received += 1;
+}
+
+// 原始队列两端都不阻塞，满或空时自旋重试，每 STRESS_SPIN 次让出一次 CPU，单核机器上也能推进
+#define STRESS_SPIN         64
+
+static void spinWait(int* spins)
+{
+    *spins += 1;
+    if (*spins % STRESS_SPIN == 0)
+        SDL_Delay(0);
+}
+
+static int producer(void* userdata)
+{
+    StressData* data = (StressData*)(userdata);
+    StressItem item;
+    int spins = 0;
+    for (uint64_t i = 0; i < data->count; i++)
+    {
+        makeItem(&item, i);
+        while (!pushQueue(data->queue, &item))
+            spinWait(&spins);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int consumer(void* userdata)
+{
+    StressData* data = (StressData*)(userdata);
+    StressItem item;
+    int spins = 0;
+    while (data->received < data->count)
+    {
+        if (popQueue(data->queue, &item))
+            checkItem(data, &item);
+        else
+            spinWait(&spins);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// 等待队列两端都走阻塞路径，生产者满时等待，消费者空时等待
+static int waitProducer(void* userdata)
+{
+    StressData* data = (StressData*)(userdata);
+    StressItem item;
+    for (uint64_t i = 0; i < data->count; i++)
+    {
+        makeItem(&item, i);
+        if (!pushWaitQueue(data->waitQueue, &item, true))
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int waitConsumer(void* userdata)
+{
+    StressData* data = (StressData*)(userdata);
+    StressItem item;
+    while (data->received < data->count)
+    {
+        // 有超时的等待在超时后返回 false，只要没有结束就继续等待
+        if (popWaitQueue(data->waitQueue, &item, data->ms))
+            checkItem(data, &item);
+        else if (data->end)
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static bool runStress(const char* name, size_t capacity, int32_t ms, uint64_t count, bool wait)
+{
+    StressData data;
+    data.queue = NULL;
+    data.waitQueue = NULL;
+    data.ms = ms;
+    data.count = count;
+    data.received = 0;
+    data.errors = 0;
+    data.end = false;
+
+    if (wait)
+        data.waitQueue = createWaitQueue(sizeof(StressItem), capacity, &(data.end), NULL);
+    else
+        data.queue = createQueue(sizeof(StressItem), capacity);
+
+    if (data.queue == NULL && data.waitQueue == NULL)
+        return false;
+
+    uint64_t startNs = wallNs();
+    SDL_Thread* producerThread = SDL_CreateThread(wait ? waitProducer : producer, "stressProducer", &data);
+    SDL_Thread* consumerThread = SDL_CreateThread(wait ? waitConsumer : consumer, "stressConsumer", &data);
+    int producerStatus = EXIT_FAILURE;
+    int consumerStatus = EXIT_FAILURE;
+    SDL_WaitThread(producerThread, &producerStatus);
+    SDL_WaitThread(consumerThread, &consumerStatus);
+    double seconds = (wallNs() - startNs) / 1e9;
+
+    // 两个线程都已退出，队列中不应该有剩余的元素
+    StressItem item;
+    uint64_t extra = 0;
+    while (wait ? popWaitQueue(data.waitQueue, &item, 0) : popQueue(data.queue, &item))
+        extra += 1;
+
+    bool ok = producerStatus == EXIT_SUCCESS && consumerStatus == EXIT_SUCCESS && data.received == count && data.errors == 0 && extra == 0;
+    printf("%-28s capacity %-3zu %llu items in %.3f s, %.0f items/s: %s\n", name, capacity,
+        (unsigned long long)data.received, seconds, seconds > 0 ? data.received / seconds : 0, ok ? "ok" : "FAILED");
+    if (!ok)
+        printf("    errors %llu, left in queue %llu\n", (unsigned long long)data.errors, (unsigned long long)extra);
+
+    if (data.queue != NULL)
+        deleteQueue(data.queue);
+    deleteWaitQueue(data.waitQueue);
+    return ok;
+}
+
+// 队列空时消费者阻塞，设置结束标志并唤醒后应当立即返回 false
+static int endConsumer(void* userdata)
+{
+    StressData* data = (StressData*)(userdata);
+    StressItem item;
+    return popWaitQueue(data->waitQueue, &item, -1) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static bool runEnd(void)
+{
+    StressData data;
+    data.end = false;
+    data.waitQueue = createWaitQueue(sizeof(StressItem), 1, &(data.end), NULL);
+    if (data.waitQueue == NULL)
+        return false;
+
+    SDL_Thread* thread = SDL_CreateThread(endConsumer, "stressEnd", &data);
+    SDL_Delay(50);
+    data.end = true;
+    wakeWaitQueue(data.waitQueue);
+
+    int status = EXIT_FAILURE;
+    SDL_WaitThread(thread, &status);
+    deleteWaitQueue(data.waitQueue);
+
+    bool ok = status == EXIT_SUCCESS;
+    printf("%-28s %s\n", "wait queue end wakeup", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// 用法: stress [count]
+int main(int argc, char* argv[])
+{
+    uint64_t count = argc > 1 ? strtoull(argv[1], NULL, 10) : STRESS_COUNT;
+
+    bool ok = true;
+    ok = runStress("queue", 1, 0, count, false) && ok;
+    ok = runStress("queue", 2, 0, count, false) && ok;
+    ok = runStress("queue", 7, 0, count, false) && ok;
+    ok = runStress("wait queue", 1, -1, count, true) && ok;
+    ok = runStress("wait queue", 2, -1, count, true) && ok;
+    ok = runStress("wait queue", 7, -1, count, true) && ok;
+    ok = runStress("wait queue (1 ms timeout)", 2, 1, count, true) && ok;
+    ok = runEnd() && ok;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "tempfile.h"
+
+FILE* openTempFile(const char* file, char* temp, size_t size, const char* mode)
+{
+    static atomic_uint sequence = 0;
+    unsigned int n = atomic_fetch_add(&sequence, 1);
+    int length = snprintf(temp, size, "%s.%ld.%u.tmp", file, (long)getpid(), n);
+    if (length < 0 || (size_t)length >= size)
+        return NULL;
+
+    return fopen(temp, mode);
+}
+
+bool replaceFile(FILE* fp, const char* temp, const char* file, bool ok)
+{
+    ok = fclose(fp) == 0 && ok;
+
+#ifdef _WIN32
+    // Windows 上 rename 不覆盖已经存在的文件
+    if (ok)
+        remove(file);
+#endif
+
+    if (ok && rename(temp, file) == 0)
+        return true;
+
+    remove(temp);
+    return false;
+}
@@ -0,0 +1,19 @@
+#ifndef FFMPEG_PLAYER_DEMO_TEMPFILE
+#define FFMPEG_PLAYER_DEMO_TEMPFILE
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// 先写临时文件再改名替换目标文件，其它进程不会读到写了一半的文件
+// 临时文件名为 <file>.<进程号>.<序号>.tmp，同时写入同一个文件的进程和线程各自使用自己的临时文件，后改名的覆盖先改名的
+
+// 临时文件名比目标文件名多出的最大长度，包括结尾的 '\0'
+#define TEMP_FILE_EXTRA     48
+
+// 打开 file 的临时文件用于写入，临时文件名写入 temp，名字过长或无法打开时返回 NULL
+FILE* openTempFile(const char* file, char* temp, size_t size, const char* mode);
+
+// 关闭临时文件并改名替换 file，ok 为 false 或者关闭、改名失败时删除临时文件并返回 false
+bool replaceFile(FILE* fp, const char* temp, const char* file, bool ok);
+
+#endif // FFMPEG_PLAYER_DEMO_TEMPFILE
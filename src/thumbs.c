@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* ffmpeg */
+#include <libavformat/avformat.h>   // libavformat-dev  : Audio-Video Foramt - 用于音视频文件封装、解封装
+#include <libavcodec/avcodec.h>     // libavcodec-dev   : Audio-Video Codec - 用于音视频数据编解码
+#include <libavutil/imgutils.h>     // libavutil-dev    : Audio-Video Utilities - 一些实用函数
+#include <libswscale/swscale.h>     // libswscale-dev   : Software Scale - 软件缩放算法
+
+#include "thumbs.h"
+#include "sheet.h"
+
+/* 文件路径的最大长度 */
+#define THUMB_PATH      1024
+
+/* 拼图最多保留的缩略图张数，每个关键帧一张时长视频的缩略图更多，超过后均匀地去掉一半 */
+#define SHEET_TILES     256
+
+/* 提取一个文件的缩略图的状态 */
+typedef struct ThumbContext
+{
+    AVFormatContext* formatContext;
+    AVCodecContext* codecContext;
+    AVStream* stream;
+    struct SwsContext* swsContext;  // 所有缩略图共用，源尺寸或格式改变时由 sws_getCachedContext 重建
+    AVPacket* packet;
+    AVFrame* frame;
+    int scaleFlags;
+    int width;                      // 缩略图尺寸
+    int height;
+    uint8_t* pixels;                // 最近一张缩略图的 RGB24 数据，相邻位置落在同一个关键帧时重复使用
+    int count;                      // 生成的缩略图张数
+    Sheet* sheet;                   // 输出拼图时收集缩略图，输出到目录时为 NULL
+    const char* output;             // 输出到目录时每张缩略图生成后立即写出
+    int index;                      // 文件序号，多个文件时用于区分输出
+    int files;
+    uint64_t decoded;               // 解码的帧数
+    uint64_t packets;               // 读取的视频数据包数
+}ThumbContext;
+
+static void closeThumbs(ThumbContext* ctx)
+{
+    sws_freeContext(ctx->swsContext);
+    av_frame_free(&(ctx->frame));
+    av_packet_free(&(ctx->packet));
+    avcodec_free_context(&(ctx->codecContext));
+    avformat_close_input(&(ctx->formatContext));
+    deleteSheet(ctx->sheet);
+    free(ctx->pixels);
+}
+
+// output 是否为拼图
+static bool isSheetOutput(const char* output)
+{
+    size_t length = strlen(output);
+    return length > 4 && strcmp(output + length - 4, ".ppm") == 0;
+}
+
+// 打开文件和视频解码器，解码器只输出关键帧
+static bool openThumbs(ThumbContext* ctx, const char* file, const DecoderOptions* options, int width, const char* output, int fileIndex, int files)
+{
+    memset(ctx, 0, sizeof(ThumbContext));
+    ctx->scaleFlags = options->scaleFlags;
+    ctx->output = output;
+    ctx->index = fileIndex;
+    ctx->files = files;
+
+    if (!decoderOpenFormat(&(ctx->formatContext), file, NULL, options))
+        return false;
+
+    int index = av_find_best_stream(ctx->formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (index < 0)
+    {
+        fprintf(stderr, "cannot find video stream: %s\n", file);
+        return false;
+    }
+
+    // 其它流的数据包由解封装器直接丢弃
+    for (unsigned int i = 0; i < ctx->formatContext->nb_streams; i++)
+    {
+        if ((int)i != index)
+            ctx->formatContext->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    ctx->stream = ctx->formatContext->streams[index];
+    const AVCodecParameters* params = ctx->stream->codecpar;
+    if (params->width <= 0 || params->height <= 0)
+    {
+        fprintf(stderr, "invalid video size %dx%d: %s\n", params->width, params->height, file);
+        return false;
+    }
+
+    // 与播放时一样可以用 --decoder 指定解码器，不做校准，提取缩略图只解码很少的帧
+    const AVCodec* codec = decoderFindNamedCodec(options->videoDecoder, params->codec_id);
+    if (codec == NULL)
+        codec = avcodec_find_decoder(params->codec_id);
+
+    if (codec == NULL)
+    {
+        fprintf(stderr, "cannot find decoder: %s\n", avcodec_get_name(params->codec_id));
+        return false;
+    }
+
+    ctx->codecContext = avcodec_alloc_context3(codec);
+    ctx->packet = av_packet_alloc();
+    ctx->frame = av_frame_alloc();
+    if (ctx->codecContext == NULL || ctx->packet == NULL || ctx->frame == NULL)
+    {
+        fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return false;
+    }
+
+    if (avcodec_parameters_to_context(ctx->codecContext, params) < 0)
+    {
+        fprintf(stderr, "avcodec_parameters_to_context failed\n");
+        return false;
+    }
+
+    // 只解码关键帧，其余的帧在解码器中直接跳过
+    ctx->codecContext->pkt_timebase = ctx->stream->time_base;
+    ctx->codecContext->skip_frame = AVDISCARD_NONKEY;
+    decoderSetThreads(ctx->codecContext, options);
+
+    if (avcodec_open2(ctx->codecContext, codec, NULL) < 0)
+    {
+        fprintf(stderr, "avcodec_open2 failed\n");
+        return false;
+    }
+
+    // 高度按显示比例（包括像素宽高比）计算，取偶数
+    AVRational sar = av_guess_sample_aspect_ratio(ctx->formatContext, ctx->stream, NULL);
+    double aspect = (double)params->width / params->height;
+    if (sar.num > 0 && sar.den > 0)
+        aspect = aspect * sar.num / sar.den;
+
+    ctx->width = width;
+    ctx->height = FFMAX((int)lround(width / aspect) & ~1, 2);
+    ctx->pixels = malloc((size_t)ctx->width * ctx->height * 3);
+    ctx->sheet = isSheetOutput(output) ? createSheet(ctx->width, ctx->height, SHEET_TILES) : NULL;
+    if (ctx->pixels == NULL || (isSheetOutput(output) && ctx->sheet == NULL))
+    {
+        fprintf(stderr, "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return false;
+    }
+
+    return true;
+}
+
+static bool writePpm(const char* path, const uint8_t* pixels, int width, int height)
+{
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "cannot write %s\n", path);
+        return false;
+    }
+
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    bool ok = fwrite(pixels, (size_t)width * 3, height, fp) == (size_t)height;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "cannot write %s\n", path);
+    return ok;
+}
+
+// 输出最近一张缩略图: 拼图时交给拼图收集，否则立即写到目录中，内存中只保留这一张
+static bool emitThumb(ThumbContext* ctx)
+{
+    ctx->count += 1;
+    if (ctx->sheet != NULL)
+        return addSheet(ctx->sheet, ctx->pixels);
+
+    char path[THUMB_PATH];
+    if (ctx->files > 1)
+        snprintf(path, sizeof(path), "%s/%d-%04d.ppm", ctx->output, ctx->index + 1, ctx->count);
+    else
+        snprintf(path, sizeof(path), "%s/%04d.ppm", ctx->output, ctx->count);
+
+    return writePpm(path, ctx->pixels, ctx->width, ctx->height);
+}
+
+// 把一帧缩放成缩略图并输出
+static bool pushThumb(ThumbContext* ctx, const AVFrame* frame)
+{
+    ctx->swsContext = sws_getCachedContext(ctx->swsContext,
+        frame->width, frame->height, frame->format,
+        ctx->width, ctx->height, AV_PIX_FMT_RGB24,
+        ctx->scaleFlags, NULL, NULL, NULL);
+    if (ctx->swsContext == NULL)
+    {
+        fprintf(stderr, "sws_getCachedContext failed\n");
+        return false;
+    }
+
+    uint8_t* data[4] = {ctx->pixels, NULL, NULL, NULL};
+    int linesize[4] = {ctx->width * 3, 0, 0, 0};
+    sws_scale(ctx->swsContext, (const uint8_t* const*)frame->data, frame->linesize, 0, frame->height, data, linesize);
+    return emitThumb(ctx);
+}
+
+// 重复上一张缩略图，相邻的两个位置定位到同一个关键帧时不再解码；还没有缩略图时跳过，只在分配或写入失败时返回 false
+static bool repeatThumb(ThumbContext* ctx)
+{
+    if (ctx->count == 0)
+        return true;
+
+    return emitThumb(ctx);
+}
+
+// 送入一个数据包（NULL 表示冲刷），取出全部输出的帧，limit 不小于 0 时最多生成这么多张缩略图，其余的帧丢弃
+static bool decodeThumbs(ThumbContext* ctx, const AVPacket* packet, int limit)
+{
+    // 损坏的数据包跳过，不影响其它缩略图
+    int ret = avcodec_send_packet(ctx->codecContext, packet);
+    if (ret < 0 && ret != AVERROR_EOF)
+        return ret == AVERROR_INVALIDDATA;
+
+    int taken = 0;
+    while ((ret = avcodec_receive_frame(ctx->codecContext, ctx->frame)) >= 0)
+    {
+        ctx->decoded += 1;
+        bool ok = limit >= 0 && taken >= limit ? true : pushThumb(ctx, ctx->frame);
+        taken += 1;
+        av_frame_unref(ctx->frame);
+        if (!ok)
+            return false;
+    }
+
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+}
+
+// 顺序读取整个文件，每个关键帧一张缩略图
+static bool extractKeyframes(ThumbContext* ctx)
+{
+    while (av_read_frame(ctx->formatContext, ctx->packet) >= 0)
+    {
+        bool ok = true;
+        if (ctx->packet->stream_index == ctx->stream->index)
+        {
+            ctx->packets += 1;
+            if (ctx->packet->flags & AV_PKT_FLAG_KEY)
+                ok = decodeThumbs(ctx, ctx->packet, -1);
+        }
+
+        av_packet_unref(ctx->packet);
+        if (!ok)
+            return false;
+    }
+
+    return decodeThumbs(ctx, NULL, -1);
+}
+
+// 在文件中均匀取 thumbs 个位置，定位到每个位置之前的关键帧，只解码这一帧
+static bool extractSeek(ThumbContext* ctx, int thumbs)
+{
+    int64_t start = ctx->formatContext->start_time != AV_NOPTS_VALUE ? ctx->formatContext->start_time : 0;
+    int64_t duration = ctx->formatContext->duration;
+    int64_t lastKey = AV_NOPTS_VALUE;
+    for (int i = 0; i < thumbs; i++)
+    {
+        // 取每一段的中点，避开片头和片尾
+        int64_t target = start + duration * (2 * i + 1) / (2 * thumbs);
+        int64_t ts = av_rescale_q(target, AV_TIME_BASE_Q, ctx->stream->time_base);
+        if (av_seek_frame(ctx->formatContext, ctx->stream->index, ts, AVSEEK_FLAG_BACKWARD) < 0)
+        {
+            fprintf(stderr, "av_seek_frame failed\n");
+            return false;
+        }
+
+        // 定位后的第一个关键帧，之前的非关键帧不送入解码器
+        bool found = false;
+        while (!found && av_read_frame(ctx->formatContext, ctx->packet) >= 0)
+        {
+            if (ctx->packet->stream_index == ctx->stream->index)
+            {
+                ctx->packets += 1;
+                found = (ctx->packet->flags & AV_PKT_FLAG_KEY) != 0;
+            }
+
+            if (!found)
+                av_packet_unref(ctx->packet);
+        }
+
+        if (!found)
+        {
+            if (!repeatThumb(ctx))
+                return false;
+            continue;
+        }
+
+        int64_t key = ctx->packet->pts != AV_NOPTS_VALUE ? ctx->packet->pts : ctx->packet->dts;
+        if (key != AV_NOPTS_VALUE && key == lastKey)
+        {
+            av_packet_unref(ctx->packet);
+            if (!repeatThumb(ctx))
+                return false;
+            continue;
+        }
+
+        // 送入关键帧后立即冲刷，帧级多线程也不必等后面的数据包，冲刷后重置解码器准备下一次定位
+        int count = ctx->count;
+        bool ok = decodeThumbs(ctx, ctx->packet, 1) && decodeThumbs(ctx, NULL, 1 - (ctx->count - count));
+        av_packet_unref(ctx->packet);
+        avcodec_flush_buffers(ctx->codecContext);
+        if (!ok)
+            return false;
+
+        if (ctx->count > count)
+            lastKey = key;
+        else if (!repeatThumb(ctx))
+            return false;
+    }
+
+    return true;
+}
+
+// 拼图在所有缩略图生成后写出，多个文件时在扩展名之前加上序号
+static bool writeThumbSheet(const ThumbContext* ctx)
+{
+    char path[THUMB_PATH];
+    size_t length = strlen(ctx->output);
+    if (ctx->files > 1)
+        snprintf(path, sizeof(path), "%.*s-%d.ppm", (int)(length - 4), ctx->output, ctx->index + 1);
+    else
+        snprintf(path, sizeof(path), "%s", ctx->output);
+
+    return writeSheet(ctx->sheet, path);
+}
+
+int runThumbs(char** files, int count, const DecoderOptions* options, int thumbs, int width, const char* output)
+{
+    int status = EXIT_SUCCESS;
+    uint64_t totalThumbs = 0;
+    uint64_t totalDecoded = 0;
+    double totalSeconds = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t fileNs = wallNs();
+        ThumbContext ctx;
+        bool ok = openThumbs(&ctx, files[i], options, width, output, i, count);
+
+        // 时长未知时无法均匀取位置，改为每个关键帧一张
+        if (ok && thumbs > 0 && ctx.formatContext->duration > 0)
+            ok = extractSeek(&ctx, thumbs);
+        else if (ok)
+            ok = extractKeyframes(&ctx);
+
+        // 拼图写文件的时间不计入，输出到目录时每张缩略图随生成写出，计入
+        double seconds = (wallNs() - fileNs) / 1e9;
+        if (ok && ctx.sheet != NULL && countSheet(ctx.sheet) > 0)
+            ok = writeThumbSheet(&ctx);
+
+        if (ok)
+        {
+            printf("file:           %s\n", files[i]);
+            printf("thumbnails:     %d (%dx%d, decoded %llu frames, read %llu video packets)\n", ctx.count, ctx.width, ctx.height,
+                (unsigned long long)ctx.decoded, (unsigned long long)ctx.packets);
+            printf("wall time:      %.3f s\n", seconds);
+            printf("thumbs/s:       %.1f\n", seconds > 0 ? ctx.count / seconds : 0);
+            if (ctx.sheet != NULL && strideSheet(ctx.sheet) > 1)
+                printf("sheet:          %d thumbnails, one in every %d\n", countSheet(ctx.sheet), strideSheet(ctx.sheet));
+            printf("\n");
+            totalThumbs += ctx.count;
+            totalDecoded += ctx.decoded;
+            totalSeconds += seconds;
+        }
+        else
+        {
+            status = EXIT_FAILURE;
+        }
+
+        closeThumbs(&ctx);
+    }
+
+    if (count > 1)
+    {
+        printf("total:          %llu thumbnails, decoded %llu frames in %.3f s, %.1f thumbs/s\n",
+            (unsigned long long)totalThumbs, (unsigned long long)totalDecoded, totalSeconds, totalSeconds > 0 ? totalThumbs / totalSeconds : 0);
+    }
+
+    return status;
+}
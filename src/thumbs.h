@@ -0,0 +1,15 @@
+#ifndef FFMPEG_PLAYER_DEMO_THUMBS
+#define FFMPEG_PLAYER_DEMO_THUMBS
+
+#include "decoder.h"
+
+// 无窗口批量提取缩略图: 视频解码器设置 skip_frame = AVDISCARD_NONKEY，只解码关键帧
+// thumbs 大于 0 时在每个文件中均匀取 thumbs 个位置，定位到每个位置之前的关键帧，只解码这一帧
+// thumbs 为 0 时顺序读取整个文件，每个关键帧一张，非关键帧的数据包不送入解码器
+// 缩略图宽 width 像素，高度按画面比例，用同一个 SwsContext 缩放为 RGB24
+// output 以 .ppm 结尾时每个文件写成一张拼图（多个文件时在扩展名之前加上序号），缩略图太多时均匀地只保留一部分；
+// 否则是已经存在的目录，每张缩略图一个 PPM 文件，生成后立即写出
+// 结束后输出每个文件和总的缩略图数、解码帧数和每秒缩略图数
+int runThumbs(char** files, int count, const DecoderOptions* options, int thumbs, int width, const char* output);
+
+#endif // FFMPEG_PLAYER_DEMO_THUMBS
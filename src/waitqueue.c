@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+#include "waitqueue.h"
+#include "queue.h"
+
+typedef struct WaitQueue
+{
+    Queue* queue;
+    SDL_sem* readable;              // 消费者等待的信号: 压入了新元素，或结束
+    SDL_sem* writable;              // 生产者等待的信号: 弹出了元素，或结束
+    atomic_bool readerWaiting;      // 消费者正在等待
+    atomic_bool writerWaiting;      // 生产者正在等待
+    const atomic_bool* end;         // 结束标志，由队列的所有者设置
+    Gauge* depth;                   // 队列深度
+}WaitQueue;
+
+WaitQueue* createWaitQueue(size_t itemSize, size_t capacity, const atomic_bool* end, Gauge* depth)
+{
+    WaitQueue* queue = malloc(sizeof(WaitQueue));
+    if (queue == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    queue->queue = createQueue(itemSize, capacity);
+    queue->readable = SDL_CreateSemaphore(0);
+    queue->writable = SDL_CreateSemaphore(0);
+    queue->readerWaiting = false;
+    queue->writerWaiting = false;
+    queue->end = end;
+    queue->depth = depth;
+    if (queue->queue == NULL || queue->readable == NULL || queue->writable == NULL)
+    {
+        deleteWaitQueue(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+void deleteWaitQueue(WaitQueue* queue)
+{
+    if (queue == NULL)
+        return;
+
+    if (queue->queue != NULL)
+        deleteQueue(queue->queue);
+
+    if (queue->readable != NULL)
+        SDL_DestroySemaphore(queue->readable);
+
+    if (queue->writable != NULL)
+        SDL_DestroySemaphore(queue->writable);
+
+    free(queue);
+}
+
+void wakeWaitQueue(WaitQueue* queue)
+{
+    if (queue == NULL)
+        return;
+
+    SDL_SemPost(queue->readable);
+    SDL_SemPost(queue->writable);
+}
+
+static bool isEndWaitQueue(WaitQueue* queue)
+{
+    return queue->end != NULL && *(queue->end);
+}
+
+static void updateDepth(WaitQueue* queue)
+{
+    if (queue->depth != NULL)
+        setGauge(queue->depth, countQueue(queue->queue));
+}
+
+bool pushWaitQueue(WaitQueue* queue, const void* item, bool wait)
+{
+    bool ok = pushQueue(queue->queue, item);
+    while (!ok && wait && !isEndWaitQueue(queue))
+    {
+        // 先声明正在等待再检查队列，消费者在两者之间弹出元素时也会发送信号
+        // 声明和检查之间、对方的发布和交换之间都需要全序栅栏，否则双方可能都读到旧值，没有超时的等待会一直挂起
+        queue->writerWaiting = true;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (countQueue(queue->queue) == capacityQueue(queue->queue) && !isEndWaitQueue(queue))
+            SDL_SemWait(queue->writable);
+        queue->writerWaiting = false;
+        ok = pushQueue(queue->queue, item);
+    }
+
+    if (ok)
+    {
+        updateDepth(queue);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_exchange(&(queue->readerWaiting), false))
+            SDL_SemPost(queue->readable);
+    }
+    return ok;
+}
+
+bool popWaitQueue(WaitQueue* queue, void* item, int32_t ms)
+{
+    bool ok = popQueue(queue->queue, item);
+    while (!ok && ms != 0 && !isEndWaitQueue(queue))
+    {
+        int ret = 0;
+        queue->readerWaiting = true;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (countQueue(queue->queue) == 0 && !isEndWaitQueue(queue))
+            ret = ms < 0 ? SDL_SemWait(queue->readable) : SDL_SemWaitTimeout(queue->readable, ms);
+        queue->readerWaiting = false;
+        ok = popQueue(queue->queue, item);
+
+        if (ret == SDL_MUTEX_TIMEDOUT)
+            break;
+    }
+
+    if (ok)
+    {
+        updateDepth(queue);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_exchange(&(queue->writerWaiting), false))
+            SDL_SemPost(queue->writable);
+    }
+    return ok;
+}
+
+int countWaitQueue(WaitQueue* queue)
+{
+    return countQueue(queue->queue);
+}
+
+int capacityWaitQueue(WaitQueue* queue)
+{
+    return capacityQueue(queue->queue);
+}
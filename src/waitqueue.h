@@ -0,0 +1,34 @@
+#ifndef FFMPEG_PLAYER_DEMO_WAIT_QUEUE
+#define FFMPEG_PLAYER_DEMO_WAIT_QUEUE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "stats.h"
+
+typedef struct WaitQueue WaitQueue;
+
+// 线程之间的单生产者单消费者队列，满时阻塞生产者，空时阻塞消费者
+// 队列本身无锁，两端各有一个信号量，只在对方声明正在等待时才发送，平时不进入内核
+// end 为 true 时两端都不再等待，设置后调用 wakeWaitQueue 唤醒正在等待的线程；end 和 depth 可以为 NULL
+WaitQueue* createWaitQueue(size_t itemSize, size_t capacity, const atomic_bool* end, Gauge* depth);
+
+// 删除队列，队列中剩余的元素由调用者先取出释放
+void deleteWaitQueue(WaitQueue* queue);
+
+// 唤醒在队列两端等待的线程，多余的信号只会让对方多检查一次
+void wakeWaitQueue(WaitQueue* queue);
+
+// 压入一个元素，wait 为 true 时队列满则等待，结束或不等待时返回 false
+bool pushWaitQueue(WaitQueue* queue, const void* item, bool wait);
+
+// 弹出一个元素，队列空时最多等待 ms 毫秒，ms 为 0 时不等待，为 -1 时一直等待，超时或结束时返回 false
+bool popWaitQueue(WaitQueue* queue, void* item, int32_t ms);
+
+// 另一端可能同时在修改，返回值只是某一时刻的快照
+int countWaitQueue(WaitQueue* queue);
+int capacityWaitQueue(WaitQueue* queue);
+
+#endif // FFMPEG_PLAYER_DEMO_WAIT_QUEUE
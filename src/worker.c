@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>               // libsdl2-dev
+
+#include "worker.h"
+
+// 一批任务，在调用 runWorkers 的线程的栈上，任务全部领完时从待领取的链表中移除
+typedef struct WorkerBatch
+{
+    WorkerTask task;
+    void* userdata;
+    int jobs;                   // 这一批的任务数
+    int next;                   // 下一个待领取的任务
+    int done;                   // 已完成的任务数
+    struct WorkerBatch* link;   // 链表中的下一批
+}WorkerBatch;
+
+typedef struct Workers{
+    SDL_mutex* mutex;
+    SDL_cond* startCond;        // 有新一批任务，或退出
+    SDL_cond* doneCond;         // 有一批任务全部完成
+    SDL_Thread** threads;
+    int count;                  // 并行度，后台线程数为 count - 1
+
+    WorkerBatch* head;          // 还有任务没有领取的批次，按提交顺序排列
+    WorkerBatch* tail;
+    bool quit;
+}Workers;
+
+// 从 batch 领取一个任务，领完最后一个时把它移出链表，调用时需持有 mutex
+static int claimJob(Workers* workers, WorkerBatch* batch)
+{
+    int index = batch->next++;
+    if (batch->next < batch->jobs)
+        return index;
+
+    WorkerBatch* prev = NULL;
+    for (WorkerBatch* p = workers->head; p != batch; p = p->link)
+        prev = p;
+
+    if (prev == NULL)
+        workers->head = batch->link;
+    else
+        prev->link = batch->link;
+
+    if (workers->tail == batch)
+        workers->tail = prev;
+
+    return index;
+}
+
+// 执行 batch 中序号为 index 的任务，调用时需持有 mutex
+static void runJob(Workers* workers, WorkerBatch* batch, int index)
+{
+    SDL_UnlockMutex(workers->mutex);
+    batch->task(batch->userdata, index);
+    SDL_LockMutex(workers->mutex);
+
+    batch->done += 1;
+    if (batch->done == batch->jobs)
+        SDL_CondBroadcast(workers->doneCond);
+}
+
+// 后台线程领取最早提交的批次中的任务，多个调用者的任务交错执行
+static int workerThread(void* userdata)
+{
+    Workers* workers = (Workers*)(userdata);
+
+    SDL_LockMutex(workers->mutex);
+    while (true)
+    {
+        while (workers->head == NULL && !workers->quit)
+            SDL_CondWait(workers->startCond, workers->mutex);
+
+        if (workers->quit)
+            break;
+
+        WorkerBatch* batch = workers->head;
+        runJob(workers, batch, claimJob(workers, batch));
+    }
+    SDL_UnlockMutex(workers->mutex);
+
+    return EXIT_SUCCESS;
+}
+
+Workers* createWorkers(int count)
+{
+    Workers* workers = malloc(sizeof(Workers));
+    if (workers == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    if (count <= 0)
+        count = SDL_GetCPUCount();
+
+    workers->mutex = SDL_CreateMutex();
+    workers->startCond = SDL_CreateCond();
+    workers->doneCond = SDL_CreateCond();
+    workers->count = count;
+    workers->head = NULL;
+    workers->tail = NULL;
+    workers->quit = false;
+
+    workers->threads = calloc(count, sizeof(SDL_Thread*));
+    if (workers->threads == NULL)
+    {
+        fprintf(stderr,  "%s:%d bad alloc\n", __FILE__, __LINE__);
+        deleteWorkers(workers);
+        return NULL;
+    }
+
+    for (int i = 1; i < count; i++)
+        workers->threads[i] = SDL_CreateThread(workerThread, "worker", workers);
+
+    return workers;
+}
+
+void deleteWorkers(Workers* workers)
+{
+    if (workers == NULL)
+        return;
+
+    if (workers->threads != NULL)
+    {
+        SDL_LockMutex(workers->mutex);
+        workers->quit = true;
+        SDL_CondBroadcast(workers->startCond);
+        SDL_UnlockMutex(workers->mutex);
+
+        for (int i = 1; i < workers->count; i++)
+            SDL_WaitThread(workers->threads[i], NULL);
+
+        free(workers->threads);
+    }
+
+    SDL_DestroyCond(workers->doneCond);
+    SDL_DestroyCond(workers->startCond);
+    SDL_DestroyMutex(workers->mutex);
+    free(workers);
+}
+
+void runWorkers(Workers* workers, WorkerTask task, void* userdata, int jobs)
+{
+    if (jobs <= 0)
+        return;
+
+    WorkerBatch batch = {task, userdata, jobs, 0, 0, NULL};
+    SDL_LockMutex(workers->mutex);
+    if (workers->tail == NULL)
+        workers->head = &batch;
+    else
+        workers->tail->link = &batch;
+    workers->tail = &batch;
+    SDL_CondBroadcast(workers->startCond);
+
+    // 调用线程只领取自己这一批的任务，然后等待后台线程完成剩余的任务
+    while (batch.next < batch.jobs)
+        runJob(workers, &batch, claimJob(workers, &batch));
+
+    while (batch.done < batch.jobs)
+        SDL_CondWait(workers->doneCond, workers->mutex);
+    SDL_UnlockMutex(workers->mutex);
+}
+
+int countWorkers(Workers* workers)
+{
+    return workers->count;
+}
@@ -0,0 +1,21 @@
+#ifndef FFMPEG_PLAYER_DEMO_WORKER
+#define FFMPEG_PLAYER_DEMO_WORKER
+
+#include <stdbool.h>
+
+typedef struct Workers Workers;
+
+// 任务函数，index 为任务序号
+typedef void (*WorkerTask)(void* userdata, int index);
+
+// 创建常驻线程池，count 为并行度（包括调用 runWorkers 的线程），0 表示 CPU 核心数
+Workers* createWorkers(int count);
+void deleteWorkers(Workers* workers);
+
+// 并行执行 task(userdata, 0) ... task(userdata, jobs - 1)，全部完成后返回
+// 调用线程也参与执行；多个线程可以同时调用，各自的任务排在一起，后台线程按提交顺序领取
+void runWorkers(Workers* workers, WorkerTask task, void* userdata, int jobs);
+
+int countWorkers(Workers* workers);
+
+#endif // FFMPEG_PLAYER_DEMO_WORKER